@@ -0,0 +1,289 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "CpuProfiler.h"
+#include "WorkerPool.h"
+
+// Rayleigh + Mie atmosphere in planet radii: the ground is r = 1, the top of
+// the atmosphere r = top. Earth's coefficients with the scale heights
+// stretched 5x (and the coefficients divided by 5, so the vertical optical
+// depth is unchanged) to make the shell visible at the scene's scale.
+struct AtmosphereParams {
+    float top = 1.05f;
+    glm::vec3 rayleigh = glm::vec3(7.4f, 17.2f, 42.1f);   // scattering at the ground, per radius
+    float rayleighHeight = 0.0063f;
+    float mie = 4.2f;                                      // scattering at the ground, per radius
+    float mieExtinction = 4.67f;
+    float mieHeight = 0.00094f;
+    float mieG = 0.76f;
+};
+
+// Precomputed single scattering after Bruneton & Neyret, built once on the
+// CPU and sampled by glsl/atmosphere.glsl:
+//   transmittance  T(r, mu) from r along mu to the top of the atmosphere,
+//                  for rays that do not hit the ground (RGB, 256 x 64)
+//   inscatter      S(r, mu, mu_s) along the view ray to the ground or the top
+//                  without the phase functions: Rayleigh in RGB, Mie red in
+//                  A (128 x 32 x 32)
+// The full 4D table also depends on the view-sun azimuth; it is dropped by
+// assuming the sun in the view plane, which is what the limb glow needs.
+// Mappings (x in [0, 1] across each axis, texel i at x = i / (n - 1)):
+//   r     x^2 between 1 and top
+//   mu    T: x^2 from the horizon up. S: ground rays in the first half,
+//         x^2 away from the horizon on both sides
+//   mu_s  linear in [-0.2, 1]
+// Tables are cached on disk keyed by the parameters and sizes.
+class AtmosphereTables {
+public:
+    static const int T_MU = 256, T_R = 64;
+    static const int S_MU = 128, S_MUS = 32, S_R = 32;
+    static const int T_STEPS = 128, S_STEPS = 64;
+
+private:
+    AtmosphereParams m_params;
+    std::vector<glm::vec3> m_transmittance;   // [r][mu]
+    std::vector<glm::vec4> m_inscatter;       // [r][mu_s][mu]
+    unsigned m_threads = 0;
+    unsigned int m_textures[2] = {};
+
+    static float horizon(float r) { return -std::sqrt(std::max(1.0f - 1.0f / (r * r), 0.0f)); }
+    float radiusAt(float x) const { return 1.0f + (m_params.top - 1.0f) * x * x; }
+
+    glm::vec3 extinction(float r) const {
+        float h = std::max(r - 1.0f, 0.0f);
+        return m_params.rayleigh * std::exp(-h / m_params.rayleighHeight)
+             + glm::vec3(m_params.mieExtinction * std::exp(-h / m_params.mieHeight));
+    }
+
+    // Distance along mu to the ground, or to the top when the ray misses it.
+    float rayLength(float r, float mu, bool& ground) const {
+        float ground2 = r * r * (mu * mu - 1.0f) + 1.0f;
+        ground = mu < horizon(r) && ground2 >= 0.0f;
+        if (ground) return std::max(-r * mu - std::sqrt(ground2), 0.0f);
+        return std::max(-r * mu + std::sqrt(std::max(r * r * (mu * mu - 1.0f) + m_params.top * m_params.top, 0.0f)), 0.0f);
+    }
+
+    void buildTransmittance(int r0, int r1) {
+        for (int ir = r0; ir < r1; ++ir) {
+            float r = radiusAt((float)ir / (T_R - 1));
+            float muH = horizon(r);
+            for (int im = 0; im < T_MU; ++im) {
+                float x = (float)im / (T_MU - 1);
+                float mu = muH + (1.0f - muH) * x * x;
+                float d = -r * mu + std::sqrt(std::max(r * r * (mu * mu - 1.0f) + m_params.top * m_params.top, 0.0f));
+                float dt = d / T_STEPS;
+                glm::vec3 depth(0.0f);
+                for (int s = 0; s < T_STEPS; ++s) {
+                    float t = (s + 0.5f) * dt;
+                    depth += extinction(std::sqrt(r * r + t * t + 2.0f * r * mu * t)) * dt;
+                }
+                m_transmittance[ir * T_MU + im] = glm::exp(-depth);
+            }
+        }
+    }
+
+    void buildInscatter(int r0, int r1) {
+        const int halfMu = S_MU / 2;
+        for (int ir = r0; ir < r1; ++ir) {
+            float r = radiusAt((float)ir / (S_R - 1));
+            float muH = horizon(r);
+            for (int is = 0; is < S_MUS; ++is) {
+                float muS = -0.2f + 1.2f * is / (S_MUS - 1);
+                for (int im = 0; im < S_MU; ++im) {
+                    float mu;
+                    if (im < halfMu) {
+                        float x = 1.0f - (float)im / (halfMu - 1);
+                        mu = muH - (1.0f + muH) * x * x;
+                    } else {
+                        float x = (float)(im - halfMu) / (halfMu - 1);
+                        mu = muH + (1.0f - muH) * x * x;
+                    }
+                    m_inscatter[(ir * S_MUS + is) * S_MU + im] = singleScattering(r, mu, muS);
+                }
+            }
+        }
+    }
+
+    glm::vec4 singleScattering(float r, float mu, float muS) const {
+        float nu = mu * muS + std::sqrt(std::max((1.0f - mu * mu) * (1.0f - muS * muS), 0.0f));
+        bool ground;
+        float dt = rayLength(r, mu, ground) / S_STEPS;
+        glm::vec3 depth(0.0f), rayleigh(0.0f), mie(0.0f);
+        for (int s = 0; s < S_STEPS; ++s) {
+            float t = (s + 0.5f) * dt;
+            float ry = std::sqrt(r * r + t * t + 2.0f * r * mu * t);
+            float h = std::max(ry - 1.0f, 0.0f);
+            float dR = std::exp(-h / m_params.rayleighHeight), dM = std::exp(-h / m_params.mieHeight);
+            glm::vec3 step = (m_params.rayleigh * dR + glm::vec3(m_params.mieExtinction * dM)) * dt;
+            glm::vec3 toEye = glm::exp(-(depth + 0.5f * step));
+            depth += step;
+            float muSy = (r * muS + t * nu) / ry;
+            if (muSy < horizon(ry)) continue;   // the planet hides the sun
+            glm::vec3 light = toEye * transmittance(ry, muSy) * dt;
+            rayleigh += light * dR;
+            mie += light * dM;
+        }
+        return glm::vec4(rayleigh * m_params.rayleigh, mie.r * m_params.mie);
+    }
+
+    // Splits [0, rows) over WorkerPool::shared().
+    template <typename Fn>
+    void parallelRows(int rows, Fn fn) {
+        WorkerPool& pool = WorkerPool::shared();
+        unsigned threads = m_threads ? m_threads : pool.size();
+        threads = std::min<unsigned>(threads, rows);
+        pool.run(threads, [&](unsigned t) {
+            PROFILE_SCOPE("atmosphere rows");
+            fn(rows * t / threads, rows * (t + 1) / threads);
+        });
+    }
+
+    std::uint64_t hash() const {
+        const int dims[] = { T_MU, T_R, S_MU, S_MUS, S_R, T_STEPS, S_STEPS, 1 };
+        std::uint64_t h = 1469598103934665603ull;
+        auto mix = [&h](const void* p, std::size_t n) {
+            for (std::size_t i = 0; i < n; ++i) h = (h ^ static_cast<const unsigned char*>(p)[i]) * 1099511628211ull;
+        };
+        mix(&m_params, sizeof(m_params));
+        mix(dims, sizeof(dims));
+        return h;
+    }
+
+    std::string cachePath(const std::string& dir) const {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.lut", (unsigned long long)hash());
+        return dir + "/" + name;
+    }
+
+public:
+    explicit AtmosphereTables(const AtmosphereParams& params = AtmosphereParams()) : m_params(params) {}
+
+    ~AtmosphereTables() {
+        if (m_textures[0]) glDeleteTextures(2, m_textures);
+    }
+
+    // Jobs on WorkerPool::shared(); 0 picks one per pool thread.
+    void setThreads(unsigned threads) { m_threads = threads; }
+
+    void build() {
+        m_transmittance.assign(T_R * T_MU, glm::vec3(0.0f));
+        m_inscatter.assign(S_R * S_MUS * S_MU, glm::vec4(0.0f));
+        // Inscatter reads the finished transmittance table.
+        parallelRows(T_R, [this](int r0, int r1) { buildTransmittance(r0, r1); });
+        parallelRows(S_R, [this](int r0, int r1) { buildInscatter(r0, r1); });
+    }
+
+    // File: "ATL1", hash, transmittance, inscatter.
+    bool load(const std::string& dir) {
+        std::ifstream in(cachePath(dir), std::ios::binary);
+        if (!in) return false;
+        char magic[4];
+        std::uint64_t storedHash = 0;
+        in.read(magic, 4);
+        in.read(reinterpret_cast<char*>(&storedHash), sizeof(storedHash));
+        if (!in || std::string(magic, 4) != "ATL1" || storedHash != hash()) return false;
+        m_transmittance.resize(T_R * T_MU);
+        m_inscatter.resize(S_R * S_MUS * S_MU);
+        in.read(reinterpret_cast<char*>(m_transmittance.data()), m_transmittance.size() * sizeof(glm::vec3));
+        in.read(reinterpret_cast<char*>(m_inscatter.data()), m_inscatter.size() * sizeof(glm::vec4));
+        if (in) return true;
+        m_transmittance.clear();
+        m_inscatter.clear();
+        return false;
+    }
+
+    void save(const std::string& dir) const {
+        std::error_code ec;
+        std::filesystem::create_directories(dir, ec);
+        std::ofstream out(cachePath(dir), std::ios::binary);
+        if (!out) return;
+        std::uint64_t h = hash();
+        out.write("ATL1", 4);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(m_transmittance.data()), m_transmittance.size() * sizeof(glm::vec3));
+        out.write(reinterpret_cast<const char*>(m_inscatter.data()), m_inscatter.size() * sizeof(glm::vec4));
+    }
+
+    // Returns true when the tables came from the cache.
+    bool loadOrBuild(const std::string& dir) {
+        PROFILE_SCOPE("atmosphere tables");
+        if (load(dir)) return true;
+        build();
+        save(dir);
+        return false;
+    }
+
+    // Bilinear lookup in the transmittance table, as the shaders do it.
+    glm::vec3 transmittance(float r, float mu) const {
+        float muH = horizon(r);
+        float x = std::sqrt(std::clamp((mu - muH) / (1.0f - muH), 0.0f, 1.0f)) * (T_MU - 1);
+        float y = std::sqrt(std::clamp((r - 1.0f) / (m_params.top - 1.0f), 0.0f, 1.0f)) * (T_R - 1);
+        int x0 = std::min((int)x, T_MU - 2), y0 = std::min((int)y, T_R - 2);
+        float fx = x - x0, fy = y - y0;
+        const glm::vec3* row0 = &m_transmittance[y0 * T_MU];
+        const glm::vec3* row1 = row0 + T_MU;
+        return glm::mix(glm::mix(row0[x0], row0[x0 + 1], fx), glm::mix(row1[x0], row1[x0 + 1], fx), fy);
+    }
+
+    void upload() {
+        if (!m_textures[0]) {
+            glGenTextures(2, m_textures);
+            glBindTexture(GL_TEXTURE_2D, m_textures[0]);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_3D, m_textures[1]);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, m_textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, T_MU, T_R, 0, GL_RGB, GL_FLOAT, m_transmittance.data());
+        glBindTexture(GL_TEXTURE_3D, m_textures[1]);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, S_MU, S_MUS, S_R, 0, GL_RGBA, GL_FLOAT, m_inscatter.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Transmittance on firstUnit, inscatter on firstUnit + 1.
+    void bind(unsigned int firstUnit) const {
+        glActiveTexture(GL_TEXTURE0 + firstUnit);
+        glBindTexture(GL_TEXTURE_2D, m_textures[0]);
+        glActiveTexture(GL_TEXTURE0 + firstUnit + 1);
+        glBindTexture(GL_TEXTURE_3D, m_textures[1]);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // #defines for glsl/atmosphere.glsl.
+    std::vector<std::string> shaderConstants() const {
+        char buf[128];
+        std::vector<std::string> out;
+        std::snprintf(buf, sizeof(buf), "ATMOSPHERE_TOP %.9g", m_params.top);
+        out.push_back(buf);
+        std::snprintf(buf, sizeof(buf), "ATMOSPHERE_RAYLEIGH vec3(%.9g, %.9g, %.9g)",
+                      m_params.rayleigh.x, m_params.rayleigh.y, m_params.rayleigh.z);
+        out.push_back(buf);
+        std::snprintf(buf, sizeof(buf), "ATMOSPHERE_MIE_G %.9g", m_params.mieG);
+        out.push_back(buf);
+        std::snprintf(buf, sizeof(buf), "ATMOSPHERE_TRANSMITTANCE_SIZE vec2(%d.0, %d.0)", T_MU, T_R);
+        out.push_back(buf);
+        std::snprintf(buf, sizeof(buf), "ATMOSPHERE_INSCATTER_SIZE vec3(%d.0, %d.0, %d.0)", S_MU, S_MUS, S_R);
+        out.push_back(buf);
+        return out;
+    }
+
+    const AtmosphereParams& params() const { return m_params; }
+    const glm::vec4& inscatter(int r, int muS, int mu) const { return m_inscatter[(r * S_MUS + muS) * S_MU + mu]; }
+    std::size_t bytes() const { return m_transmittance.size() * sizeof(glm::vec3) + m_inscatter.size() * sizeof(glm::vec4); }
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// One complete ("X") event of a Chrome trace, viewable in chrome://tracing
+// or Perfetto. Times are microseconds on the steady clock (traceNowUs), so
+// events from the GPU profiler and CPU scopes line up on one timeline.
+struct TraceEvent {
+    const char* name;    // static string
+    const char* track;   // row in the viewer: "GPU", "main", ...
+    double startUs, durationUs;
+    int depth;
+};
+
+inline double traceNowUs() {
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Writes `events` as a trace file, one thread row per track (named with
+// metadata events, in order of first appearance).
+inline bool writeChromeTrace(const std::string& path, const std::vector<TraceEvent>& events) {
+    FILE* f = std::fopen(path.c_str(), "w");
+    if (!f) return false;
+    std::vector<std::string> tracks;
+    auto trackId = [&](const char* track) {
+        for (std::size_t i = 0; i < tracks.size(); ++i)
+            if (tracks[i] == track) return (int)i + 1;
+        tracks.push_back(track);
+        return (int)tracks.size();
+    };
+    auto escaped = [](const char* s) {
+        std::string out;
+        for (; *s; ++s) {
+            if (*s == '"' || *s == '\\') out.push_back('\\');
+            out.push_back(*s);
+        }
+        return out;
+    };
+    std::fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (const TraceEvent& e : events) {
+        std::fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                     first ? "" : ",\n", escaped(e.name).c_str(), trackId(e.track), e.startUs, e.durationUs);
+        first = false;
+    }
+    for (std::size_t i = 0; i < tracks.size(); ++i)
+        std::fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                     first && i == 0 ? "" : ",\n", (int)i + 1, escaped(tracks[i].c_str()).c_str());
+    std::fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    bool ok = std::ferror(f) == 0;
+    std::fclose(f);
+    return ok;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <glm.hpp>
+#include "Registry.h"
+#include "SceneGraph.h"
+
+class Sphere;
+
+// `node` is the body's frame in the scene graph (its orbit position; moons
+// attach here), `body` the scaled, spinning child that is drawn. position and
+// renderPos are copied back from the graph after each update.
+struct Transform {
+    SceneGraph::NodeId node;
+    SceneGraph::NodeId body;
+    glm::dvec3 position;
+    glm::vec3 renderPos;
+};
+
+// Circular orbit in the xz plane around the parent node. `node` and Spin's
+// `body` repeat the entity's Transform ids, so their systems walk one pool
+// without looking the Transform up.
+struct OrbitalElements {
+    double radius;
+    double angle;
+    double speed;
+    double baseSpeed;
+    SceneGraph::NodeId node;
+};
+
+struct Spin {
+    glm::vec3 axis;
+    float speed;
+    SceneGraph::NodeId body;
+};
+
+struct RenderSphere {
+    Sphere* mesh;
+    float radius;
+    glm::vec3 color;
+};
+
+// Emissive bodies are drawn unlit and act as point lights.
+struct Emissive {
+    glm::vec3 color;
+    glm::vec3 ambient, diffuse, specular;
+    float constant, linear, quadratic;
+};
+
+struct ShadowCaster {
+    float radius;
+};
+
+// Planet with an atmosphere shell; `radius` is the ground, the shell is
+// AtmosphereParams::top times that.
+struct Atmosphere {
+    float radius;
+};
+
+using Registry = BasicRegistry<Transform, OrbitalElements, Spin, RenderSphere, Emissive, ShadowCaster, Atmosphere>;
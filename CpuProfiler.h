@@ -0,0 +1,193 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "ChromeTrace.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// CPU scopes for the Chrome trace, next to GpuProfiler's passes.
+//
+//   PROFILE_SCOPE("culling");   // times the rest of the enclosing block
+//
+// Each thread records into its own fixed ring (single producer, drained by
+// one consumer), so recording takes no lock: a timestamp read at each end
+// and a store. Timestamps are raw TSC ticks, mapped to the steady clock at
+// drain time. Scope names are string literals in a static tag, so a scope's
+// identity (and its hashed id) is fixed at compile time. With recording off
+// (the default) a scope costs one relaxed load; without SOLAR_PROFILE the
+// macro expands to nothing.
+struct CpuScopeTag {
+    const char* name;
+    std::uint32_t id;   // FNV-1a of the name
+};
+
+constexpr std::uint32_t cpuScopeId(const char* s, std::uint32_t h = 2166136261u) {
+    return *s ? cpuScopeId(s + 1, (h ^ (std::uint32_t)(unsigned char)*s) * 16777619u) : h;
+}
+
+class CpuProfiler {
+public:
+    struct Event {
+        const CpuScopeTag* tag;
+        std::uint64_t start, end;
+        std::uint32_t depth;
+    };
+
+    // Ring of one thread's events. Pooled: a thread returns it on exit and
+    // the next new thread takes it over, so short-lived threads reuse a
+    // handful of buffers (WorkerPool's threads keep theirs).
+    struct ThreadBuffer {
+        static constexpr std::uint32_t CAPACITY = 1u << 14;
+        std::unique_ptr<Event[]> events{ new Event[CAPACITY] };
+        std::atomic<std::uint32_t> head{0}, tail{0};
+        std::atomic<std::uint64_t> dropped{0};
+        std::uint32_t depth = 0;
+        char name[32] = {};
+    };
+
+    static std::uint64_t ticks() {
+#if defined(_MSC_VER) || defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+    static void setEnabled(bool on) {
+        registry();   // calibration starts before the first event
+        s_enabled.store(on, std::memory_order_relaxed);
+    }
+
+    // Names the calling thread's row in the trace.
+    static void setThreadName(const char* name) {
+        ThreadBuffer* b = buffer();
+        std::snprintf(b->name, sizeof(b->name), "%s", name);
+    }
+
+    // Called on b's own thread only.
+    static void record(ThreadBuffer* b, const CpuScopeTag* tag, std::uint64_t start, std::uint64_t end,
+                       std::uint32_t depth) {
+        std::uint32_t head = b->head.load(std::memory_order_relaxed);
+        if (head - b->tail.load(std::memory_order_acquire) == ThreadBuffer::CAPACITY) {
+            b->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        b->events[head % ThreadBuffer::CAPACITY] = { tag, start, end, depth };
+        b->head.store(head + 1, std::memory_order_release);
+    }
+
+    static ThreadBuffer* buffer() {
+        thread_local ThreadSlot slot;
+        if (!slot.buffer) slot.buffer = registry().acquire();
+        return slot.buffer;
+    }
+
+    // Moves every event recorded so far, on any thread, into `out` as trace
+    // events. Threads may keep recording meanwhile; a full ring drops new
+    // events (counted in dropped()) until it is drained.
+    static void drain(std::vector<TraceEvent>& out) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        // Ticks per microsecond over everything since the registry started.
+        std::uint64_t nowTicks = ticks();
+        double nowUs = traceNowUs();
+        double rate = nowUs > r.originUs ? (double)(nowTicks - r.originTicks) / (nowUs - r.originUs) : 1e3;
+        for (const std::unique_ptr<ThreadBuffer>& b : r.buffers) {
+            std::uint32_t tail = b->tail.load(std::memory_order_relaxed);
+            std::uint32_t head = b->head.load(std::memory_order_acquire);
+            for (; tail != head; ++tail) {
+                const Event& e = b->events[tail % ThreadBuffer::CAPACITY];
+                double start = r.originUs + (double)(std::int64_t)(e.start - r.originTicks) / rate;
+                out.push_back({ e.tag->name, b->name, start, (double)(e.end - e.start) / rate, (int)e.depth });
+            }
+            b->tail.store(head, std::memory_order_release);
+        }
+    }
+
+    static std::uint64_t dropped() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        std::uint64_t n = 0;
+        for (const std::unique_ptr<ThreadBuffer>& b : r.buffers) n += b->dropped.load(std::memory_order_relaxed);
+        return n;
+    }
+
+private:
+    struct Registry {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+        std::vector<ThreadBuffer*> free;
+        std::uint64_t originTicks = ticks();
+        double originUs = traceNowUs();
+
+        ThreadBuffer* acquire() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!free.empty()) {
+                ThreadBuffer* b = free.back();
+                free.pop_back();
+                return b;
+            }
+            buffers.push_back(std::make_unique<ThreadBuffer>());
+            std::snprintf(buffers.back()->name, sizeof(buffers.back()->name), "thread %d", (int)buffers.size());
+            return buffers.back().get();
+        }
+        void release(ThreadBuffer* b) {
+            std::lock_guard<std::mutex> lock(mutex);
+            b->depth = 0;
+            free.push_back(b);
+        }
+    };
+    struct ThreadSlot {
+        ThreadBuffer* buffer = nullptr;
+        ~ThreadSlot() { if (buffer) registry().release(buffer); }
+    };
+
+    static Registry& registry() {
+        static Registry r;
+        return r;
+    }
+
+    static inline std::atomic<bool> s_enabled{false};
+};
+
+class CpuScope {
+private:
+    const CpuScopeTag* m_tag;
+    CpuProfiler::ThreadBuffer* m_buffer = nullptr;   // null while recording is off
+    std::uint64_t m_start = 0;
+
+public:
+    explicit CpuScope(const CpuScopeTag* tag) : m_tag(tag) {
+        if (!CpuProfiler::enabled()) return;
+        m_buffer = CpuProfiler::buffer();
+        ++m_buffer->depth;
+        m_start = CpuProfiler::ticks();
+    }
+    ~CpuScope() {
+        if (!m_buffer) return;
+        std::uint64_t end = CpuProfiler::ticks();
+        CpuProfiler::record(m_buffer, m_tag, m_start, end, --m_buffer->depth);
+    }
+    CpuScope(const CpuScope&) = delete;
+    CpuScope& operator=(const CpuScope&) = delete;
+};
+
+#ifdef SOLAR_PROFILE
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name)                                                                              \
+    static constexpr CpuScopeTag PROFILE_CONCAT(profileTag_, __LINE__) = { name, cpuScopeId(name) };     \
+    CpuScope PROFILE_CONCAT(profileScope_, __LINE__)(&PROFILE_CONCAT(profileTag_, __LINE__))
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
@@ -0,0 +1,100 @@
+#pragma once
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <vector>
+
+enum class EclipseType { Solar, Lunar };
+
+struct EclipseEvent {
+    double time;
+    EclipseType type;
+    bool operator>(const EclipseEvent& o) const { return time > o.time; }
+};
+
+// Angles and angular speeds of the earth around the sun and of the moon
+// around the earth. Both orbits lie in the same plane and both angles are
+// measured from the world x axis, so the bodies are in syzygy whenever
+// moonAngle - earthAngle is a multiple of pi.
+struct OrbitPhase {
+    double earthAngle = 0.0, moonAngle = 0.0;
+    double earthSpeed = 0.0, moonSpeed = 0.0;
+};
+
+// Predicts syzygies analytically instead of polling alignment every frame.
+// Between speed changes the relative phase is linear in time, so the next
+// crossing of each target angle is exact and the caller can land on it
+// regardless of frame length. Call reset() whenever the speeds change.
+class EclipsePredictor {
+private:
+    static constexpr double TWO_PI = 6.28318530717958647692;
+    static constexpr double PI = 3.14159265358979323846;
+
+    OrbitPhase m_phase;
+    double m_epoch = 0.0;
+    std::priority_queue<EclipseEvent, std::vector<EclipseEvent>, std::greater<EclipseEvent>> m_queue;
+
+    // Moon between sun and earth (solar) puts the moon at earthAngle + pi as
+    // seen from the earth; moon behind the earth (lunar) at earthAngle.
+    static double targetSeparation(EclipseType type) {
+        return type == EclipseType::Solar ? PI : 0.0;
+    }
+
+    double relativeSpeed() const { return m_phase.moonSpeed - m_phase.earthSpeed; }
+
+    double separationAt(double t) const {
+        return (m_phase.moonAngle - m_phase.earthAngle) + relativeSpeed() * (t - m_epoch);
+    }
+
+    // First time strictly after `after` when the separation crosses the
+    // target angle, or a negative value if the phase is frozen.
+    double nextCrossing(EclipseType type, double after) const {
+        double w = relativeSpeed();
+        if (std::abs(w) < 1e-12) return -1.0;
+
+        double delta = targetSeparation(type) - separationAt(after);
+        if (w > 0.0) delta = std::fmod(delta, TWO_PI);
+        else         delta = -std::fmod(-delta, TWO_PI);
+        if (delta * w <= 0.0) delta += w > 0.0 ? TWO_PI : -TWO_PI;
+
+        double dt = delta / w;
+        // Skip the event we are sitting on (e.g. just after stopping at it).
+        if (dt < 1e-9) dt += TWO_PI / std::abs(w);
+        return after + dt;
+    }
+
+    void schedule(EclipseType type, double after) {
+        double t = nextCrossing(type, after);
+        if (t >= 0.0) m_queue.push({ t, type });
+    }
+
+public:
+    void reset(const OrbitPhase& phase, double now) {
+        m_phase = phase;
+        m_epoch = now;
+        m_queue = {};
+        schedule(EclipseType::Solar, now);
+        schedule(EclipseType::Lunar, now);
+    }
+
+    bool empty() const { return m_queue.empty(); }
+    const EclipseEvent& peek() const { return m_queue.top(); }
+
+    // Removes the earliest event and schedules the next one of the same type.
+    EclipseEvent pop() {
+        EclipseEvent e = m_queue.top();
+        m_queue.pop();
+        schedule(e.type, e.time);
+        return e;
+    }
+
+    const OrbitPhase& phase() const { return m_phase; }
+
+    // Batch mode: every eclipse in [from, to) for a fixed phase.
+    std::vector<EclipseEvent> listEvents(const OrbitPhase& phase, double from, double to) {
+        reset(phase, from);
+        std::vector<EclipseEvent> events;
+        while (!empty() && peek().time < to) events.push_back(pop());
+        return events;
+    }
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <glm.hpp>
+#include <cstddef>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FLOATING_ORIGIN_SSE2 1
+#endif
+
+// Simulation state lives in double precision world space; the GPU only ever
+// sees positions relative to the camera, converted to float after the
+// subtraction so large coordinates never lose precision in float.
+//
+// glm::dvec3 arrays are tightly packed (3 doubles each), so two bodies are
+// six doubles = three SSE2 registers, with the origin pattern repeating every
+// three registers: (ox,oy) (oz,ox) (oy,oz).
+inline void rebaseToOrigin(const glm::dvec3* in, glm::vec3* out, std::size_t count, const glm::dvec3& origin) {
+    static_assert(sizeof(glm::dvec3) == 3 * sizeof(double), "dvec3 must be tightly packed");
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "vec3 must be tightly packed");
+
+    std::size_t i = 0;
+#ifdef FLOATING_ORIGIN_SSE2
+    const double* src = &in[0].x;
+    float* dst = &out[0].x;
+    const __m128d o0 = _mm_set_pd(origin.y, origin.x);
+    const __m128d o1 = _mm_set_pd(origin.x, origin.z);
+    const __m128d o2 = _mm_set_pd(origin.z, origin.y);
+    for (; i + 2 <= count; i += 2, src += 6, dst += 6) {
+        __m128 a = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(src + 0), o0));
+        __m128 b = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(src + 2), o1));
+        __m128 c = _mm_cvtpd_ps(_mm_sub_pd(_mm_loadu_pd(src + 4), o2));
+        _mm_storel_pi(reinterpret_cast<__m64*>(dst + 0), a);
+        _mm_storel_pi(reinterpret_cast<__m64*>(dst + 2), b);
+        _mm_storel_pi(reinterpret_cast<__m64*>(dst + 4), c);
+    }
+#endif
+    for (; i < count; ++i)
+        out[i] = glm::vec3(in[i] - origin);
+}
+
+inline glm::vec3 rebaseToOrigin(const glm::dvec3& p, const glm::dvec3& origin) {
+    return glm::vec3(p - origin);
+}
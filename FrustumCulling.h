@@ -0,0 +1,146 @@
+#pragma once
+#include <glm.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FRUSTUM_CULLING_SSE 1
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FRUSTUM_CULLING_AVX 1
+#endif
+
+// The six planes of projection * view (Gribb & Hartmann): left, right,
+// bottom, top, near, far, each normalized with its normal pointing inwards.
+// Passing projection * view * model gives them in model space.
+inline void frustumPlanes(const glm::mat4& m, glm::vec4 planes[6]) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i) rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    planes[0] = rows[3] + rows[0];
+    planes[1] = rows[3] - rows[0];
+    planes[2] = rows[3] + rows[1];
+    planes[3] = rows[3] - rows[1];
+    planes[4] = rows[3] + rows[2];
+    planes[5] = rows[3] - rows[2];
+    for (int i = 0; i < 6; ++i) planes[i] /= glm::length(glm::vec3(planes[i]));
+}
+
+// Bounding-sphere frustum culling. With normalized planes a sphere is
+// outside when its center is more than its radius behind any plane.
+// Spheres are kept as SoA and tested eight at a time with AVX (when the
+// build enables it) or four at a time with SSE; the ids of the survivors
+// come out as a compact list, in insertion order. Spheres with a NaN
+// coordinate are culled on every path.
+class FrustumCuller {
+public:
+    enum class Path { Scalar, SSE, AVX };
+
+private:
+    glm::vec4 m_planes[6] = {};
+    std::vector<float> m_x, m_y, m_z, m_r;
+    std::vector<std::uint32_t> m_ids;
+    Path m_path = bestPath();
+
+    bool insideScalar(std::size_t j) const {
+        for (const glm::vec4& p : m_planes)
+            if (!((m_x[j] * p.x + m_y[j] * p.y) + (m_z[j] * p.z + p.w) >= -m_r[j])) return false;
+        return true;
+    }
+
+public:
+    static Path bestPath() {
+#if defined(FRUSTUM_CULLING_AVX)
+        return Path::AVX;
+#elif defined(FRUSTUM_CULLING_SSE)
+        return Path::SSE;
+#else
+        return Path::Scalar;
+#endif
+    }
+
+    // Falls back to the best compiled-in path when `path` is not available.
+    void setPath(Path path) {
+#ifndef FRUSTUM_CULLING_AVX
+        if (path == Path::AVX) path = bestPath();
+#endif
+#ifndef FRUSTUM_CULLING_SSE
+        if (path == Path::SSE) path = bestPath();
+#endif
+        m_path = path;
+    }
+    Path path() const { return m_path; }
+
+    void setPlanes(const glm::mat4& viewProjection) { frustumPlanes(viewProjection, m_planes); }
+
+    void clear() {
+        m_x.clear(); m_y.clear(); m_z.clear(); m_r.clear();
+        m_ids.clear();
+    }
+
+    void reserve(std::size_t n) {
+        m_x.reserve(n); m_y.reserve(n); m_z.reserve(n); m_r.reserve(n);
+        m_ids.reserve(n);
+    }
+
+    void add(const glm::vec3& center, float radius, std::uint32_t id) {
+        m_x.push_back(center.x); m_y.push_back(center.y); m_z.push_back(center.z); m_r.push_back(radius);
+        m_ids.push_back(id);
+    }
+
+    void cull(std::vector<std::uint32_t>& visible) const {
+        std::size_t count = m_x.size();
+        visible.resize(count);
+        std::uint32_t* out = visible.data();
+        std::size_t j = 0;
+
+#ifdef FRUSTUM_CULLING_AVX
+        if (m_path == Path::AVX) {
+            for (; j + 8 <= count; j += 8) {
+                __m256 x = _mm256_loadu_ps(&m_x[j]), y = _mm256_loadu_ps(&m_y[j]), z = _mm256_loadu_ps(&m_z[j]);
+                __m256 negR = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&m_r[j]));
+                __m256 inside = _mm256_cmp_ps(negR, negR, _CMP_EQ_OQ);
+                for (const glm::vec4& p : m_planes) {
+                    __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(p.x)), _mm256_mul_ps(y, _mm256_set1_ps(p.y))),
+                                             _mm256_add_ps(_mm256_mul_ps(z, _mm256_set1_ps(p.z)), _mm256_set1_ps(p.w)));
+                    inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, negR, _CMP_GE_OQ));
+                }
+                int mask = _mm256_movemask_ps(inside);
+                while (mask) {
+                    int bit = 0;
+                    while (!(mask & (1 << bit))) ++bit;
+                    *out++ = m_ids[j + bit];
+                    mask &= mask - 1;
+                }
+            }
+        }
+#endif
+#ifdef FRUSTUM_CULLING_SSE
+        if (m_path != Path::Scalar) {
+            for (; j + 4 <= count; j += 4) {
+                __m128 x = _mm_loadu_ps(&m_x[j]), y = _mm_loadu_ps(&m_y[j]), z = _mm_loadu_ps(&m_z[j]);
+                __m128 negR = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&m_r[j]));
+                __m128 inside = _mm_cmpeq_ps(negR, negR);
+                for (const glm::vec4& p : m_planes) {
+                    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(p.x)), _mm_mul_ps(y, _mm_set1_ps(p.y))),
+                                          _mm_add_ps(_mm_mul_ps(z, _mm_set1_ps(p.z)), _mm_set1_ps(p.w)));
+                    inside = _mm_and_ps(inside, _mm_cmpge_ps(d, negR));
+                }
+                int mask = _mm_movemask_ps(inside);
+                while (mask) {
+                    int bit = 0;
+                    while (!(mask & (1 << bit))) ++bit;
+                    *out++ = m_ids[j + bit];
+                    mask &= mask - 1;
+                }
+            }
+        }
+#endif
+        for (; j < count; ++j)
+            if (insideScalar(j)) *out++ = m_ids[j];
+        visible.resize(out - visible.data());
+    }
+
+    std::size_t size() const { return m_x.size(); }
+};
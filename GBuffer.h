@@ -0,0 +1,115 @@
+#pragma once
+#include <GL/glew.h>
+#include <iostream>
+
+// G-buffer for the deferred path (gbuffer.fs writes it, deferred-lighting.fs
+// reads it):
+//   0 RGBA8    albedo, a = 1 for emissive (albedo is then the final color),
+//              0.5 for bodies lit through an atmosphere
+//   1 RG16F    octahedral-encoded normal
+//   2 RG32UI   the receiver's occluder list (offset, count) for the
+//              analytic shadows
+//   depth      DEPTH24_STENCIL8, view position is rebuilt from it; the
+//              window's format, so it can be blitted there (blitDepth)
+// Lighting then runs once per visible pixel, whatever the overdraw was.
+class GBuffer {
+private:
+    unsigned int m_fbo = 0;
+    unsigned int m_textures[4] = {};
+    unsigned int m_emptyVAO = 0;
+    int m_width = 0, m_height = 0;
+
+    void allocate() {
+        glBindTexture(GL_TEXTURE_2D, m_textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_width, m_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindTexture(GL_TEXTURE_2D, m_textures[1]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, m_width, m_height, 0, GL_RG, GL_FLOAT, nullptr);
+        glBindTexture(GL_TEXTURE_2D, m_textures[2]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32UI, m_width, m_height, 0, GL_RG_INTEGER, GL_UNSIGNED_INT, nullptr);
+        glBindTexture(GL_TEXTURE_2D, m_textures[3]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, m_width, m_height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+public:
+    GBuffer(int width, int height) : m_width(width), m_height(height) {
+        glGenTextures(4, m_textures);
+        for (unsigned int tex : m_textures) {
+            glBindTexture(GL_TEXTURE_2D, tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        allocate();
+
+        glGenFramebuffers(1, &m_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        for (int i = 0; i < 3; ++i)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, m_textures[i], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_textures[3], 0);
+        const GLenum drawBuffers[3] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2 };
+        glDrawBuffers(3, drawBuffers);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "G-buffer framebuffer incomplete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // Core profile needs a VAO bound even for attribute-less draws.
+        glGenVertexArrays(1, &m_emptyVAO);
+    }
+
+    ~GBuffer() {
+        glDeleteVertexArrays(1, &m_emptyVAO);
+        glDeleteFramebuffers(1, &m_fbo);
+        glDeleteTextures(4, m_textures);
+    }
+
+    void resize(int width, int height) {
+        if (width == m_width && height == m_height) return;
+        m_width = width;
+        m_height = height;
+        allocate();
+    }
+
+    // Binds and clears the G-buffer for the geometry pass.
+    void bindForGeometry() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glViewport(0, 0, m_width, m_height);
+        const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        const GLuint none[4] = { 0, 0, 0, 0 };
+        glClearBufferfv(GL_COLOR, 0, zero);
+        glClearBufferfv(GL_COLOR, 1, zero);
+        glClearBufferuiv(GL_COLOR, 2, none);
+        glClear(GL_DEPTH_BUFFER_BIT);
+    }
+
+    // Binds albedo, normal, occluders and depth to units firstUnit .. +3.
+    void bindTextures(unsigned int firstUnit) const {
+        for (int i = 0; i < 4; ++i) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_2D, m_textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Copies the scene depth into `target` (same size), so passes after the
+    // lighting can depth test against it; leaves `target` bound.
+    void blitDepth(unsigned int target) const {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+        glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    // Full-screen triangle generated from gl_VertexID.
+    void drawFullscreen() const {
+        glBindVertexArray(m_emptyVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    // RGBA8 + RG16F + RG32UI + DEPTH24_STENCIL8 per pixel.
+    std::size_t bytes() const { return (std::size_t)m_width * m_height * 20; }
+};
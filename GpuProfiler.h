@@ -0,0 +1,212 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <vector>
+#include "ChromeTrace.h"
+
+// GPU time per pass from pairs of timestamp queries, which nest where
+// GL_TIME_ELAPSED queries cannot. Each frame's queries go into one slot of a
+// ring that is only read back `latency` frames later, when the GPU is long
+// done with them; a slot still in flight by then is dropped rather than
+// waited on, so profiling never stalls the pipeline. Resolved scopes feed
+// rolling per-pass statistics and, when enabled, a Chrome trace on the
+// same clock as the CPU scopes.
+class GpuProfiler {
+public:
+    struct PassStats {
+        const char* name;
+        int depth;
+        double lastMs, averageMs, maxMs;
+    };
+
+private:
+    struct Scope {
+        const char* name;
+        int depth;
+        int begin, end;   // query indices in the frame
+    };
+    struct Frame {
+        std::vector<unsigned int> queries;
+        int used = 0;
+        std::vector<Scope> scopes;
+        double clockOffsetUs = 0.0;   // steady clock minus GPU clock
+        bool pending = false;
+    };
+    struct History {
+        const char* name;
+        int depth;
+        std::vector<float> samples;   // ring of the last `window` frames
+        std::size_t next = 0, count = 0;
+    };
+
+    std::vector<Frame> m_frames;
+    int m_current = 0;
+    std::vector<int> m_open;   // scope indices in the current frame
+    bool m_inFrame = false;
+    std::vector<History> m_history;
+    std::size_t m_window;
+    std::deque<TraceEvent> m_trace;
+    std::size_t m_traceCapacity = 0;
+    std::uint64_t m_dropped = 0;
+    // Reading GL_TIMESTAMP synchronises with the GPU, so the clock offset is
+    // only measured while tracing, and then every CALIBRATE_FRAMES frames.
+    static constexpr int CALIBRATE_FRAMES = 120;
+    double m_clockOffsetUs = 0.0;
+    int m_calibrateIn = 0;
+
+    int issue(Frame& f) {
+        if (f.used == (int)f.queries.size()) {
+            f.queries.push_back(0);
+            glGenQueries(1, &f.queries.back());
+        }
+        glQueryCounter(f.queries[f.used], GL_TIMESTAMP);
+        return f.used++;
+    }
+
+    History& history(const char* name, int depth) {
+        for (History& h : m_history)
+            if (std::strcmp(h.name, name) == 0) return h;
+        m_history.push_back({ name, depth, std::vector<float>(m_window, 0.0f) });
+        return m_history.back();
+    }
+
+    void resolve(Frame& f, bool wait) {
+        if (!f.pending) return;
+        f.pending = false;
+        // Timestamps complete in order, so the last one being there means
+        // they all are.
+        GLuint available = wait;
+        if (!wait) glGetQueryObjectuiv(f.queries[f.used - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            ++m_dropped;
+            return;
+        }
+        std::vector<GLuint64> stamps(f.used);
+        for (int i = 0; i < f.used; ++i) glGetQueryObjectui64v(f.queries[i], GL_QUERY_RESULT, &stamps[i]);
+        for (const Scope& s : f.scopes) {
+            if (s.end < 0) continue;
+            double ms = (stamps[s.end] - stamps[s.begin]) * 1e-6;
+            History& h = history(s.name, s.depth);
+            h.samples[h.next] = (float)ms;
+            h.next = (h.next + 1) % m_window;
+            h.count = std::min(h.count + 1, m_window);
+            if (m_traceCapacity > 0) {
+                m_trace.push_back({ s.name, "GPU", stamps[s.begin] * 1e-3 + f.clockOffsetUs, ms * 1e3, s.depth });
+                while (m_trace.size() > m_traceCapacity) m_trace.pop_front();
+            }
+        }
+    }
+
+public:
+    GpuProfiler(int latency = 4, std::size_t window = 120)
+        : m_frames(std::max(latency, 1)), m_window(std::max<std::size_t>(window, 1)) {}
+
+    ~GpuProfiler() {
+        for (Frame& f : m_frames)
+            if (!f.queries.empty()) glDeleteQueries((GLsizei)f.queries.size(), f.queries.data());
+    }
+
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // Starts a frame in the next ring slot, first reading back the frame
+    // that used it. The whole frame is itself a scope, "frame".
+    void beginFrame() {
+        m_current = (m_current + 1) % (int)m_frames.size();
+        Frame& f = m_frames[m_current];
+        resolve(f, false);
+        f.used = 0;
+        f.scopes.clear();
+        if (m_traceCapacity > 0 && --m_calibrateIn < 0) {
+            GLint64 gpuNow = 0;
+            glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+            m_clockOffsetUs = traceNowUs() - gpuNow * 1e-3;
+            m_calibrateIn = CALIBRATE_FRAMES - 1;
+        }
+        f.clockOffsetUs = m_clockOffsetUs;
+        m_open.clear();
+        m_inFrame = true;
+        begin("frame");
+    }
+
+    void endFrame() {
+        if (!m_inFrame) return;
+        while (!m_open.empty()) end();
+        m_frames[m_current].pending = true;
+        m_inFrame = false;
+    }
+
+    // `name` must outlive the profiler (a string literal).
+    void begin(const char* name) {
+        if (!m_inFrame) return;
+        Frame& f = m_frames[m_current];
+        f.scopes.push_back({ name, (int)m_open.size(), issue(f), -1 });
+        m_open.push_back((int)f.scopes.size() - 1);
+    }
+
+    void end() {
+        if (!m_inFrame || m_open.empty()) return;
+        Frame& f = m_frames[m_current];
+        f.scopes[m_open.back()].end = issue(f);
+        m_open.pop_back();
+    }
+
+    // Reads back every finished frame still in the ring, waiting on the GPU;
+    // for the end of a run, before the last stats or the trace are taken.
+    void flush() {
+        for (std::size_t i = 1; i <= m_frames.size(); ++i)
+            resolve(m_frames[(m_current + i) % m_frames.size()], true);
+    }
+
+    // Every pass seen so far, in first-seen order, over the last `window`
+    // resolved frames.
+    std::vector<PassStats> stats() const {
+        std::vector<PassStats> out;
+        for (const History& h : m_history) {
+            PassStats s = { h.name, h.depth, 0.0, 0.0, 0.0 };
+            if (h.count > 0) {
+                s.lastMs = h.samples[(h.next + m_window - 1) % m_window];
+                for (std::size_t i = 0; i < h.count; ++i) {
+                    s.averageMs += h.samples[i];
+                    s.maxMs = std::max(s.maxMs, (double)h.samples[i]);
+                }
+                s.averageMs /= h.count;
+            }
+            out.push_back(s);
+        }
+        return out;
+    }
+
+    double averageMs(const char* name) const {
+        for (const PassStats& s : stats())
+            if (std::strcmp(s.name, name) == 0) return s.averageMs;
+        return 0.0;
+    }
+
+    // Keeps the last `events` resolved scopes for appendTrace (0: none).
+    void setTraceCapacity(std::size_t events) {
+        m_traceCapacity = events;
+        m_calibrateIn = 0;
+        while (m_trace.size() > m_traceCapacity) m_trace.pop_front();
+    }
+    void appendTrace(std::vector<TraceEvent>& out) const { out.insert(out.end(), m_trace.begin(), m_trace.end()); }
+
+    // Frames whose queries were still in flight when their slot came round.
+    std::uint64_t droppedFrames() const { return m_dropped; }
+    int latency() const { return (int)m_frames.size(); }
+};
+
+// Times the enclosing block as one pass.
+class GpuScope {
+private:
+    GpuProfiler& m_profiler;
+
+public:
+    GpuScope(GpuProfiler& profiler, const char* name) : m_profiler(profiler) { m_profiler.begin(name); }
+    ~GpuScope() { m_profiler.end(); }
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+};
@@ -0,0 +1,132 @@
+#pragma once
+#include <string>
+#if defined(SOLAR_HEADLESS_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#elif defined(SOLAR_HEADLESS_OSMESA)
+#include <GL/osmesa.h>
+#include <vector>
+#endif
+
+// An OpenGL 3.3 core context without a window or display server, for
+// --headless runs on CI machines and servers (Mesa's llvmpipe included).
+// The context has no default framebuffer worth drawing into, so callers
+// render into their own FBO. Built with SOLAR_HEADLESS_EGL (surfaceless
+// EGL) or SOLAR_HEADLESS_OSMESA; without either, create() fails.
+class HeadlessContext {
+private:
+#if defined(SOLAR_HEADLESS_EGL)
+    EGLDisplay m_display = EGL_NO_DISPLAY;
+    EGLContext m_context = EGL_NO_CONTEXT;
+#elif defined(SOLAR_HEADLESS_OSMESA)
+    OSMesaContext m_context = nullptr;
+    std::vector<unsigned char> m_buffer;   // 1x1, never drawn into
+#endif
+
+public:
+    HeadlessContext() = default;
+    HeadlessContext(const HeadlessContext&) = delete;
+    HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+    ~HeadlessContext() {
+#if defined(SOLAR_HEADLESS_EGL)
+        if (m_display != EGL_NO_DISPLAY) {
+            eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+            if (m_context != EGL_NO_CONTEXT) eglDestroyContext(m_display, m_context);
+            eglTerminate(m_display);
+        }
+#elif defined(SOLAR_HEADLESS_OSMESA)
+        if (m_context) OSMesaDestroyContext(m_context);
+#endif
+    }
+
+    static bool available() {
+#if defined(SOLAR_HEADLESS_EGL) || defined(SOLAR_HEADLESS_OSMESA)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static const char* backend() {
+#if defined(SOLAR_HEADLESS_EGL)
+        return "EGL";
+#elif defined(SOLAR_HEADLESS_OSMESA)
+        return "OSMesa";
+#else
+        return "none";
+#endif
+    }
+
+    // Creates the context and makes it current; on failure `error` says why.
+    bool create(std::string& error) {
+#if defined(SOLAR_HEADLESS_EGL)
+        // Mesa's surfaceless platform needs neither X nor a GPU device; other
+        // drivers get the default display.
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        if (m_display == EGL_NO_DISPLAY) m_display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        EGLint major, minor;
+        if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+            m_display = EGL_NO_DISPLAY;
+            error = "no EGL display";
+            return false;
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            error = "EGL has no desktop OpenGL";
+            return false;
+        }
+        const EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE
+        };
+        EGLConfig config;
+        EGLint configs = 0;
+        if (!eglChooseConfig(m_display, configAttribs, &config, 1, &configs) || configs == 0) {
+            error = "no EGL config for desktop OpenGL";
+            return false;
+        }
+        const EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, contextAttribs);
+        if (m_context == EGL_NO_CONTEXT) {
+            error = "eglCreateContext failed (no GL 3.3 core?)";
+            return false;
+        }
+        if (!eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_context)) {
+            error = "surfaceless contexts not supported";
+            return false;
+        }
+        return true;
+#elif defined(SOLAR_HEADLESS_OSMESA)
+        const int attribs[] = {
+            OSMESA_FORMAT, OSMESA_RGBA,
+            OSMESA_DEPTH_BITS, 0,
+            OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+            OSMESA_CONTEXT_MAJOR_VERSION, 3,
+            OSMESA_CONTEXT_MINOR_VERSION, 3,
+            0
+        };
+        m_context = OSMesaCreateContextAttribs(attribs, nullptr);
+        if (!m_context) {
+            error = "OSMesaCreateContextAttribs failed (no GL 3.3 core?)";
+            return false;
+        }
+        m_buffer.resize(4);
+        if (!OSMesaMakeCurrent(m_context, m_buffer.data(), GL_UNSIGNED_BYTE, 1, 1)) {
+            error = "OSMesaMakeCurrent failed";
+            return false;
+        }
+        return true;
+#else
+        error = "built without SOLAR_HEADLESS (EGL or OSMesa)";
+        return false;
+#endif
+    }
+};
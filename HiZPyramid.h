@@ -0,0 +1,137 @@
+#pragma once
+#include <GL/glew.h>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Shader.h"
+
+// Hierarchical depth (Hi-Z) for occlusion tests: the depth buffer copied into
+// level 0 of an R32F mip chain where every texel of level l holds the
+// farthest depth of the texels it covers in level l - 1 (hiz.fs). Anything
+// whose nearest depth is beyond that is hidden; glsl/hiz.glsl does the test.
+// Built at the end of a frame, it is tested against during the next one.
+class HiZPyramid {
+private:
+    Shader m_shader;                  // feature FIRST: the copy into level 0
+    unsigned int m_depthCopy = 0, m_copyFbo = 0;
+    unsigned int m_pyramid = 0;
+    std::vector<unsigned int> m_levelFbos;
+    unsigned int m_emptyVAO = 0;
+    int m_width = 0, m_height = 0, m_levels = 0;
+
+    void allocate(int width, int height) {
+        m_width = width;
+        m_height = height;
+        m_levels = 1;
+        while ((std::max(width, height) >> m_levels) > 0) ++m_levels;
+
+        glBindTexture(GL_TEXTURE_2D, m_depthCopy);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, width, height, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, nullptr);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_copyFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthCopy, 0);
+
+        glBindTexture(GL_TEXTURE_2D, m_pyramid);
+        for (int l = 0; l < m_levels; ++l)
+            glTexImage2D(GL_TEXTURE_2D, l, GL_R32F, std::max(width >> l, 1), std::max(height >> l, 1), 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        if (!m_levelFbos.empty()) glDeleteFramebuffers((GLsizei)m_levelFbos.size(), m_levelFbos.data());
+        m_levelFbos.assign(m_levels, 0);
+        glGenFramebuffers(m_levels, m_levelFbos.data());
+        for (int l = 0; l < m_levels; ++l) {
+            glBindFramebuffer(GL_FRAMEBUFFER, m_levelFbos[l]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_pyramid, l);
+            if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                std::cout << "Hi-Z level " << l << " framebuffer incomplete" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+public:
+    HiZPyramid(const std::string& shaderFile) : m_shader(shaderFile, { "FIRST" }) {
+        glGenTextures(1, &m_depthCopy);
+        glGenTextures(1, &m_pyramid);
+        for (unsigned int tex : { m_depthCopy, m_pyramid }) {
+            glBindTexture(GL_TEXTURE_2D, tex);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        glBindTexture(GL_TEXTURE_2D, m_depthCopy);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &m_copyFbo);
+        glGenVertexArrays(1, &m_emptyVAO);
+    }
+
+    ~HiZPyramid() {
+        if (!m_levelFbos.empty()) glDeleteFramebuffers((GLsizei)m_levelFbos.size(), m_levelFbos.data());
+        glDeleteFramebuffers(1, &m_copyFbo);
+        glDeleteTextures(1, &m_depthCopy);
+        glDeleteTextures(1, &m_pyramid);
+        glDeleteVertexArrays(1, &m_emptyVAO);
+    }
+
+    // Rebuilds the pyramid from the depth of `sourceFbo` (0 for the window;
+    // either way a 24/8 depth-stencil buffer to blit from). Leaves
+    // `sourceFbo` bound with a full viewport.
+    void build(unsigned int sourceFbo, int width, int height) {
+        if (width != m_width || height != m_height) allocate(width, height);
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, sourceFbo);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_copyFbo);
+        glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(m_emptyVAO);
+        glActiveTexture(GL_TEXTURE0);
+        m_shader.select(1);
+        m_shader.setUniform1i("source", 0);
+        glBindTexture(GL_TEXTURE_2D, m_depthCopy);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_levelFbos[0]);
+        glViewport(0, 0, width, height);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+
+        // Each level reads the one below; clamping the base and max level to
+        // it keeps the level being written out of the sampled range.
+        m_shader.select(0);
+        m_shader.setUniform1i("source", 0);
+        glBindTexture(GL_TEXTURE_2D, m_pyramid);
+        for (int l = 1; l < m_levels; ++l) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, l - 1);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, l - 1);
+            m_shader.setUniformVec2i("sourceSize", glm::ivec2(std::max(width >> (l - 1), 1), std::max(height >> (l - 1), 1)));
+            glBindFramebuffer(GL_FRAMEBUFFER, m_levelFbos[l]);
+            glViewport(0, 0, std::max(width >> l, 1), std::max(height >> l, 1));
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_levels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindVertexArray(0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, sourceFbo);
+        glViewport(0, 0, width, height);
+        glEnable(GL_DEPTH_TEST);
+    }
+
+    void bind(unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, m_pyramid);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    int levels() const { return m_levels; }
+    // The depth copy plus every R32F level.
+    std::size_t bytes() const {
+        std::size_t total = (std::size_t)m_width * m_height * 4;
+        for (int l = 0; l < m_levels; ++l) total += (std::size_t)std::max(m_width >> l, 1) * std::max(m_height >> l, 1) * 4;
+        return total;
+    }
+};
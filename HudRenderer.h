@@ -0,0 +1,116 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <imgui.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Shader.h"
+
+// Draws ImGui's output with hud.fs in one call: every command list is
+// merged into one vertex and one index buffer. Clip rectangles and texture
+// switches are dropped, which holds for the HUD (a single auto-sized
+// window, nothing scrolled or clipped, only the font atlas).
+class HudRenderer {
+private:
+    Shader m_shader;
+    unsigned int m_vao = 0, m_vbo = 0, m_ebo = 0;
+    unsigned int m_font = 0;
+    std::vector<ImDrawVert> m_vertices;
+    std::vector<std::uint32_t> m_indices;
+    std::size_t m_vboSize = 0, m_eboSize = 0;
+
+public:
+    static constexpr int FONT_UNIT = 13;
+
+    explicit HudRenderer(const std::string& shaderPath) : m_shader(shaderPath) {
+        m_shader.select(0);
+        glGenVertexArrays(1, &m_vao);
+        glGenBuffers(1, &m_vbo);
+        glGenBuffers(1, &m_ebo);
+        glBindVertexArray(m_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (void*)offsetof(ImDrawVert, pos));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (void*)offsetof(ImDrawVert, uv));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (void*)offsetof(ImDrawVert, col));
+        glBindVertexArray(0);
+    }
+
+    ~HudRenderer() {
+        glDeleteVertexArrays(1, &m_vao);
+        glDeleteBuffers(1, &m_vbo);
+        glDeleteBuffers(1, &m_ebo);
+        if (m_font) glDeleteTextures(1, &m_font);
+    }
+
+    HudRenderer(const HudRenderer&) = delete;
+    HudRenderer& operator=(const HudRenderer&) = delete;
+
+    void uploadFont(ImFontAtlas& atlas) {
+        unsigned char* pixels;
+        int width, height;
+        atlas.GetTexDataAsRGBA32(&pixels, &width, &height);
+        glGenTextures(1, &m_font);
+        glBindTexture(GL_TEXTURE_2D, m_font);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        atlas.SetTexID((ImTextureID)(std::intptr_t)m_font);
+    }
+
+    // Into the bound framebuffer, over what is there.
+    void render(const ImDrawData* data) {
+        if (!data || data->TotalVtxCount == 0) return;
+        m_vertices.clear();
+        m_indices.clear();
+        for (int l = 0; l < data->CmdListsCount; ++l) {
+            const ImDrawList* list = data->CmdLists[l];
+            std::uint32_t base = (std::uint32_t)m_vertices.size();
+            m_vertices.insert(m_vertices.end(), list->VtxBuffer.Data, list->VtxBuffer.Data + list->VtxBuffer.Size);
+            for (const ImDrawCmd& cmd : list->CmdBuffer) {
+                if (cmd.UserCallback) continue;
+                for (unsigned int i = 0; i < cmd.ElemCount; ++i)
+                    m_indices.push_back(base + cmd.VtxOffset + list->IdxBuffer[cmd.IdxOffset + i]);
+            }
+        }
+        if (m_indices.empty()) return;
+
+        // Buffers grow to fit and are orphaned each frame otherwise.
+        std::size_t vbytes = m_vertices.size() * sizeof(ImDrawVert), ibytes = m_indices.size() * sizeof(std::uint32_t);
+        glBindVertexArray(m_vao);
+        glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+        if (vbytes > m_vboSize) m_vboSize = vbytes * 2;
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)m_vboSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, (GLsizeiptr)vbytes, m_vertices.data());
+        if (ibytes > m_eboSize) m_eboSize = ibytes * 2;
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)m_eboSize, nullptr, GL_STREAM_DRAW);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, (GLsizeiptr)ibytes, m_indices.data());
+
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST), cullFace = glIsEnabled(GL_CULL_FACE), blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_CULL_FACE);
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+
+        m_shader.bind();
+        m_shader.setUniformVec2f("displaySize", glm::vec2(data->DisplaySize.x, data->DisplaySize.y));
+        m_shader.setUniform1i("fontAtlas", FONT_UNIT);
+        glActiveTexture(GL_TEXTURE0 + FONT_UNIT);
+        glBindTexture(GL_TEXTURE_2D, m_font);
+        glDrawElements(GL_TRIANGLES, (GLsizei)m_indices.size(), GL_UNSIGNED_INT, nullptr);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(0);
+
+        if (depthTest) glEnable(GL_DEPTH_TEST);
+        if (cullFace) glEnable(GL_CULL_FACE);
+        if (!blend) glDisable(GL_BLEND);
+    }
+};
@@ -0,0 +1,159 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "CpuProfiler.h"
+#include "FrustumCulling.h"
+#include "HiZPyramid.h"
+#include "Shader.h"
+#include "Sphere.h"
+
+// Layout shared with cull-instances.fs and Sphere::setInstanceSpheres.
+struct FieldInstance {
+    glm::vec4 sphere;   // center relative to the field origin, radius
+    glm::vec4 color;
+};
+
+// Many small untextured spheres (the --field asteroid ring) drawn with one
+// instanced call. Culled either on the CPU, with FrustumCuller and the
+// survivors uploaded every frame, or with cull-instances.fs: a compute pass
+// appends the survivors to a GPU buffer and counts them straight into the
+// indirect draw's command, with an optional Hi-Z occlusion test. The GPU
+// path needs compute shaders, storage buffers and indirect draws (GL 4.3,
+// which Mesa's llvmpipe has); the CPU path runs on the 3.3 context.
+class InstanceField {
+private:
+    struct DrawCommand {
+        std::uint32_t count, instanceCount, firstIndex;
+        std::int32_t baseVertex;
+        std::uint32_t baseInstance;
+    };
+
+    std::vector<FieldInstance> m_instances;
+    FrustumCuller m_culler;
+    std::vector<std::uint32_t> m_visibleIds;
+    std::vector<FieldInstance> m_upload;
+    unsigned int m_cpuBuffer = 0;
+    unsigned int m_instanceBuffer = 0, m_visibleBuffer = 0, m_commandBuffer = 0;
+    std::uint32_t m_indexCount;
+    bool m_gpu = false;   // which path produced the current visible set
+
+public:
+    InstanceField(std::vector<FieldInstance> instances, int indexCount)
+        : m_instances(std::move(instances)), m_indexCount((std::uint32_t)indexCount) {
+        m_culler.reserve(m_instances.size());
+        for (std::size_t i = 0; i < m_instances.size(); ++i)
+            m_culler.add(glm::vec3(m_instances[i].sphere), m_instances[i].sphere.w, (std::uint32_t)i);
+        glGenBuffers(1, &m_cpuBuffer);
+        if (!gpuSupported()) return;
+
+        GLsizeiptr bytes = (GLsizeiptr)(m_instances.size() * sizeof(FieldInstance));
+        glGenBuffers(1, &m_instanceBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, m_instances.data(), GL_STATIC_DRAW);
+        glGenBuffers(1, &m_visibleBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        DrawCommand command = { m_indexCount, 0, 0, 0, 0 };
+        glGenBuffers(1, &m_commandBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(command), &command, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+    ~InstanceField() {
+        glDeleteBuffers(1, &m_cpuBuffer);
+        if (m_instanceBuffer) glDeleteBuffers(1, &m_instanceBuffer);
+        if (m_visibleBuffer) glDeleteBuffers(1, &m_visibleBuffer);
+        if (m_commandBuffer) glDeleteBuffers(1, &m_commandBuffer);
+    }
+
+    // cull-instances.fs is #version 430 (binding layouts, std430), so the
+    // ARB extensions alone on an older context are not enough.
+    static bool gpuSupported() {
+        return GLEW_VERSION_4_3;
+    }
+
+    // Frustum culls on the CPU and uploads the survivors. `origin` is the
+    // field origin in render space.
+    void cullCpu(const glm::mat4& viewProjection, const glm::vec3& origin) {
+        PROFILE_SCOPE("field cull");
+        m_gpu = false;
+        m_culler.setPlanes(viewProjection * glm::translate(glm::mat4(1.0f), origin));
+        m_culler.cull(m_visibleIds);
+        m_upload.resize(m_visibleIds.size());
+        for (std::size_t i = 0; i < m_visibleIds.size(); ++i) m_upload[i] = m_instances[m_visibleIds[i]];
+        glBindBuffer(GL_ARRAY_BUFFER, m_cpuBuffer);
+        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)(m_upload.size() * sizeof(FieldInstance)), m_upload.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // Culls with cull-instances.fs (`cullShader`, feature HIZ). With `hiZ`
+    // the instances hidden in it are dropped too; it was built with
+    // `hiZViewProjection`, and `hiZOffset` takes this frame's render space
+    // to the one it was built in.
+    void cullGpu(Shader& cullShader, const glm::mat4& viewProjection, const glm::vec3& origin,
+                 const HiZPyramid* hiZ, const glm::mat4& hiZViewProjection, const glm::vec3& hiZOffset) {
+        m_gpu = true;
+        const std::uint32_t zero = 0;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, offsetof(DrawCommand, instanceCount), sizeof(zero), &zero);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+        cullShader.select(hiZ ? 1 : 0);
+        glm::vec4 planes[6];
+        frustumPlanes(viewProjection, planes);
+        cullShader.setUniformVec4fv("frustum", planes, 6);
+        cullShader.setUniformVec3f("origin", origin);
+        cullShader.setUniform1ui("count", (unsigned int)m_instances.size());
+        if (hiZ) {
+            hiZ->bind(12);
+            cullShader.setUniform1i("hiZ", 12);
+            cullShader.setUniformMat4f("hiZViewProjection", hiZViewProjection);
+            cullShader.setUniformVec3f("hiZOffset", hiZOffset);
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_visibleBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_commandBuffer);
+        glDispatchCompute((GLuint)((m_instances.size() + 255) / 256), 1, 1);
+        // The draw reads the command and the visible instances as vertices.
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    }
+
+    // Draws the instances that survived the last cull with `mesh`, a unit
+    // sphere (instanced.fs bound).
+    void draw(Sphere& mesh) const {
+        if (m_gpu) {
+            mesh.setInstanceSpheres(m_visibleBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+            mesh.DrawIndirect();
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        } else if (!m_visibleIds.empty()) {
+            mesh.setInstanceSpheres(m_cpuBuffer);
+            mesh.DrawInstanced((int)m_visibleIds.size());
+        }
+    }
+
+    // Instances drawn after the last cull. After a GPU cull this reads the
+    // command back and stalls on it, so it is for occasional stats only.
+    std::uint32_t visibleCount() const {
+        if (!m_gpu) return (std::uint32_t)m_visibleIds.size();
+        std::uint32_t count = 0;
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+        glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, offsetof(DrawCommand, instanceCount), sizeof(count), &count);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        return count;
+    }
+
+    std::size_t size() const { return m_instances.size(); }
+    // Instance buffers on the GPU: all instances and the visible list when
+    // culling there, plus the survivors of the last CPU cull.
+    std::size_t bufferBytes() const {
+        std::size_t gpu = m_instanceBuffer ? 2 * m_instances.size() * sizeof(FieldInstance) : 0;
+        return gpu + m_upload.size() * sizeof(FieldInstance);
+    }
+};
@@ -0,0 +1,278 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "CpuProfiler.h"
+#include "WorkerPool.h"
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define LIGHT_CLUSTERS_SSE 1
+#endif
+
+// A point light as the clustered shader sees it. Positions are camera
+// relative like everything else handed to the GPU.
+struct ClusterLight {
+    glm::vec3 position;
+    float radius;
+    glm::vec3 ambient, diffuse, specular;
+    float constant, linear, quadratic;
+};
+
+// Distance at which the light's attenuation drops its brightest channel
+// below `cutoff`. Lights without falloff reach everywhere.
+inline float lightRange(float constant, float linear, float quadratic, const glm::vec3& peak, float cutoff = 1.0f / 256.0f) {
+    float k = std::max(peak.x, std::max(peak.y, peak.z)) / cutoff;
+    if (constant >= k) return 0.0f;
+    if (quadratic > 0.0f) return (-linear + std::sqrt(linear * linear + 4.0f * quadratic * (k - constant))) / (2.0f * quadratic);
+    if (linear > 0.0f) return (k - constant) / linear;
+    return FLT_MAX;
+}
+
+// Clustered forward lighting: the view frustum is cut into DIM_X x DIM_Y
+// screen tiles and DIM_Z exponential depth slices, and every light sphere is
+// binned into the clusters it touches. The fragment shader then only loops
+// over the lights of its own cluster.
+//
+// Binning works per slice: each worker owns a contiguous range of slices, so
+// its clusters (and index lists) are contiguous too and the results are just
+// concatenated. Within a slice a light is tested against four neighbouring
+// clusters of a tile row at a time.
+class LightClusters {
+public:
+    static constexpr int DIM_X = 16, DIM_Y = 9, DIM_Z = 24;
+    static constexpr int COUNT = DIM_X * DIM_Y * DIM_Z;
+
+private:
+    struct Span { int x0, x1, y0, y1, z0, z1; };
+    struct Worker {
+        std::vector<std::uint32_t> indices;
+        std::vector<std::vector<std::uint32_t>> tiles;
+        std::vector<std::uint32_t> candidates;
+    };
+
+    // View-space cluster AABBs, SoA, index (z * DIM_Y + y) * DIM_X + x.
+    std::vector<float> m_minX, m_minY, m_minZ, m_maxX, m_maxY, m_maxZ;
+    float m_proj00 = 0.0f, m_proj11 = 0.0f, m_near = 0.0f, m_far = 0.0f;
+    float m_depthScale = 0.0f, m_depthBias = 0.0f;
+
+    std::vector<glm::vec4> m_spheres;          // view space center, radius
+    std::vector<Span> m_spans;
+    std::vector<std::uint32_t> m_grid;         // offset, count per cluster
+    std::vector<std::uint32_t> m_indices;
+    std::vector<glm::vec4> m_lightTexels;
+    std::vector<Worker> m_workers;
+    unsigned m_threads = 0;
+
+    unsigned int m_buffers[3] = {};
+    unsigned int m_textures[3] = {};
+
+    int sliceOf(float depth) const {
+        return glm::clamp((int)std::floor(std::log(depth) * m_depthScale + m_depthBias), 0, DIM_Z - 1);
+    }
+
+    static int tileOf(float ndc, int dim) {
+        return glm::clamp((int)std::floor((ndc * 0.5f + 0.5f) * dim), 0, dim - 1);
+    }
+
+    void bin(Worker& w, int zBegin, int zEnd, std::size_t lightCount) {
+        PROFILE_SCOPE("light bin");
+        w.indices.clear();
+        w.tiles.resize(DIM_X * DIM_Y);
+        w.candidates.clear();
+        for (std::size_t l = 0; l < lightCount; ++l)
+            if (m_spans[l].z0 < zEnd && m_spans[l].z1 >= zBegin) w.candidates.push_back((std::uint32_t)l);
+
+        for (int z = zBegin; z < zEnd; ++z) {
+            for (std::vector<std::uint32_t>& t : w.tiles) t.clear();
+            for (std::uint32_t l : w.candidates) {
+                const Span& s = m_spans[l];
+                if (z < s.z0 || z > s.z1) continue;
+                const glm::vec4& c = m_spheres[l];
+                float r2 = c.w * c.w;
+                for (int y = s.y0; y <= s.y1; ++y) {
+                    int row = (z * DIM_Y + y) * DIM_X;
+                    int x = s.x0;
+#ifdef LIGHT_CLUSTERS_SSE
+                    const __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+                    const __m128 vr2 = _mm_set1_ps(r2), zero = _mm_setzero_ps();
+                    for (; x + 4 <= s.x1 + 1; x += 4) {
+                        int i = row + x;
+                        __m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minX[i]), cx), zero),
+                                               _mm_max_ps(_mm_sub_ps(cx, _mm_loadu_ps(&m_maxX[i])), zero));
+                        __m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minY[i]), cy), zero),
+                                               _mm_max_ps(_mm_sub_ps(cy, _mm_loadu_ps(&m_maxY[i])), zero));
+                        __m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minZ[i]), cz), zero),
+                                               _mm_max_ps(_mm_sub_ps(cz, _mm_loadu_ps(&m_maxZ[i])), zero));
+                        __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+                        int mask = _mm_movemask_ps(_mm_cmple_ps(d2, vr2));
+                        for (int b = 0; b < 4; ++b)
+                            if (mask & (1 << b)) w.tiles[y * DIM_X + x + b].push_back(l);
+                    }
+#endif
+                    for (; x <= s.x1; ++x) {
+                        int i = row + x;
+                        float dx = std::max(m_minX[i] - c.x, 0.0f) + std::max(c.x - m_maxX[i], 0.0f);
+                        float dy = std::max(m_minY[i] - c.y, 0.0f) + std::max(c.y - m_maxY[i], 0.0f);
+                        float dz = std::max(m_minZ[i] - c.z, 0.0f) + std::max(c.z - m_maxZ[i], 0.0f);
+                        if (dx * dx + dy * dy + dz * dz <= r2) w.tiles[y * DIM_X + x].push_back(l);
+                    }
+                }
+            }
+            // Offsets are local to this worker until the merge.
+            for (int t = 0; t < DIM_X * DIM_Y; ++t) {
+                std::size_t cluster = (std::size_t)z * DIM_X * DIM_Y + t;
+                m_grid[2 * cluster] = (std::uint32_t)w.indices.size();
+                m_grid[2 * cluster + 1] = (std::uint32_t)w.tiles[t].size();
+                w.indices.insert(w.indices.end(), w.tiles[t].begin(), w.tiles[t].end());
+            }
+        }
+    }
+
+public:
+    LightClusters() : m_grid(2 * COUNT, 0) {}
+
+    ~LightClusters() {
+        if (m_textures[0]) glDeleteTextures(3, m_textures);
+        if (m_buffers[0]) glDeleteBuffers(3, m_buffers);
+    }
+
+    // Jobs on WorkerPool::shared(); 0 picks one per pool thread.
+    void setThreads(unsigned threads) { m_threads = threads; }
+
+    // Rebuilds the cluster bounds when the (symmetric perspective)
+    // projection changes.
+    void setProjection(const glm::mat4& projection, float zNear, float zFar) {
+        if (projection[0][0] == m_proj00 && projection[1][1] == m_proj11 && zNear == m_near && zFar == m_far) return;
+        m_proj00 = projection[0][0];
+        m_proj11 = projection[1][1];
+        m_near = zNear;
+        m_far = zFar;
+        float logRatio = std::log(zFar / zNear);
+        m_depthScale = DIM_Z / logRatio;
+        m_depthBias = -DIM_Z * std::log(zNear) / logRatio;
+
+        for (std::vector<float>* v : { &m_minX, &m_minY, &m_minZ, &m_maxX, &m_maxY, &m_maxZ }) v->resize(COUNT);
+        for (int z = 0; z < DIM_Z; ++z) {
+            float d0 = zNear * std::pow(zFar / zNear, (float)z / DIM_Z);
+            float d1 = zNear * std::pow(zFar / zNear, (float)(z + 1) / DIM_Z);
+            for (int y = 0; y < DIM_Y; ++y) {
+                float ny0 = -1.0f + 2.0f * y / DIM_Y, ny1 = -1.0f + 2.0f * (y + 1) / DIM_Y;
+                for (int x = 0; x < DIM_X; ++x) {
+                    float nx0 = -1.0f + 2.0f * x / DIM_X, nx1 = -1.0f + 2.0f * (x + 1) / DIM_X;
+                    int i = (z * DIM_Y + y) * DIM_X + x;
+                    // The tile's side planes pass through the eye, so its
+                    // extremes are on the near or far face.
+                    m_minX[i] = std::min(nx0 * d0, nx0 * d1) / m_proj00;
+                    m_maxX[i] = std::max(nx1 * d0, nx1 * d1) / m_proj00;
+                    m_minY[i] = std::min(ny0 * d0, ny0 * d1) / m_proj11;
+                    m_maxY[i] = std::max(ny1 * d0, ny1 * d1) / m_proj11;
+                    m_minZ[i] = -d1;
+                    m_maxZ[i] = -d0;
+                }
+            }
+        }
+    }
+
+    void build(const ClusterLight* lights, std::size_t count, const glm::mat4& view) {
+        PROFILE_SCOPE("light clusters");
+        m_spheres.resize(count);
+        m_spans.resize(count);
+        m_lightTexels.resize(count * 4);
+        for (std::size_t l = 0; l < count; ++l) {
+            const ClusterLight& light = lights[l];
+            m_lightTexels[4 * l + 0] = glm::vec4(light.position, light.radius);
+            m_lightTexels[4 * l + 1] = glm::vec4(light.ambient, light.constant);
+            m_lightTexels[4 * l + 2] = glm::vec4(light.diffuse, light.linear);
+            m_lightTexels[4 * l + 3] = glm::vec4(light.specular, light.quadratic);
+
+            glm::vec3 c = glm::vec3(view * glm::vec4(light.position, 1.0f));
+            float r = std::min(light.radius, 2.0f * m_far);
+            m_spheres[l] = glm::vec4(c, r);
+            Span& s = m_spans[l];
+            float depth = -c.z;
+            float dMin = std::max(depth - r, m_near), dMax = depth + r;
+            if (depth + r < m_near || depth - r > m_far) {
+                s = { 0, -1, 0, -1, 1, 0 };
+                continue;
+            }
+            s.z0 = sliceOf(dMin);
+            s.z1 = sliceOf(std::min(dMax, m_far));
+            // Screen bounds of the sphere's view-space box: each extreme
+            // projects furthest at the nearest or the farthest depth.
+            auto ndc = [&](float v, float scale, bool upper) {
+                bool nearest = upper ? v > 0.0f : v < 0.0f;
+                return v * scale / (nearest ? dMin : dMax);
+            };
+            s.x0 = tileOf(ndc(c.x - r, m_proj00, false), DIM_X);
+            s.x1 = tileOf(ndc(c.x + r, m_proj00, true), DIM_X);
+            s.y0 = tileOf(ndc(c.y - r, m_proj11, false), DIM_Y);
+            s.y1 = tileOf(ndc(c.y + r, m_proj11, true), DIM_Y);
+        }
+
+        // Threads only pay off once there is enough to bin.
+        WorkerPool& pool = WorkerPool::shared();
+        unsigned threads = m_threads ? m_threads : pool.size();
+        if (count < 256) threads = 1;
+        threads = std::min<unsigned>(threads, DIM_Z);
+        m_workers.resize(threads);
+
+        pool.run(threads, [&](unsigned t) { bin(m_workers[t], DIM_Z * t / threads, DIM_Z * (t + 1) / threads, count); });
+
+        m_indices.clear();
+        for (unsigned t = 0; t < threads; ++t) {
+            std::uint32_t base = (std::uint32_t)m_indices.size();
+            int c0 = DIM_X * DIM_Y * (DIM_Z * t / threads), c1 = DIM_X * DIM_Y * (DIM_Z * (t + 1) / threads);
+            for (int c = c0; c < c1; ++c) m_grid[2 * c] += base;
+            m_indices.insert(m_indices.end(), m_workers[t].indices.begin(), m_workers[t].indices.end());
+        }
+    }
+
+    // Uploads lights (RGBA32F, four texels each), the cluster grid (RG32UI
+    // offset/count) and the light index lists (R32UI) as texture buffers.
+    void upload() {
+        if (!m_buffers[0]) {
+            glGenBuffers(3, m_buffers);
+            glGenTextures(3, m_textures);
+        }
+        auto fill = [&](int i, const void* data, std::size_t bytes, std::size_t minBytes, GLenum format) {
+            glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+            // Never zero-sized: an empty buffer texture is incomplete.
+            glBufferData(GL_TEXTURE_BUFFER, std::max(bytes, minBytes), bytes ? data : nullptr, GL_STREAM_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+            glTexBuffer(GL_TEXTURE_BUFFER, format, m_buffers[i]);
+        };
+        fill(0, m_lightTexels.data(), m_lightTexels.size() * sizeof(glm::vec4), sizeof(glm::vec4), GL_RGBA32F);
+        fill(1, m_grid.data(), m_grid.size() * sizeof(std::uint32_t), 0, GL_RG32UI);
+        fill(2, m_indices.data(), m_indices.size() * sizeof(std::uint32_t), sizeof(std::uint32_t), GL_R32UI);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // Binds lights, grid and indices to units firstUnit .. firstUnit + 2.
+    void bind(unsigned int firstUnit) const {
+        for (int i = 0; i < 3; ++i) {
+            glActiveTexture(GL_TEXTURE0 + firstUnit + i);
+            glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // Grid size as #defines for glsl/lighting.glsl.
+    static std::vector<std::string> shaderConstants() {
+        return { "CLUSTER_DIM_X " + std::to_string(DIM_X), "CLUSTER_DIM_Y " + std::to_string(DIM_Y),
+                 "CLUSTER_DIM_Z " + std::to_string(DIM_Z) };
+    }
+
+    // Shader slice = floor(log(viewDepth) * depthScale + depthBias).
+    float depthScale() const { return m_depthScale; }
+    float depthBias() const { return m_depthBias; }
+    std::size_t lightCount() const { return m_spheres.size(); }
+    std::size_t listedCount() const { return m_indices.size(); }
+    std::uint32_t clusterCount(int cluster) const { return m_grid[2 * cluster + 1]; }
+    std::uint32_t clusterOffset(int cluster) const { return m_grid[2 * cluster]; }
+    std::uint32_t clusterLight(std::size_t i) const { return m_indices[i]; }
+};
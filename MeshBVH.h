@@ -0,0 +1,252 @@
+#pragma once
+#include <glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <limits>
+#include <string>
+#include <vector>
+
+struct Bounds {
+    glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+    glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+
+    void grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+    void grow(const Bounds& b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+    bool empty() const { return min.x > max.x; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    float area() const {
+        if (empty()) return 0.0f;
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+};
+
+// Bounding-volume hierarchy over a set of boxes (Model's meshes), built with
+// a binned SAH and stored depth first: an inner node's left child follows it
+// and `right` holds the other. Every node also keeps the range of `items`
+// below it, so a subtree found entirely inside the frustum is emitted
+// without visiting its nodes.
+class BoundsBVH {
+public:
+    struct Node {
+        Bounds bounds;
+        std::uint32_t first, count;   // range of items() in this subtree
+        std::uint32_t right;          // 0 for leaves
+        std::uint32_t pad;
+    };
+    static_assert(sizeof(Node) == 40, "Node layout is part of the .bvh file");
+
+    static const int BINS = 12;
+    static const std::uint32_t MAX_LEAF = 4;
+
+private:
+    std::vector<Node> m_nodes;
+    std::vector<std::uint32_t> m_items;
+    std::uint64_t m_key = 0;
+
+    // FNV-1a of the input boxes, so a cached tree is only reused for the
+    // same meshes.
+    static std::uint64_t hashBounds(const std::vector<Bounds>& boxes) {
+        std::uint64_t h = 1469598103934665603ull;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(boxes.data());
+        for (std::size_t i = 0; i < boxes.size() * sizeof(Bounds); ++i) h = (h ^ p[i]) * 1099511628211ull;
+        return h;
+    }
+
+    void buildNode(std::uint32_t node, std::uint32_t first, std::uint32_t count,
+                   const std::vector<Bounds>& boxes, const std::vector<glm::vec3>& centers) {
+        Bounds bounds, centroids;
+        for (std::uint32_t i = first; i < first + count; ++i) {
+            bounds.grow(boxes[m_items[i]]);
+            centroids.grow(centers[m_items[i]]);
+        }
+        m_nodes[node] = { bounds, first, count, 0, 0 };
+        if (count <= MAX_LEAF) return;
+
+        // Cheapest bin boundary over all three axes; cost in units of one
+        // box test, with one traversal step for the split itself.
+        float bestCost = (float)count;
+        int bestAxis = -1, bestSplit = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            float lo = centroids.min[axis], extent = centroids.max[axis] - lo;
+            if (extent <= 0.0f) continue;
+            Bounds binBounds[BINS];
+            std::uint32_t binCount[BINS] = {};
+            for (std::uint32_t i = first; i < first + count; ++i) {
+                int b = std::min(BINS - 1, (int)((centers[m_items[i]][axis] - lo) / extent * BINS));
+                binBounds[b].grow(boxes[m_items[i]]);
+                ++binCount[b];
+            }
+            float rightArea[BINS];
+            std::uint32_t rightCount[BINS];
+            Bounds acc;
+            std::uint32_t n = 0;
+            for (int b = BINS - 1; b > 0; --b) {
+                acc.grow(binBounds[b]);
+                n += binCount[b];
+                rightArea[b] = acc.area();
+                rightCount[b] = n;
+            }
+            acc = Bounds();
+            n = 0;
+            for (int b = 0; b < BINS - 1; ++b) {
+                acc.grow(binBounds[b]);
+                n += binCount[b];
+                if (n == 0 || rightCount[b + 1] == 0) continue;
+                float cost = 1.0f + (acc.area() * n + rightArea[b + 1] * rightCount[b + 1]) / std::max(bounds.area(), 1e-30f);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b + 1;
+                }
+            }
+        }
+
+        std::uint32_t* begin = m_items.data() + first;
+        std::uint32_t* mid;
+        if (bestAxis >= 0) {
+            float lo = centroids.min[bestAxis], extent = centroids.max[bestAxis] - lo;
+            mid = std::partition(begin, begin + count, [&](std::uint32_t item) {
+                return std::min(BINS - 1, (int)((centers[item][bestAxis] - lo) / extent * BINS)) < bestSplit;
+            });
+        } else {
+            // Splitting does not pay off (or every centroid coincides): keep
+            // it a leaf unless it is too big, then halve it.
+            if (count <= 4 * MAX_LEAF) return;
+            int axis = 0;
+            glm::vec3 d = bounds.max - bounds.min;
+            if (d.y > d[axis]) axis = 1;
+            if (d.z > d[axis]) axis = 2;
+            mid = begin + count / 2;
+            std::nth_element(begin, mid, begin + count,
+                             [&](std::uint32_t a, std::uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+        }
+        std::uint32_t leftCount = (std::uint32_t)(mid - begin);
+
+        std::uint32_t left = (std::uint32_t)m_nodes.size();
+        m_nodes.emplace_back();
+        buildNode(left, first, leftCount, boxes, centers);
+        std::uint32_t right = (std::uint32_t)m_nodes.size();
+        m_nodes.emplace_back();
+        buildNode(right, first + leftCount, count - leftCount, boxes, centers);
+        m_nodes[node].right = right;
+    }
+
+public:
+    void build(const std::vector<Bounds>& boxes) {
+        m_nodes.clear();
+        m_items.resize(boxes.size());
+        for (std::uint32_t i = 0; i < m_items.size(); ++i) m_items[i] = i;
+        m_key = hashBounds(boxes);
+        if (boxes.empty()) return;
+        std::vector<glm::vec3> centers(boxes.size());
+        for (std::size_t i = 0; i < boxes.size(); ++i) centers[i] = boxes[i].center();
+        m_nodes.reserve(2 * boxes.size());
+        m_nodes.emplace_back();
+        buildNode(0, 0, (std::uint32_t)boxes.size(), boxes, centers);
+    }
+
+    // False when `b` is entirely behind one of the planes in `mask`; planes
+    // it is entirely in front of are cleared from `mask`.
+    static bool intersects(const Bounds& b, const glm::vec4 planes[6], unsigned& mask) {
+        glm::vec3 c = b.center(), e = b.max - c;
+        for (int p = 0; p < 6; ++p) {
+            if (!(mask & (1u << p))) continue;
+            float d = glm::dot(glm::vec3(planes[p]), c) + planes[p].w;
+            float r = glm::dot(glm::abs(glm::vec3(planes[p])), e);
+            if (d < -r) return false;
+            if (d >= r) mask &= ~(1u << p);
+        }
+        return true;
+    }
+
+    // Calls visit(item) for every box of `boxes` (the ones the tree was
+    // built from) that may intersect the frustum given by frustumPlanes in
+    // the boxes' space. Planes a node is entirely inside are not tested
+    // again below it.
+    template <typename Fn>
+    void cull(const glm::vec4 planes[6], const std::vector<Bounds>& boxes, Fn visit) const {
+        if (m_nodes.empty()) return;
+        std::pair<std::uint32_t, unsigned> stack[64];
+        int top = 0;
+        stack[top++] = { 0u, 0x3Fu };
+        while (top > 0) {
+            std::uint32_t index = stack[--top].first;
+            unsigned mask = stack[top].second;
+            const Node& node = m_nodes[index];
+            if (!intersects(node.bounds, planes, mask)) continue;
+            if (mask == 0) {
+                for (std::uint32_t i = node.first; i < node.first + node.count; ++i) visit(m_items[i]);
+            } else if (node.right == 0 || top + 2 > 64) {
+                for (std::uint32_t i = node.first; i < node.first + node.count; ++i) {
+                    unsigned itemMask = mask;
+                    if (intersects(boxes[m_items[i]], planes, itemMask)) visit(m_items[i]);
+                }
+            } else {
+                stack[top++] = { node.right, mask };
+                stack[top++] = { index + 1, mask };
+            }
+        }
+    }
+
+    // File: "BVH1", key, node count, item count, nodes, items.
+    bool save(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary);
+        if (!out) return false;
+        std::uint32_t nodes = (std::uint32_t)m_nodes.size(), items = (std::uint32_t)m_items.size();
+        out.write("BVH1", 4);
+        out.write(reinterpret_cast<const char*>(&m_key), sizeof(m_key));
+        out.write(reinterpret_cast<const char*>(&nodes), sizeof(nodes));
+        out.write(reinterpret_cast<const char*>(&items), sizeof(items));
+        out.write(reinterpret_cast<const char*>(m_nodes.data()), nodes * sizeof(Node));
+        out.write(reinterpret_cast<const char*>(m_items.data()), items * sizeof(std::uint32_t));
+        return (bool)out;
+    }
+
+    // Only accepts a tree built from exactly these boxes.
+    bool load(const std::string& path, const std::vector<Bounds>& boxes) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in) return false;
+        char magic[4];
+        std::uint64_t key = 0;
+        std::uint32_t nodes = 0, items = 0;
+        in.read(magic, 4);
+        in.read(reinterpret_cast<char*>(&key), sizeof(key));
+        in.read(reinterpret_cast<char*>(&nodes), sizeof(nodes));
+        in.read(reinterpret_cast<char*>(&items), sizeof(items));
+        if (!in || std::string(magic, 4) != "BVH1" || items != boxes.size() || key != hashBounds(boxes)
+            || nodes > 2 * items) return false;
+        m_nodes.resize(nodes);
+        m_items.resize(items);
+        in.read(reinterpret_cast<char*>(m_nodes.data()), nodes * sizeof(Node));
+        in.read(reinterpret_cast<char*>(m_items.data()), items * sizeof(std::uint32_t));
+        m_key = key;
+        bool valid = (bool)in;
+        // Inner nodes keep their left child next to them and the right one
+        // further on, so cull() only ever walks forward and stays in range.
+        for (std::uint32_t i = 0; valid && i < nodes; ++i) {
+            const Node& n = m_nodes[i];
+            valid = n.first <= items && n.count <= items - n.first
+                && (n.right == 0 || (i + 1 < nodes && n.right > i + 1 && n.right < nodes));
+        }
+        for (std::uint32_t item : m_items) valid = valid && item < items;
+        if (valid) return true;
+        m_nodes.clear();
+        m_items.clear();
+        return false;
+    }
+
+    // Returns true when the tree came from `path`; otherwise builds it and
+    // writes it there.
+    bool loadOrBuild(const std::string& path, const std::vector<Bounds>& boxes) {
+        if (load(path, boxes)) return true;
+        build(boxes);
+        save(path);
+        return false;
+    }
+
+    const std::vector<Node>& nodes() const { return m_nodes; }
+    const std::vector<std::uint32_t>& items() const { return m_items; }
+};
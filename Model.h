@@ -6,13 +6,21 @@
 #include <assimp/postprocess.h>
 
 #include "Mesh.h"
+#include "MeshBVH.h"
+#include "FrustumCulling.h"
+#include "OcclusionBuffer.h"
 #include "stb_image.h"
+#include "CpuProfiler.h"
 
 class Model {
 public:
     std::vector<Texture> textures_loaded;
     std::vector<Mesh> meshes;
     std::string directory;
+    // Per mesh, in the space the meshes are drawn in, and the tree over
+    // them (cached next to the model file as <path>.bvh).
+    std::vector<Bounds> meshBounds;
+    BoundsBVH bvh;
 
     Model(std::string const &path) {
         loadModel(path);
@@ -23,10 +31,47 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // Draws the meshes that may be inside the frustum of clipFromModel
+    // (projection * view * model); returns how many were drawn.
+    unsigned int Draw(Shader &shader, const glm::mat4 &clipFromModel) {
+        glm::vec4 planes[6];
+        frustumPlanes(clipFromModel, planes);
+        unsigned int drawn = 0;
+        bvh.cull(planes, meshBounds, [&](std::uint32_t i) {
+            meshes[i].Draw(shader);
+            ++drawn;
+        });
+        return drawn;
+    }
+
+    // The same, also skipping meshes whose bounding spheres `occlusion`
+    // finds hidden; viewFromModel is view * model.
+    unsigned int Draw(Shader &shader, const glm::mat4 &clipFromModel, const glm::mat4 &viewFromModel,
+                      const OcclusionBuffer &occlusion) {
+        glm::vec4 planes[6];
+        frustumPlanes(clipFromModel, planes);
+        float scale = std::max(glm::length(glm::vec3(viewFromModel[0])),
+                               std::max(glm::length(glm::vec3(viewFromModel[1])), glm::length(glm::vec3(viewFromModel[2]))));
+        unsigned int drawn = 0;
+        bvh.cull(planes, meshBounds, [&](std::uint32_t i) {
+            const Bounds& b = meshBounds[i];
+            glm::vec3 center = glm::vec3(viewFromModel * glm::vec4(b.center(), 1.0f));
+            if (!occlusion.visible(center, glm::length(b.max - b.min) * 0.5f * scale)) return;
+            meshes[i].Draw(shader);
+            ++drawn;
+        });
+        return drawn;
+    }
+
 private:
     void loadModel(std::string const &path) {
+        PROFILE_SCOPE("model load");
         Assimp::Importer importer;
-        const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+        const aiScene* scene;
+        {
+            PROFILE_SCOPE("model import");
+            scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
+        }
 
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
             std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << std::endl;
@@ -34,12 +79,17 @@ private:
         }
         directory = path.substr(0, path.find_last_of('/'));
         processNode(scene->mRootNode, scene);
+        bvh.loadOrBuild(path + ".bvh", meshBounds);
     }
 
     void processNode(aiNode *node, const aiScene *scene) {
         for(unsigned int i = 0; i < node->mNumMeshes; i++) {
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
             meshes.push_back(processMesh(mesh, scene));
+            Bounds bounds;
+            for (const Vertex &v : meshes.back().vertices) bounds.grow(v.Position);
+            if (bounds.empty()) bounds.grow(glm::vec3(0.0f));
+            meshBounds.push_back(bounds);
         }
         for(unsigned int i = 0; i < node->mNumChildren; i++) {
             processNode(node->mChildren[i], scene);
@@ -86,7 +136,11 @@ private:
         glGenTextures(1, &textureID);
 
         int width, height, nrComponents;
-        unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+        unsigned char *data;
+        {
+            PROFILE_SCOPE("texture decode");
+            data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
+        }
         if (data) {
             GLenum format;
             if (nrComponents == 1) format = GL_RED;
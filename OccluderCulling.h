@@ -0,0 +1,137 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUDER_CULLING_SSE 1
+#endif
+
+// Per-receiver occluder lists for the analytic sphere shadows in HW-model.fs.
+//
+// Occluder O (radius ro) can shadow receiver R (radius rr) from light L only
+// if their cones as seen from L overlap and O is not entirely behind R.
+// With a = O - L, b = R - L the cone test cos(angle) > cos(alphaO + alphaR)
+// expands to
+//     dot(a, b) > sqrt(|a|^2 - ro^2) * sqrt(|b|^2 - rr^2) - ro * rr
+// which needs no trig and no division. Casters are kept as SoA and tested
+// four at a time against each receiver.
+class OccluderLists {
+private:
+    std::vector<float> m_x, m_y, m_z, m_r;
+    std::vector<std::uint32_t> m_casterIds;   // caller's id per caster
+    std::vector<glm::vec4> m_packed;          // all lists back to back
+    std::vector<int> m_offset, m_count;       // per receiver
+    std::size_t m_pairsTested = 0;
+
+    unsigned int m_buffer = 0;
+    unsigned int m_texture = 0;
+
+    void append(std::size_t receiver, std::size_t caster) {
+        if (m_casterIds[caster] == (std::uint32_t)receiver) return;
+        m_packed.emplace_back(m_x[caster], m_y[caster], m_z[caster], m_r[caster]);
+        ++m_count[receiver];
+    }
+
+public:
+    ~OccluderLists() {
+        if (m_texture) glDeleteTextures(1, &m_texture);
+        if (m_buffer) glDeleteBuffers(1, &m_buffer);
+    }
+
+    void clearCasters() {
+        m_x.clear(); m_y.clear(); m_z.clear(); m_r.clear();
+        m_casterIds.clear();
+    }
+
+    // `id` is the receiver index of the caster when it is also a receiver,
+    // so it is not listed as shadowing itself.
+    void addCaster(const glm::vec3& pos, float radius, std::uint32_t id) {
+        m_x.push_back(pos.x); m_y.push_back(pos.y); m_z.push_back(pos.z); m_r.push_back(radius);
+        m_casterIds.push_back(id);
+    }
+
+    void build(const glm::vec3& light, const glm::vec3* receivers, const float* radii, std::size_t receiverCount) {
+        m_packed.clear();
+        m_offset.assign(receiverCount, 0);
+        m_count.assign(receiverCount, 0);
+        m_pairsTested = receiverCount * m_x.size();
+        std::size_t casters = m_x.size();
+
+        for (std::size_t i = 0; i < receiverCount; ++i) {
+            m_offset[i] = (int)m_packed.size();
+            glm::vec3 b = receivers[i] - light;
+            float rr = radii[i];
+            float bLen2 = glm::dot(b, b);
+            float bLen = std::sqrt(bLen2);
+            float bTan = std::sqrt(std::max(bLen2 - rr * rr, 0.0f));
+            float farSide = bLen + rr;
+
+            std::size_t j = 0;
+#ifdef OCCLUDER_CULLING_SSE
+            const __m128 lx = _mm_set1_ps(light.x), ly = _mm_set1_ps(light.y), lz = _mm_set1_ps(light.z);
+            const __m128 bx = _mm_set1_ps(b.x), by = _mm_set1_ps(b.y), bz = _mm_set1_ps(b.z);
+            const __m128 vrr = _mm_set1_ps(rr), vbTan = _mm_set1_ps(bTan), vFar = _mm_set1_ps(farSide);
+            const __m128 zero = _mm_setzero_ps();
+            for (; j + 4 <= casters; j += 4) {
+                __m128 ax = _mm_sub_ps(_mm_loadu_ps(&m_x[j]), lx);
+                __m128 ay = _mm_sub_ps(_mm_loadu_ps(&m_y[j]), ly);
+                __m128 az = _mm_sub_ps(_mm_loadu_ps(&m_z[j]), lz);
+                __m128 ro = _mm_loadu_ps(&m_r[j]);
+                __m128 aLen2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, ax), _mm_mul_ps(ay, ay)), _mm_mul_ps(az, az));
+                __m128 dotAB = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax, bx), _mm_mul_ps(ay, by)), _mm_mul_ps(az, bz));
+                __m128 aTan = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(aLen2, _mm_mul_ps(ro, ro)), zero));
+                __m128 bound = _mm_sub_ps(_mm_mul_ps(aTan, vbTan), _mm_mul_ps(ro, vrr));
+                __m128 inCone = _mm_cmpgt_ps(dotAB, bound);
+                __m128 nearEnough = _mm_cmplt_ps(_mm_sub_ps(_mm_sqrt_ps(aLen2), ro), vFar);
+                int mask = _mm_movemask_ps(_mm_and_ps(inCone, nearEnough));
+                while (mask) {
+                    int bit = 0;
+                    while (!(mask & (1 << bit))) ++bit;
+                    append(i, j + bit);
+                    mask &= mask - 1;
+                }
+            }
+#endif
+            for (; j < casters; ++j) {
+                glm::vec3 a = glm::vec3(m_x[j], m_y[j], m_z[j]) - light;
+                float ro = m_r[j];
+                float aLen2 = glm::dot(a, a);
+                float aTan = std::sqrt(std::max(aLen2 - ro * ro, 0.0f));
+                if (glm::dot(a, b) > aTan * bTan - ro * rr && std::sqrt(aLen2) - ro < farSide)
+                    append(i, j);
+            }
+        }
+    }
+
+    // Uploads all lists into a texture buffer (RGBA32F: position, radius).
+    void upload() {
+        if (!m_buffer) {
+            glGenBuffers(1, &m_buffer);
+            glGenTextures(1, &m_texture);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+        // Never zero-sized: an empty buffer texture is incomplete.
+        std::size_t bytes = std::max<std::size_t>(m_packed.size(), 1) * sizeof(glm::vec4);
+        glBufferData(GL_TEXTURE_BUFFER, bytes, m_packed.empty() ? nullptr : m_packed.data(), GL_STREAM_DRAW);
+        glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void bind(unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    int offset(std::size_t receiver) const { return m_offset[receiver]; }
+    int count(std::size_t receiver) const { return m_count[receiver]; }
+    std::size_t receiverCount() const { return m_count.size(); }
+    std::size_t casterCount() const { return m_x.size(); }
+    std::size_t listedCount() const { return m_packed.size(); }
+    std::size_t pairsTested() const { return m_pairsTested; }
+};
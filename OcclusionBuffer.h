@@ -0,0 +1,160 @@
+#pragma once
+#include <glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Low-resolution occluder depth on the CPU with a Hi-Z pyramid over it, for
+// dropping bodies hidden behind the big ones before any draw is issued.
+// Depths are view depths (distance along the view direction); level 0 holds,
+// per texel, an upper bound on the depth of the occluder surface everywhere
+// inside it (+inf where no occluder covers the whole texel), and each level
+// above the farthest of the texels under it. Expects a symmetric perspective
+// projection (glm::perspective).
+class OcclusionBuffer {
+private:
+    int m_width, m_height;
+    std::vector<std::vector<float>> m_levels;
+    std::vector<glm::ivec2> m_sizes;
+    float m_scaleX = 1.0f, m_scaleY = 1.0f;   // projection[0][0], [1][1]
+    float m_near = 0.1f;
+    std::size_t m_occluders = 0;
+
+    // Pixel rect of a sphere entirely in front of the camera, from the
+    // corners of its box (unclamped).
+    void screenRect(const glm::vec3& c, float r, glm::vec2& lo, glm::vec2& hi) const {
+        lo = glm::vec2(std::numeric_limits<float>::max());
+        hi = -lo;
+        for (int i = 0; i < 8; ++i) {
+            glm::vec3 p = c + r * glm::vec3(i & 1 ? 1.0f : -1.0f, i & 2 ? 1.0f : -1.0f, i & 4 ? 1.0f : -1.0f);
+            glm::vec2 ndc(m_scaleX * p.x / -p.z, m_scaleY * p.y / -p.z);
+            glm::vec2 pixel = (ndc * 0.5f + 0.5f) * glm::vec2(m_width, m_height);
+            lo = glm::min(lo, pixel);
+            hi = glm::max(hi, pixel);
+        }
+    }
+
+public:
+    OcclusionBuffer(int width = 256, int height = 128) : m_width(width), m_height(height) {
+        glm::ivec2 size(width, height);
+        while (true) {
+            m_sizes.push_back(size);
+            m_levels.emplace_back((std::size_t)size.x * size.y);
+            if (size.x == 1 && size.y == 1) break;
+            size = glm::max(size / 2, glm::ivec2(1));
+        }
+    }
+
+    // Clears the buffer for a new frame.
+    void begin(const glm::mat4& projection, float zNear) {
+        m_scaleX = projection[0][0];
+        m_scaleY = projection[1][1];
+        m_near = zNear;
+        m_occluders = 0;
+        std::fill(m_levels[0].begin(), m_levels[0].end(), std::numeric_limits<float>::infinity());
+    }
+
+    // Rasterizes a sphere given in view space into level 0: the texels whose
+    // four corner rays all hit it (the silhouette cone is convex, so the
+    // whole texel is then covered). Every visible point of a sphere is no
+    // farther from the eye than its silhouette rim, sqrt(|c|^2 - r^2), which
+    // bounds the depth over the texel. Spheres reaching past the near plane
+    // are skipped, since the clipped render would show what is behind them.
+    void addOccluder(const glm::vec3& c, float r) {
+        float d2 = glm::dot(c, c);
+        if (-c.z - r <= m_near || d2 <= r * r) return;
+        float depth = std::sqrt(d2 - r * r);
+        glm::vec2 lo, hi;
+        screenRect(c, r, lo, hi);
+        int x0 = std::max((int)std::floor(lo.x), 0), x1 = std::min((int)std::ceil(hi.x), m_width);
+        int y0 = std::max((int)std::floor(lo.y), 0), y1 = std::min((int)std::ceil(hi.y), m_height);
+        if (x0 >= x1 || y0 >= y1) return;
+        ++m_occluders;
+
+        // Corner (x, y) is the corner shared by texels (x-1 .. x, y-1 .. y).
+        int cornersX = x1 - x0 + 1;
+        std::vector<unsigned char> hit((std::size_t)cornersX * (y1 - y0 + 1));
+        float limit = (d2 - r * r) * 1.00001f;
+        for (int y = y0; y <= y1; ++y) {
+            float dy = (2.0f * y / m_height - 1.0f) / m_scaleY;
+            for (int x = x0; x <= x1; ++x) {
+                glm::vec3 d((2.0f * x / m_width - 1.0f) / m_scaleX, dy, -1.0f);
+                float dc = glm::dot(d, c);
+                hit[(y - y0) * cornersX + (x - x0)] = dc > 0.0f && dc * dc >= glm::dot(d, d) * limit;
+            }
+        }
+        std::vector<float>& level = m_levels[0];
+        for (int y = y0; y < y1; ++y) {
+            const unsigned char* row = &hit[(y - y0) * cornersX];
+            const unsigned char* next = row + cornersX;
+            for (int x = x0; x < x1; ++x) {
+                int k = x - x0;
+                if (row[k] && row[k + 1] && next[k] && next[k + 1]) {
+                    float& texel = level[(std::size_t)y * m_width + x];
+                    texel = std::min(texel, depth);
+                }
+            }
+        }
+    }
+
+    // Level 0 row `y` (bottom up), for occluders rasterized elsewhere
+    // (OcclusionRasterizer); they are counted with addRasterized.
+    float* row(int y) { return &m_levels[0][(std::size_t)y * m_width]; }
+    void addRasterized(std::size_t occluders) { m_occluders += occluders; }
+
+    // Rebuilds the levels above 0 after the occluders are in. Sizes halve
+    // rounding down, so with an odd size the last texel also takes the one
+    // past its pair.
+    void buildHiZ() {
+        for (std::size_t l = 1; l < m_levels.size(); ++l) {
+            glm::ivec2 src = m_sizes[l - 1], dst = m_sizes[l];
+            const std::vector<float>& below = m_levels[l - 1];
+            std::vector<float>& level = m_levels[l];
+            for (int y = 0; y < dst.y; ++y) {
+                int sy0 = 2 * y, sy1 = y == dst.y - 1 ? src.y - 1 : std::min(2 * y + 1, src.y - 1);
+                for (int x = 0; x < dst.x; ++x) {
+                    int sx0 = 2 * x, sx1 = x == dst.x - 1 ? src.x - 1 : std::min(2 * x + 1, src.x - 1);
+                    float farthest = 0.0f;
+                    for (int sy = sy0; sy <= sy1; ++sy)
+                        for (int sx = sx0; sx <= sx1; ++sx)
+                            farthest = std::max(farthest, below[(std::size_t)sy * src.x + sx]);
+                    level[(std::size_t)y * dst.x + x] = farthest;
+                }
+            }
+        }
+    }
+
+    // False only when the view-space sphere is certainly behind the
+    // occluders: its nearest depth lies beyond the farthest occluder depth
+    // over its screen rect, read from the level where that rect spans at
+    // most 2x2 texels.
+    bool visible(const glm::vec3& c, float r) const {
+        if (m_occluders == 0) return true;
+        float nearest = -c.z - r;
+        if (nearest <= m_near) return true;
+        glm::vec2 lo, hi;
+        screenRect(c, r, lo, hi);
+        lo = glm::max(lo, glm::vec2(0.0f));
+        hi = glm::min(hi, glm::vec2(m_width, m_height));
+        if (lo.x >= hi.x || lo.y >= hi.y) return true;   // off screen: the frustum test's call
+        float extent = std::max(hi.x - lo.x, hi.y - lo.y);
+        int l = std::min((int)std::ceil(std::log2(std::max(extent, 1.0f))), (int)m_levels.size() - 1);
+        glm::ivec2 last = m_sizes[l] - 1;
+        glm::ivec2 a = glm::min(glm::ivec2(lo) >> l, last), b = glm::min(glm::ivec2(hi) >> l, last);
+        const std::vector<float>& level = m_levels[l];
+        for (int y = a.y; y <= b.y; ++y)
+            for (int x = a.x; x <= b.x; ++x)
+                if (!(nearest > level[(std::size_t)y * m_sizes[l].x + x])) return true;
+        return false;
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    std::size_t occluderCount() const { return m_occluders; }
+    // Texels of level 0 covered by an occluder, for stats.
+    std::size_t coveredTexels() const {
+        return (std::size_t)std::count_if(m_levels[0].begin(), m_levels[0].end(), [](float d) { return std::isfinite(d); });
+    }
+};
@@ -0,0 +1,301 @@
+#pragma once
+#include <glm.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "OcclusionBuffer.h"
+#include "CpuProfiler.h"
+#include "WorkerPool.h"
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define OCCLUSION_RASTER_SSE 1
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#define OCCLUSION_RASTER_AVX 1
+#endif
+
+// Software rasterizer for occluder proxies (convex meshes drawn no larger
+// than the real object) into an OcclusionBuffer. Triangles are binned into
+// screen tiles by every thread of the shared WorkerPool, then each tile is
+// rasterized by one thread: per occluder, the coverage of its front faces is built as one
+// 64-bit mask per row, with edge functions evaluated eight pixel centers at
+// a time with AVX or four with SSE. The mask is eroded by one texel, which
+// leaves only texels entirely inside the convex silhouette, and those get
+// the occluder's depth bound: the farthest of its front-facing vertices.
+class OcclusionRasterizer {
+public:
+    enum class Path { Scalar, SSE, AVX };
+    // Tiles are 62 texels wide so that with the one-texel apron the erosion
+    // reads on each side a row fits in 64 bits.
+    static const int TILE_W = 62, TILE_H = 32;
+
+private:
+    struct Triangle {
+        float a[3], b[3], c[3];   // edge functions a*x + b*y + c, >= 0 inside
+        int x0, y0, x1, y1;       // pixel center bounds, inclusive
+        std::uint32_t occluder;
+    };
+
+    std::vector<Triangle> m_triangles;
+    std::vector<float> m_depths;          // per occluder
+    std::vector<std::vector<std::vector<std::uint32_t>>> m_bins;   // [thread][tile]
+    std::vector<glm::vec3> m_sphereVertices;
+    std::vector<std::uint32_t> m_sphereIndices;
+    int m_width = 0, m_height = 0, m_tilesX = 0, m_tilesY = 0;
+    unsigned m_threads = 0;
+    Path m_path = bestPath();
+
+    // Bits of the 64 columns starting at `left` whose centers on row `y` are
+    // inside the triangle, for columns [k0, k1) of them.
+    std::uint64_t rowMask(const Triangle& t, int left, int y, int k0, int k1) const {
+        float yc = y + 0.5f;
+        float r0 = t.b[0] * yc + t.c[0], r1 = t.b[1] * yc + t.c[1], r2 = t.b[2] * yc + t.c[2];
+        // Narrow the columns to the row's span (padded a texel either way,
+        // the edge tests below decide).
+        float lo = -1e30f, hi = 1e30f;
+        const float rows[3] = { r0, r1, r2 };
+        for (int e = 0; e < 3; ++e) {
+            if (t.a[e] > 0.0f) lo = std::max(lo, -rows[e] / t.a[e]);
+            else if (t.a[e] < 0.0f) hi = std::min(hi, -rows[e] / t.a[e]);
+            else if (rows[e] < 0.0f) return 0;
+        }
+        if (lo > hi) return 0;
+        k0 = std::max(k0, (int)std::max(std::floor(lo - 0.5f) - left - 1.0f, -1.0f));
+        k1 = std::min(k1, (int)std::min(std::ceil(hi - 0.5f) - left + 2.0f, 64.0f));
+        std::uint64_t mask = 0;
+        int k = k0;
+#ifdef OCCLUSION_RASTER_AVX
+        if (m_path == Path::AVX) {
+            __m256 a0 = _mm256_set1_ps(t.a[0]), a1 = _mm256_set1_ps(t.a[1]), a2 = _mm256_set1_ps(t.a[2]);
+            __m256 e0 = _mm256_set1_ps(r0), e1 = _mm256_set1_ps(r1), e2 = _mm256_set1_ps(r2);
+            __m256 zero = _mm256_setzero_ps();
+            for (k &= ~7; k < k1; k += 8) {
+                float base = left + k + 0.5f;
+                __m256 x = _mm256_add_ps(_mm256_set1_ps(base), _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0));
+                __m256 in = _mm256_and_ps(_mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a0, x), e0), zero, _CMP_GE_OQ),
+                                          _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a1, x), e1), zero, _CMP_GE_OQ));
+                in = _mm256_and_ps(in, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(a2, x), e2), zero, _CMP_GE_OQ));
+                mask |= (std::uint64_t)_mm256_movemask_ps(in) << k;
+            }
+            return mask;
+        }
+#endif
+#ifdef OCCLUSION_RASTER_SSE
+        if (m_path != Path::Scalar) {
+            __m128 a0 = _mm_set1_ps(t.a[0]), a1 = _mm_set1_ps(t.a[1]), a2 = _mm_set1_ps(t.a[2]);
+            __m128 e0 = _mm_set1_ps(r0), e1 = _mm_set1_ps(r1), e2 = _mm_set1_ps(r2);
+            __m128 zero = _mm_setzero_ps();
+            for (k &= ~3; k < k1; k += 4) {
+                float base = left + k + 0.5f;
+                __m128 x = _mm_add_ps(_mm_set1_ps(base), _mm_set_ps(3, 2, 1, 0));
+                __m128 in = _mm_and_ps(_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, x), e0), zero),
+                                       _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, x), e1), zero));
+                in = _mm_and_ps(in, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, x), e2), zero));
+                mask |= (std::uint64_t)_mm_movemask_ps(in) << k;
+            }
+            return mask;
+        }
+#endif
+        for (; k < k1; ++k) {
+            float x = left + k + 0.5f;
+            if (t.a[0] * x + r0 >= 0.0f && t.a[1] * x + r1 >= 0.0f && t.a[2] * x + r2 >= 0.0f)
+                mask |= 1ull << k;
+        }
+        return mask;
+    }
+
+    void binTriangles(std::vector<std::vector<std::uint32_t>>& bins, std::size_t first, std::size_t last) const {
+        PROFILE_SCOPE("raster bin");
+        for (std::vector<std::uint32_t>& bin : bins) bin.clear();
+        for (std::size_t i = first; i < last; ++i) {
+            const Triangle& t = m_triangles[i];
+            // One texel of apron: tiles next to the triangle erode against it.
+            int tx0 = std::max((t.x0 - 1) / TILE_W, 0), tx1 = std::min((t.x1 + 1) / TILE_W, m_tilesX - 1);
+            int ty0 = std::max((t.y0 - 1) / TILE_H, 0), ty1 = std::min((t.y1 + 1) / TILE_H, m_tilesY - 1);
+            for (int ty = ty0; ty <= ty1; ++ty)
+                for (int tx = tx0; tx <= tx1; ++tx)
+                    bins[ty * m_tilesX + tx].push_back((std::uint32_t)i);
+        }
+    }
+
+    void rasterizeTile(int tile, OcclusionBuffer& buffer) const {
+        int left = (tile % m_tilesX) * TILE_W - 1, bottom = (tile / m_tilesX) * TILE_H - 1;
+        std::uint64_t cover[TILE_H + 2];
+        std::uint32_t current = 0xFFFFFFFFu;
+        auto flush = [&]() {
+            if (current == 0xFFFFFFFFu) return;
+            float depth = m_depths[current];
+            for (int r = 1; r <= TILE_H; ++r) {
+                int y = bottom + r;
+                if (y >= m_height) break;
+                std::uint64_t e = cover[r - 1] & cover[r] & cover[r + 1];
+                e &= (e << 1) & (e >> 1);
+                e &= ~1ull & ~(1ull << 63);
+                float* row = buffer.row(y);
+                for (int bit = 1; e >> bit; ++bit) {
+                    int x = left + bit;
+                    if ((e >> bit & 1) && x < m_width) row[x] = std::min(row[x], depth);
+                }
+            }
+        };
+        // Bins keep submission order, so each occluder's triangles are
+        // consecutive.
+        for (const std::vector<std::vector<std::uint32_t>>& bins : m_bins) {
+            for (std::uint32_t i : bins[tile]) {
+                const Triangle& t = m_triangles[i];
+                if (t.occluder != current) {
+                    flush();
+                    current = t.occluder;
+                    std::fill(cover, cover + TILE_H + 2, 0ull);
+                }
+                int k0 = std::max(t.x0 - left, 0), k1 = std::min(t.x1 - left + 1, 64);
+                int r0 = std::max(t.y0 - bottom, 0), r1 = std::min(t.y1 - bottom, TILE_H + 1);
+                for (int r = r0; r <= r1 && k0 < k1; ++r)
+                    cover[r] |= rowMask(t, left, bottom + r, k0, k1);
+            }
+        }
+        flush();
+    }
+
+public:
+    static Path bestPath() {
+#if defined(OCCLUSION_RASTER_AVX)
+        return Path::AVX;
+#elif defined(OCCLUSION_RASTER_SSE)
+        return Path::SSE;
+#else
+        return Path::Scalar;
+#endif
+    }
+
+    // Falls back to the best compiled-in path when `path` is not available.
+    void setPath(Path path) {
+#ifndef OCCLUSION_RASTER_AVX
+        if (path == Path::AVX) path = bestPath();
+#endif
+#ifndef OCCLUSION_RASTER_SSE
+        if (path == Path::SSE) path = bestPath();
+#endif
+        m_path = path;
+    }
+    Path path() const { return m_path; }
+
+    // Jobs per pass on WorkerPool::shared(); 0 picks one per pool thread.
+    void setThreads(unsigned threads) { m_threads = threads; }
+
+    OcclusionRasterizer() { sphereProxy(m_sphereVertices, m_sphereIndices); }
+
+    // Proxy for Sphere meshes: Sphere's parametrization with fewer sectors
+    // and stacks. When the drawn sphere's counts are multiples of these, the
+    // proxy's vertices are some of its vertices and it lies inside it. Faces
+    // wind counter-clockwise seen from outside.
+    static void sphereProxy(std::vector<glm::vec3>& vertices, std::vector<std::uint32_t>& indices,
+                            unsigned sectors = 12, unsigned stacks = 6) {
+        const float PI = 3.1415926f;
+        vertices.clear();
+        indices.clear();
+        for (unsigned i = 0; i <= stacks; ++i) {
+            float stackAngle = PI / 2 - i * PI / stacks;
+            for (unsigned j = 0; j <= sectors; ++j) {
+                float sectorAngle = j * 2 * PI / sectors;
+                vertices.emplace_back(std::cos(stackAngle) * std::cos(sectorAngle), std::cos(stackAngle) * std::sin(sectorAngle),
+                                      std::sin(stackAngle));
+            }
+        }
+        auto face = [&](std::uint32_t a, std::uint32_t b, std::uint32_t c) {
+            glm::vec3 n = glm::cross(vertices[b] - vertices[a], vertices[c] - vertices[a]);
+            if (glm::dot(n, vertices[a] + vertices[b] + vertices[c]) < 0.0f) std::swap(b, c);
+            indices.insert(indices.end(), { a, b, c });
+        };
+        for (unsigned i = 0; i < stacks; ++i) {
+            std::uint32_t k1 = i * (sectors + 1), k2 = k1 + sectors + 1;
+            for (unsigned j = 0; j < sectors; ++j, ++k1, ++k2) {
+                if (i != 0) face(k1, k2, k1 + 1);
+                if (i != stacks - 1) face(k1 + 1, k2, k2 + 1);
+            }
+        }
+    }
+
+    void begin(int width, int height) {
+        m_width = width;
+        m_height = height;
+        m_tilesX = (width + TILE_W - 1) / TILE_W;
+        m_tilesY = (height + TILE_H - 1) / TILE_H;
+        m_triangles.clear();
+        m_depths.clear();
+    }
+
+    // Queues a convex occluder proxy drawn with clipFromModel. An occluder
+    // reaching past the near plane is dropped, as is one with no front faces
+    // on screen. Returns whether it was queued.
+    bool addOccluder(const glm::mat4& clipFromModel, const std::vector<glm::vec3>& vertices,
+                     const std::vector<std::uint32_t>& indices) {
+        std::vector<glm::vec3> screen(vertices.size());
+        for (std::size_t i = 0; i < vertices.size(); ++i) {
+            glm::vec4 clip = clipFromModel * glm::vec4(vertices[i], 1.0f);
+            if (clip.z < -clip.w || clip.w <= 0.0f) return false;
+            screen[i] = glm::vec3((clip.x / clip.w * 0.5f + 0.5f) * m_width, (clip.y / clip.w * 0.5f + 0.5f) * m_height, clip.w);
+        }
+        std::uint32_t occluder = (std::uint32_t)m_depths.size();
+        std::size_t firstTriangle = m_triangles.size();
+        float depth = 0.0f;
+        for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+            const glm::vec3 v[3] = { screen[indices[i]], screen[indices[i + 1]], screen[indices[i + 2]] };
+            float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[2].x - v[0].x) * (v[1].y - v[0].y);
+            if (!(area > 0.0f)) continue;
+            depth = std::max(depth, std::max(v[0].z, std::max(v[1].z, v[2].z)));
+            Triangle t;
+            for (int e = 0; e < 3; ++e) {
+                const glm::vec3& p = v[e];
+                const glm::vec3& q = v[(e + 1) % 3];
+                t.a[e] = p.y - q.y;
+                t.b[e] = q.x - p.x;
+                t.c[e] = -(t.a[e] * p.x + t.b[e] * p.y);
+            }
+            // Texels whose centers may be inside.
+            t.x0 = (int)std::floor(std::min(v[0].x, std::min(v[1].x, v[2].x)) - 0.5f);
+            t.x1 = (int)std::ceil(std::max(v[0].x, std::max(v[1].x, v[2].x)) - 0.5f);
+            t.y0 = (int)std::floor(std::min(v[0].y, std::min(v[1].y, v[2].y)) - 0.5f);
+            t.y1 = (int)std::ceil(std::max(v[0].y, std::max(v[1].y, v[2].y)) - 0.5f);
+            if (t.x1 < -1 || t.y1 < -1 || t.x0 > m_width || t.y0 > m_height) continue;
+            t.occluder = occluder;
+            m_triangles.push_back(t);
+        }
+        if (m_triangles.size() == firstTriangle) return false;
+        m_depths.push_back(depth);
+        return true;
+    }
+
+    // A unit Sphere (36x18 or any multiple of 12x6) drawn with clipFromModel.
+    bool addSphere(const glm::mat4& clipFromModel) {
+        return addOccluder(clipFromModel, m_sphereVertices, m_sphereIndices);
+    }
+
+    // Rasterizes everything queued since begin() into level 0 of `buffer`
+    // (begun with the same size); buildHiZ() follows.
+    void render(OcclusionBuffer& buffer) {
+        PROFILE_SCOPE("occluder raster");
+        WorkerPool& pool = WorkerPool::shared();
+        unsigned threads = m_threads ? m_threads : pool.size();
+        if (m_triangles.size() < 256) threads = 1;
+        int tiles = m_tilesX * m_tilesY;
+        threads = std::min<unsigned>(threads, tiles);
+        m_bins.resize(threads);
+        for (auto& bins : m_bins) bins.resize(tiles);
+
+        std::size_t count = m_triangles.size();
+        pool.run(threads, [&](unsigned t) {
+            binTriangles(m_bins[t], count * t / threads, count * (t + 1) / threads);
+        });
+        pool.run(threads, [&](unsigned t) {
+            PROFILE_SCOPE("raster tiles");
+            for (int tile = tiles * t / threads; tile < (int)(tiles * (t + 1) / threads); ++tile) rasterizeTile(tile, buffer);
+        });
+        buffer.addRasterized(m_depths.size());
+    }
+
+    std::size_t triangleCount() const { return m_triangles.size(); }
+    std::size_t occluderCount() const { return m_depths.size(); }
+};
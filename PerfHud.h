@@ -0,0 +1,177 @@
+#pragma once
+#include <GLFW/glfw3.h>
+#include <imgui.h>
+#include <backends/imgui_impl_glfw.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "ChromeTrace.h"
+#include "GpuProfiler.h"
+#include "HudRenderer.h"
+
+// One frame's counters, filled in by the render loop.
+struct HudStats {
+    float frameMs = 0.0f;
+    std::uint64_t drawCalls = 0, primitives = 0;
+    std::size_t textureBytes = 0, bufferBytes = 0;
+    std::size_t bodies = 0, inFrustum = 0, drawn = 0;
+    std::size_t fieldSize = 0, fieldDrawn = 0;
+    bool fieldGpuCulled = false;   // fieldDrawn unknown
+};
+
+// The render loop's own switches, flipped from the HUD.
+struct HudToggles {
+    int* shadowMode;         // 0 analytic, 1 cube map
+    int* renderPath;         // 0 forward, 1 deferred
+    bool* depthPrepass;
+    bool* atmosphere;
+    bool* occlusionCulling;
+    bool* gpuCulling;        // field: compute cull + indirect draw
+};
+
+// Performance overlay: frame-time graph, counters, the CPU scopes of the
+// main thread and the GPU passes (rolling averages), and the toggles. One
+// ImGui window drawn by HudRenderer in a single draw call. Without a window
+// (headless runs) it takes no input and setDisplaySize gives the target.
+class PerfHud {
+private:
+    struct History {
+        const char* name;
+        int depth;
+        std::vector<float> samples;   // ms, ring of the last `window` frames
+        std::size_t next = 0, count = 0;
+        double frameUs = 0.0;
+    };
+
+    HudRenderer m_renderer;
+    bool m_glfw;
+    std::size_t m_window;
+    std::vector<float> m_frameMs;
+    std::size_t m_frameNext = 0;
+    std::vector<History> m_cpu;
+    std::vector<TraceEvent> m_sorted;
+
+    static void push(History& h, float ms, std::size_t window) {
+        h.samples[h.next] = ms;
+        h.next = (h.next + 1) % window;
+        h.count = std::min(h.count + 1, window);
+    }
+    static float average(const History& h) {
+        float sum = 0.0f;
+        for (std::size_t i = 0; i < h.count; ++i) sum += h.samples[i];
+        return h.count ? sum / h.count : 0.0f;
+    }
+    static double megabytes(std::size_t bytes) { return bytes / (1024.0 * 1024.0); }
+
+public:
+    PerfHud(GLFWwindow* window, const std::string& shaderPath, std::size_t historyFrames = 120)
+        : m_renderer(shaderPath), m_glfw(window != nullptr), m_window(std::max<std::size_t>(historyFrames, 1)),
+          m_frameMs(240, 0.0f) {
+        IMGUI_CHECKVERSION();
+        ImGui::CreateContext();
+        ImGuiIO& io = ImGui::GetIO();
+        io.IniFilename = nullptr;
+        io.BackendRendererName = "solar_hud";
+        ImGui::StyleColorsDark();
+        // Chains to the callbacks already installed on the window.
+        if (m_glfw) ImGui_ImplGlfw_InitForOpenGL(window, true);
+        m_renderer.uploadFont(*io.Fonts);
+    }
+
+    ~PerfHud() {
+        if (m_glfw) ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
+
+    PerfHud(const PerfHud&) = delete;
+    PerfHud& operator=(const PerfHud&) = delete;
+
+    void setDisplaySize(int width, int height) { ImGui::GetIO().DisplaySize = ImVec2((float)width, (float)height); }
+
+    // Folds one frame of CPU scopes (CpuProfiler::drain) into the averages.
+    // Only the main thread's are kept, so they add up to its frame; repeated
+    // scopes sum.
+    void addCpuFrame(const TraceEvent* events, std::size_t count) {
+        m_sorted.assign(events, events + count);
+        // Parents start first, so the list reads top-down.
+        std::sort(m_sorted.begin(), m_sorted.end(),
+                  [](const TraceEvent& a, const TraceEvent& b) { return a.startUs < b.startUs; });
+        for (History& h : m_cpu) h.frameUs = 0.0;
+        for (const TraceEvent& e : m_sorted) {
+            if (std::strcmp(e.track, "main") != 0) continue;
+            auto it = std::find_if(m_cpu.begin(), m_cpu.end(),
+                                   [&](const History& h) { return std::strcmp(h.name, e.name) == 0; });
+            if (it == m_cpu.end()) {
+                m_cpu.push_back({ e.name, e.depth, std::vector<float>(m_window, 0.0f) });
+                it = m_cpu.end() - 1;
+            }
+            it->frameUs += e.durationUs;
+        }
+        for (History& h : m_cpu) push(h, (float)(h.frameUs * 1e-3), m_window);
+    }
+
+    // Rolling average of a main-thread CPU scope, 0 if it was never seen.
+    double cpuAverageMs(const char* name) const {
+        for (const History& h : m_cpu)
+            if (std::strcmp(h.name, name) == 0) return average(h);
+        return 0.0;
+    }
+
+    // Builds and draws the overlay into the bound framebuffer.
+    void draw(const HudStats& stats, const GpuProfiler& gpu, HudToggles& toggles) {
+        m_frameMs[m_frameNext] = stats.frameMs;
+        m_frameNext = (m_frameNext + 1) % m_frameMs.size();
+        float frameAverage = 0.0f;
+        for (float ms : m_frameMs) frameAverage += ms;
+        frameAverage /= m_frameMs.size();
+
+        if (m_glfw) ImGui_ImplGlfw_NewFrame();
+        else ImGui::GetIO().DeltaTime = std::max(stats.frameMs * 1e-3f, 1e-4f);
+        ImGui::NewFrame();
+        ImGui::SetNextWindowPos(ImVec2(10.0f, 10.0f), ImGuiCond_Always);
+        ImGui::SetNextWindowBgAlpha(0.6f);
+        ImGui::Begin("perf", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize
+                     | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav);
+
+        ImGui::Text("frame %.2f ms (%.0f fps)", frameAverage, frameAverage > 0.0f ? 1000.0f / frameAverage : 0.0f);
+        ImGui::PlotLines("##frame", m_frameMs.data(), (int)m_frameMs.size(), (int)m_frameNext, nullptr,
+                         0.0f, std::max(frameAverage * 2.0f, 1.0f), ImVec2(260.0f, 50.0f));
+        for (const History& h : m_cpu)
+            if (std::strcmp(h.name, "simulation") == 0) ImGui::Text("sim step %.3f ms", average(h));
+        ImGui::Text("draw calls %llu, triangles %llu", (unsigned long long)stats.drawCalls,
+                    (unsigned long long)stats.primitives);
+        ImGui::Text("textures %.1f MB, buffers %.1f MB", megabytes(stats.textureBytes), megabytes(stats.bufferBytes));
+        ImGui::Text("bodies %zu: %zu in frustum, %zu drawn", stats.bodies, stats.inFrustum, stats.drawn);
+        if (stats.fieldSize > 0 && stats.fieldGpuCulled) ImGui::Text("field %zu: culled on the GPU", stats.fieldSize);
+        else if (stats.fieldSize > 0) ImGui::Text("field %zu: %zu drawn", stats.fieldSize, stats.fieldDrawn);
+
+        ImGui::SeparatorText("CPU ms");
+        for (const History& h : m_cpu) {
+            float ms = average(h);
+            if (ms >= 0.001f) ImGui::Text("%*s%-18s %7.3f", 2 * h.depth, "", h.name, ms);
+        }
+        ImGui::SeparatorText("GPU ms");
+        for (const GpuProfiler::PassStats& s : gpu.stats())
+            ImGui::Text("%*s%-18s %7.3f", 2 * s.depth, "", s.name, s.averageMs);
+
+        ImGui::SeparatorText("toggles");
+        ImGui::RadioButton("analytic shadows", toggles.shadowMode, 0);
+        ImGui::SameLine();
+        ImGui::RadioButton("shadow map", toggles.shadowMode, 1);
+        ImGui::RadioButton("forward", toggles.renderPath, 0);
+        ImGui::SameLine();
+        ImGui::RadioButton("deferred", toggles.renderPath, 1);
+        ImGui::Checkbox("depth prepass", toggles.depthPrepass);
+        ImGui::SameLine();
+        ImGui::Checkbox("atmosphere", toggles.atmosphere);
+        ImGui::Checkbox("occlusion culling", toggles.occlusionCulling);
+        if (stats.fieldSize > 0) ImGui::Checkbox("field GPU culling", toggles.gpuCulling);
+        ImGui::TextDisabled("F1 hides, F2 frees the mouse");
+        ImGui::End();
+
+        ImGui::Render();
+        m_renderer.render(ImGui::GetDrawData());
+    }
+};
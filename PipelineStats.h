@@ -0,0 +1,70 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+
+// One GL query around a pass, read back without stalling: two queries
+// alternate so the result read each frame is the previous frame's.
+// Does nothing when the query target is unsupported.
+class PassQuery {
+private:
+    GLenum m_target;
+    unsigned int m_queries[2] = {};
+    int m_current = 0;
+    bool m_pending[2] = {};
+    bool m_active = false;
+    std::uint64_t m_last = 0;
+    bool m_supported = false;
+
+public:
+    PassQuery(GLenum target, bool supported) : m_target(target), m_supported(supported) {
+        if (m_supported) glGenQueries(2, m_queries);
+    }
+
+    ~PassQuery() {
+        if (m_supported) glDeleteQueries(2, m_queries);
+    }
+
+    bool supported() const { return m_supported; }
+
+    void begin() {
+        if (!m_supported) return;
+        for (int i = 0; i < 2; ++i) {
+            if (!m_pending[i]) continue;
+            GLuint available = 0;
+            glGetQueryObjectuiv(m_queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 result = 0;
+                glGetQueryObjectui64v(m_queries[i], GL_QUERY_RESULT, &result);
+                m_last = result;
+                m_pending[i] = false;
+            }
+        }
+        // Both queries still in flight: this frame goes uncounted.
+        m_active = !m_pending[m_current];
+        if (m_active)
+            glBeginQuery(m_target, m_queries[m_current]);
+    }
+
+    void end() {
+        if (!m_active) return;
+        glEndQuery(m_target);
+        m_pending[m_current] = true;
+        m_current = 1 - m_current;
+        m_active = false;
+    }
+
+    // Result of the most recent finished pass.
+    std::uint64_t last() const { return m_last; }
+};
+
+// Fragment shader invocations of a pass (ARB_pipeline_statistics_query).
+class FragmentStats : public PassQuery {
+public:
+    FragmentStats() : PassQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, GLEW_ARB_pipeline_statistics_query != 0) {}
+};
+
+// Primitives reaching the rasterizer stage of a pass, every draw included.
+class PrimitiveStats : public PassQuery {
+public:
+    PrimitiveStats() : PassQuery(GL_PRIMITIVES_GENERATED, true) {}
+};
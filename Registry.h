@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+using Entity = std::uint32_t;
+constexpr Entity NULL_ENTITY = 0xffffffffu;
+
+// Packed storage for one component type (sparse set). Components of a type
+// are contiguous in `data()`, in the same order as `entities()`, so systems
+// iterate them linearly; removal swaps the last element into the hole.
+template <typename T>
+class ComponentPool {
+private:
+    std::vector<T> m_data;
+    std::vector<Entity> m_entities;
+    std::vector<std::uint32_t> m_sparse;
+
+    static constexpr std::uint32_t NONE = 0xffffffffu;
+
+public:
+    T& add(Entity e, const T& c) {
+        if (e >= m_sparse.size()) m_sparse.resize(e + 1, NONE);
+        if (m_sparse[e] != NONE) return m_data[m_sparse[e]] = c;
+        m_sparse[e] = (std::uint32_t)m_data.size();
+        m_entities.push_back(e);
+        m_data.push_back(c);
+        return m_data.back();
+    }
+
+    void remove(Entity e) {
+        if (!has(e)) return;
+        std::uint32_t i = m_sparse[e];
+        Entity last = m_entities.back();
+        m_data[i] = m_data.back();
+        m_entities[i] = last;
+        m_sparse[last] = i;
+        m_data.pop_back();
+        m_entities.pop_back();
+        m_sparse[e] = NONE;
+    }
+
+    bool has(Entity e) const { return e < m_sparse.size() && m_sparse[e] != NONE; }
+    T& get(Entity e) { return m_data[m_sparse[e]]; }
+    const T& get(Entity e) const { return m_data[m_sparse[e]]; }
+    T* tryGet(Entity e) { return has(e) ? &m_data[m_sparse[e]] : nullptr; }
+    // Position of e's component in data(), or NONE.
+    std::uint32_t indexOf(Entity e) const { return has(e) ? m_sparse[e] : NONE; }
+
+    std::size_t size() const { return m_data.size(); }
+    void reserve(std::size_t n) { m_data.reserve(n); m_entities.reserve(n); }
+    T* data() { return m_data.data(); }
+    const T* data() const { return m_data.data(); }
+    const std::vector<Entity>& entities() const { return m_entities; }
+};
+
+// Entity registry over a fixed set of component types; each type gets its
+// own pool, looked up at compile time.
+template <typename... Components>
+class BasicRegistry {
+private:
+    std::tuple<ComponentPool<Components>...> m_pools;
+    Entity m_next = 0;
+
+public:
+    Entity create() { return m_next++; }
+    std::size_t count() const { return m_next; }
+
+    template <typename T> ComponentPool<T>& pool() { return std::get<ComponentPool<T>>(m_pools); }
+    template <typename T> const ComponentPool<T>& pool() const { return std::get<ComponentPool<T>>(m_pools); }
+
+    template <typename T> T& add(Entity e, const T& c) { return pool<T>().add(e, c); }
+    template <typename T> void remove(Entity e) { pool<T>().remove(e); }
+    template <typename T> bool has(Entity e) const { return pool<T>().has(e); }
+    template <typename T> T& get(Entity e) { return pool<T>().get(e); }
+    template <typename T> T* tryGet(Entity e) { return pool<T>().tryGet(e); }
+};
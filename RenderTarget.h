@@ -0,0 +1,68 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Offscreen stand-in for the window framebuffer in --headless runs:
+//   color      RGBA8 renderbuffer
+//   depth      DEPTH24_STENCIL8 renderbuffer, the same format as a default
+//              framebuffer, so HiZPyramid can blit from it
+class RenderTarget {
+private:
+    unsigned int m_fbo = 0;
+    unsigned int m_color = 0, m_depth = 0;
+    int m_width = 0, m_height = 0;
+
+public:
+    RenderTarget(int width, int height) : m_width(width), m_height(height) {
+        glGenRenderbuffers(1, &m_color);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glGenRenderbuffers(1, &m_depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glGenFramebuffers(1, &m_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Render target framebuffer incomplete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~RenderTarget() {
+        glDeleteFramebuffers(1, &m_fbo);
+        glDeleteRenderbuffers(1, &m_color);
+        glDeleteRenderbuffers(1, &m_depth);
+    }
+
+    // Binds the target with a full viewport.
+    void bind() const {
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glViewport(0, 0, m_width, m_height);
+    }
+
+    // Reads the color back into a binary PPM, top row first.
+    bool savePpm(const std::string& path) const {
+        std::vector<unsigned char> pixels((std::size_t)m_width * m_height * 4);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        FILE* f = std::fopen(path.c_str(), "wb");
+        if (!f) return false;
+        std::fprintf(f, "P6\n%d %d\n255\n", m_width, m_height);
+        for (int y = m_height - 1; y >= 0; --y)
+            for (int x = 0; x < m_width; ++x)
+                std::fwrite(&pixels[((std::size_t)y * m_width + x) * 4], 1, 3, f);
+        std::fclose(f);
+        return true;
+    }
+
+    unsigned int fbo() const { return m_fbo; }
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+};
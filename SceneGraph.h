@@ -0,0 +1,299 @@
+#pragma once
+#include <glm.hpp>
+#include <gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "CpuProfiler.h"
+#include "FloatingOrigin.h"
+
+#if defined(FLOATING_ORIGIN_SSE2) && !defined(GLM_FORCE_QUAT_DATA_WXYZ)
+#include <xmmintrin.h>
+#define SCENE_GRAPH_SSE2 1   // quaternions are loaded as x, y, z, w
+#endif
+
+// Scene graph flattened into depth-first order, so every subtree is the
+// contiguous slot range [slot, subtreeEnd[slot]) and every parent comes
+// before its children. Setters only record the changed node; update()
+// recomputes the dirty subtrees in one forward pass over the slot arrays,
+// so the cost follows what moved rather than the size of the graph.
+//
+// World translations are accumulated in double like the rest of the
+// simulation; only the rotation/scale part is float. update() then rebases
+// the translations against the camera (see FloatingOrigin.h) so the matrices
+// handed to the GPU stay camera-relative: all of them when the camera moved,
+// only the recomputed ranges otherwise.
+//
+// updateRange() builds the local rotation/scale matrices of a block of
+// slots first, four slots per SSE2 register lane-wise, then composes them
+// with their parents in slot order.
+class SceneGraph {
+public:
+    using NodeId = std::uint32_t;
+    static constexpr NodeId NONE = 0xffffffffu;
+
+private:
+    // Per node id (stable handles).
+    std::vector<NodeId> m_parentOf;
+    std::vector<std::vector<NodeId>> m_children;
+    std::vector<std::uint32_t> m_slotOf;
+    bool m_layoutDirty = false;
+
+    // Per slot (depth-first order).
+    std::vector<NodeId> m_idOf;
+    std::vector<std::uint32_t> m_parentSlot;
+    std::vector<std::uint32_t> m_subtreeEnd;
+    std::vector<glm::dvec3> m_localPos;
+    std::vector<glm::quat> m_localRot;
+    std::vector<glm::vec3> m_localScale;
+    std::vector<glm::mat3> m_worldLinear;
+    std::vector<std::uint8_t> m_uniformScale;   // world linear part is rotation * s
+    std::vector<glm::dvec3> m_worldPos;
+    std::vector<glm::vec3> m_renderPos;
+
+    std::vector<std::uint32_t> m_dirtyRoots;
+    std::vector<std::uint8_t> m_dirty;
+    std::size_t m_lastUpdated = 0;
+    glm::dvec3 m_origin{0.0};
+    bool m_rebased = false;   // m_renderPos is relative to m_origin
+
+    void markDirty(NodeId id) {
+        std::uint32_t slot = m_slotOf[id];
+        if (!m_dirty[slot]) {
+            m_dirty[slot] = 1;
+            m_dirtyRoots.push_back(slot);
+        }
+    }
+
+    template <typename T>
+    static void permute(std::vector<T>& v, const std::vector<std::uint32_t>& oldSlotOfNew) {
+        std::vector<T> out(v.size());
+        for (std::size_t i = 0; i < out.size(); ++i) out[i] = v[oldSlotOfNew[i]];
+        v.swap(out);
+    }
+
+    // Re-flattens after nodes were added. Roots keep creation order.
+    void relayout() {
+        std::size_t n = m_parentOf.size();
+        std::vector<std::uint32_t> oldSlotOfNew;
+        std::vector<NodeId> newIdOf;
+        oldSlotOfNew.reserve(n);
+        newIdOf.reserve(n);
+
+        std::vector<NodeId> stack;
+        for (NodeId root = 0; root < n; ++root) {
+            if (m_parentOf[root] != NONE) continue;
+            stack.push_back(root);
+            while (!stack.empty()) {
+                NodeId id = stack.back();
+                stack.pop_back();
+                oldSlotOfNew.push_back(m_slotOf[id]);
+                newIdOf.push_back(id);
+                const std::vector<NodeId>& kids = m_children[id];
+                for (auto it = kids.rbegin(); it != kids.rend(); ++it) stack.push_back(*it);
+            }
+        }
+
+        permute(m_localPos, oldSlotOfNew);
+        permute(m_localRot, oldSlotOfNew);
+        permute(m_localScale, oldSlotOfNew);
+        permute(m_worldLinear, oldSlotOfNew);
+        permute(m_uniformScale, oldSlotOfNew);
+        permute(m_worldPos, oldSlotOfNew);
+        permute(m_renderPos, oldSlotOfNew);
+        m_idOf.swap(newIdOf);
+        for (std::uint32_t slot = 0; slot < n; ++slot) m_slotOf[m_idOf[slot]] = slot;
+
+        m_parentSlot.assign(n, NONE);
+        m_subtreeEnd.assign(n, 0);
+        for (std::uint32_t slot = 0; slot < n; ++slot) {
+            NodeId parent = m_parentOf[m_idOf[slot]];
+            if (parent != NONE) m_parentSlot[slot] = m_slotOf[parent];
+        }
+        // Children sit after their parent, so walking backwards lets each
+        // subtree end propagate up to its parent.
+        for (std::uint32_t slot = n; slot-- > 0;) {
+            m_subtreeEnd[slot] = std::max<std::uint32_t>(m_subtreeEnd[slot], slot + 1);
+            std::uint32_t p = m_parentSlot[slot];
+            if (p != NONE) m_subtreeEnd[p] = std::max(m_subtreeEnd[p], m_subtreeEnd[slot]);
+        }
+
+        // Everything is recomputed after a layout change.
+        m_dirty.assign(n, 0);
+        m_dirtyRoots.clear();
+        for (std::uint32_t slot = 0; slot < n; ++slot) {
+            if (m_parentSlot[slot] == NONE) {
+                m_dirty[slot] = 1;
+                m_dirtyRoots.push_back(slot);
+            }
+        }
+        m_layoutDirty = false;
+    }
+
+    static glm::mat3 localLinear(const glm::quat& r, const glm::vec3& scale) {
+        glm::mat3 local = glm::mat3_cast(r);
+        local[0] *= scale.x;
+        local[1] *= scale.y;
+        local[2] *= scale.z;
+        return local;
+    }
+
+    static bool isUniform(const glm::vec3& sc) {
+        return std::abs(sc.x - sc.y) <= 1e-6f * std::abs(sc.x) && std::abs(sc.x - sc.z) <= 1e-6f * std::abs(sc.x);
+    }
+
+#ifdef SCENE_GRAPH_SSE2
+    // localLinear() of slots s..s+3 into their m_worldLinear, computed with
+    // one slot per lane (same operations as glm::mat3_cast) and transposed
+    // back on the way out: each matrix is nine floats, stored 4 + 4 + 1.
+    void localLinear4(std::uint32_t s) {
+        __m128 x = _mm_loadu_ps(&m_localRot[s + 0].x), y = _mm_loadu_ps(&m_localRot[s + 1].x);
+        __m128 z = _mm_loadu_ps(&m_localRot[s + 2].x), w = _mm_loadu_ps(&m_localRot[s + 3].x);
+        _MM_TRANSPOSE4_PS(x, y, z, w);
+        const glm::vec3* sc = &m_localScale[s];
+        __m128 sx = _mm_set_ps(sc[3].x, sc[2].x, sc[1].x, sc[0].x);
+        __m128 sy = _mm_set_ps(sc[3].y, sc[2].y, sc[1].y, sc[0].y);
+        __m128 sz = _mm_set_ps(sc[3].z, sc[2].z, sc[1].z, sc[0].z);
+
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f);
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xz = _mm_mul_ps(x, z), xy = _mm_mul_ps(x, y), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+        // a = elements 0-3, b = 4-7, c = 8 of the column-major matrices.
+        __m128 a0 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+        __m128 a1 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+        __m128 a2 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+        __m128 a3 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+        __m128 b0 = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+        __m128 b1 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+        __m128 b2 = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+        __m128 b3 = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+        __m128 c = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+        _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+        _MM_TRANSPOSE4_PS(b0, b1, b2, b3);
+        alignas(16) float cs[4];
+        _mm_store_ps(cs, c);
+
+        float* m = &m_worldLinear[s][0].x;
+        _mm_storeu_ps(m + 0, a0);  _mm_storeu_ps(m + 4, b0);  m[8] = cs[0];
+        _mm_storeu_ps(m + 9, a1);  _mm_storeu_ps(m + 13, b1); m[17] = cs[1];
+        _mm_storeu_ps(m + 18, a2); _mm_storeu_ps(m + 22, b2); m[26] = cs[2];
+        _mm_storeu_ps(m + 27, a3); _mm_storeu_ps(m + 31, b3); m[35] = cs[3];
+    }
+#endif
+
+    // Two passes per block of slots, small enough to stay in L1: the local
+    // rotation/scale of every slot (independent, so four at a time with
+    // SSE2) left in m_worldLinear, then the composition with the parents in
+    // slot order, since a parent may sit in the same block.
+    void updateRange(std::uint32_t begin, std::uint32_t end) {
+        constexpr std::uint32_t BLOCK = 256;
+        for (std::uint32_t block = begin; block < end; block += BLOCK) {
+            std::uint32_t blockEnd = std::min(end, block + BLOCK);
+            std::uint32_t s = block;
+#ifdef SCENE_GRAPH_SSE2
+            for (; s + 4 <= blockEnd; s += 4) localLinear4(s);
+#endif
+            for (; s < blockEnd; ++s) m_worldLinear[s] = localLinear(m_localRot[s], m_localScale[s]);
+
+            for (s = block; s < blockEnd; ++s) {
+                bool uniform = isUniform(m_localScale[s]);
+                std::uint32_t p = m_parentSlot[s];
+                if (p == NONE) {
+                    m_worldPos[s] = m_localPos[s];
+                } else {
+                    const glm::mat3& pl = m_worldLinear[p];
+                    m_worldLinear[s] = pl * m_worldLinear[s];
+                    m_worldPos[s] = m_worldPos[p] + glm::dmat3(pl) * m_localPos[s];
+                    uniform = uniform && m_uniformScale[p];
+                }
+                m_uniformScale[s] = uniform;
+                m_dirty[s] = 0;
+            }
+        }
+        m_lastUpdated += end - begin;
+    }
+
+public:
+    NodeId createNode(NodeId parent = NONE) {
+        NodeId id = (NodeId)m_parentOf.size();
+        m_parentOf.push_back(parent);
+        m_children.emplace_back();
+        if (parent != NONE) m_children[parent].push_back(id);
+
+        // New nodes go at the end until the next relayout.
+        m_slotOf.push_back(id);
+        m_idOf.push_back(id);
+        m_localPos.emplace_back(0.0);
+        m_localRot.emplace_back(1.0f, 0.0f, 0.0f, 0.0f);
+        m_localScale.emplace_back(1.0f);
+        m_worldLinear.emplace_back(1.0f);
+        m_uniformScale.push_back(1);
+        m_worldPos.emplace_back(0.0);
+        m_renderPos.emplace_back(0.0f);
+        m_dirty.push_back(0);
+        m_layoutDirty = true;
+        return id;
+    }
+
+    void setTranslation(NodeId id, const glm::dvec3& t) { m_localPos[m_slotOf[id]] = t; markDirty(id); }
+    void setRotation(NodeId id, const glm::quat& r) { m_localRot[m_slotOf[id]] = r; markDirty(id); }
+    void setScale(NodeId id, const glm::vec3& s) { m_localScale[m_slotOf[id]] = s; markDirty(id); }
+
+    // Recomputes dirty subtrees and rebases world translations against
+    // `origin` (the camera) for rendering: every node when the origin moved,
+    // just the recomputed ones otherwise.
+    void update(const glm::dvec3& origin) {
+        PROFILE_SCOPE("scene graph");
+        if (m_layoutDirty) relayout();
+        bool fullRebase = !m_rebased || origin != m_origin;
+
+        m_lastUpdated = 0;
+        std::sort(m_dirtyRoots.begin(), m_dirtyRoots.end());
+        std::uint32_t covered = 0, rebaseBegin = 0;
+        auto rebaseRange = [&](std::uint32_t end) {
+            if (!fullRebase && end > rebaseBegin)
+                rebaseToOrigin(&m_worldPos[rebaseBegin], &m_renderPos[rebaseBegin], end - rebaseBegin, origin);
+        };
+        for (std::uint32_t root : m_dirtyRoots) {
+            // A root inside an already recomputed range was handled with it.
+            if (root < covered) { m_dirty[root] = 0; continue; }
+            // Adjacent ranges are rebased together.
+            if (root > covered) { rebaseRange(covered); rebaseBegin = root; }
+            covered = m_subtreeEnd[root];
+            updateRange(root, covered);
+        }
+        rebaseRange(covered);
+        m_dirtyRoots.clear();
+
+        if (fullRebase && !m_worldPos.empty())
+            rebaseToOrigin(m_worldPos.data(), m_renderPos.data(), m_worldPos.size(), origin);
+        m_origin = origin;
+        m_rebased = true;
+    }
+
+    std::size_t size() const { return m_parentOf.size(); }
+    std::size_t lastUpdatedCount() const { return m_lastUpdated; }
+    NodeId parent(NodeId id) const { return m_parentOf[id]; }
+
+    glm::dvec3 worldPosition(NodeId id) const { return m_worldPos[m_slotOf[id]]; }
+    glm::vec3 renderPosition(NodeId id) const { return m_renderPos[m_slotOf[id]]; }
+
+    // Camera-relative model matrix for the GPU.
+    glm::mat4 renderMatrix(NodeId id) const {
+        std::uint32_t s = m_slotOf[id];
+        glm::mat4 m(m_worldLinear[s]);
+        m[3] = glm::vec4(m_renderPos[s], 1.0f);
+        return m;
+    }
+
+    // Normal matrix for renderMatrix(id), up to scale (shaders normalize).
+    // Rotation times uniform scale is its own normal matrix, which covers
+    // every body; only non-uniformly scaled nodes pay for the inverse.
+    glm::mat3 normalMatrix(NodeId id) const {
+        std::uint32_t s = m_slotOf[id];
+        if (m_uniformScale[s]) return m_worldLinear[s];
+        return glm::transpose(glm::inverse(m_worldLinear[s]));
+    }
+};
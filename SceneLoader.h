@@ -0,0 +1,651 @@
+#pragma once
+#include <glm.hpp>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Components.h"
+#include "SceneGraph.h"
+#include "Systems.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Scene files describe materials and bodies (hierarchy, orbit, spin, light,
+// shadow). Two encodings share the same in-memory records:
+//  - JSON (scenes/*.json), read in one pass by a schema-driven reader with no
+//    intermediate DOM;
+//  - a pre-baked binary (.ssb) whose body table is BodyRecord[] verbatim, so
+//    loading is a file mapping plus a header check.
+
+enum BodyFlags : std::uint32_t {
+    BODY_SHADOW = 1u << 0,
+    BODY_LIGHT  = 1u << 1,
+};
+
+// Fixed layout: this is exactly what the .ssb body table stores.
+struct BodyRecord {
+    std::int32_t parent;     // index of an earlier body, -1 for roots
+    std::int32_t material;   // -1: not drawn
+    std::uint32_t flags;
+    float radius;
+    double position[3];
+    double orbitRadius, orbitSpeed, orbitPhase;
+    float spinAxis[3];
+    float spinSpeed;
+    float lightAmbient[3], lightDiffuse[3], lightSpecular[3];
+    float attenuation[3];
+};
+static_assert(sizeof(BodyRecord) == 128, "BodyRecord layout is part of the .ssb format");
+
+struct MaterialDesc {
+    std::string texture;
+    glm::vec3 color = glm::vec3(1.0f);
+    bool emissive = false;
+    glm::vec3 emissiveColor = glm::vec3(0.0f);
+    bool atmosphere = false;
+};
+
+struct BakedMaterial {
+    char texture[232];
+    float color[3];
+    float emissiveColor[3];
+    std::uint32_t emissive;
+    std::uint32_t atmosphere;   // was padding, so older files read as 0
+};
+static_assert(sizeof(BakedMaterial) == 264, "BakedMaterial layout is part of the .ssb format");
+
+struct BakedSceneHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint32_t materialCount;
+    std::uint32_t bodyCount;
+    std::uint64_t materialOffset;
+    std::uint64_t bodyOffset;
+    std::uint64_t nameOffset;    // uint32 offsets[bodyCount + 1], then chars
+    std::uint64_t fileSize;
+};
+
+class MappedFile {
+private:
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#endif
+
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        m_file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) { close(); return false; }
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!m_mapping) { close(); return false; }
+        m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        m_size = (std::size_t)size.QuadPart;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) { ::close(fd); return false; }
+        void* p = mmap(nullptr, (std::size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        m_data = (const char*)p;
+        m_size = (std::size_t)st.st_size;
+#endif
+        return m_data != nullptr;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (m_data) UnmapViewOfFile(m_data);
+        if (m_mapping) CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data) munmap((void*)m_data, m_size);
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+};
+
+// A loaded scene. Body records either live in `m_ownedBodies` (JSON) or point
+// straight into the mapped .ssb file.
+class SceneData {
+    friend class SceneJsonParser;
+    friend bool loadBakedScene(const std::string&, SceneData&, std::string&);
+
+private:
+    std::vector<BodyRecord> m_ownedBodies;
+    std::vector<std::uint32_t> m_ownedNameOffsets;
+    std::string m_ownedNameChars;
+    MappedFile m_file;
+    const BodyRecord* m_bodies = nullptr;
+    std::size_t m_bodyCount = 0;
+    const std::uint32_t* m_nameOffsets = nullptr;
+    const char* m_nameChars = nullptr;
+
+public:
+    std::vector<MaterialDesc> materials;
+
+    std::size_t bodyCount() const { return m_bodyCount; }
+    const BodyRecord* bodies() const { return m_bodies; }
+    // Names use the .ssb layout in both encodings: offsets[count + 1] + chars.
+    std::string_view name(std::size_t i) const {
+        return { m_nameChars + m_nameOffsets[i], m_nameOffsets[i + 1] - m_nameOffsets[i] };
+    }
+    int find(std::string_view n) const {
+        for (std::size_t i = 0; i < m_bodyCount; ++i)
+            if (name(i) == n) return (int)i;
+        return -1;
+    }
+};
+
+class JsonReader {
+private:
+    const char* m_begin;
+    const char* p;
+    const char* m_end;
+    std::string m_error;
+    std::string m_scratch;
+
+public:
+    JsonReader(const char* begin, const char* end) : m_begin(begin), p(begin), m_end(end) {}
+
+    bool ok() const { return m_error.empty(); }
+    const std::string& error() const { return m_error; }
+
+    void fail(const char* msg) {
+        if (m_error.empty()) m_error = std::string(msg) + " at offset " + std::to_string(p - m_begin);
+        p = m_end;
+    }
+
+    void ws() {
+        while (p < m_end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')) ++p;
+    }
+    bool peek(char c) { ws(); return p < m_end && *p == c; }
+    void expect(char c) {
+        ws();
+        if (p < m_end && *p == c) ++p;
+        else fail("unexpected character");
+    }
+
+    // Strings without escapes are returned as views into the buffer; escaped
+    // ones as a view of a scratch string that the next call overwrites.
+    bool inBuffer(std::string_view v) const { return v.data() >= m_begin && v.data() < m_end; }
+
+    std::string_view string() {
+        expect('"');
+        const char* start = p;
+        while (p < m_end && *p != '"' && *p != '\\') ++p;
+        if (p < m_end && *p == '"') return { start, (std::size_t)(p++ - start) };
+
+        m_scratch.assign(start, p);
+        while (p < m_end && *p != '"') {
+            char c = *p++;
+            if (c == '\\' && p < m_end) {
+                c = *p++;
+                if (c == 'n') c = '\n';
+                else if (c == 't') c = '\t';
+            }
+            m_scratch.push_back(c);
+        }
+        if (p >= m_end) { fail("unterminated string"); return {}; }
+        ++p;
+        return m_scratch;
+    }
+
+    double number() {
+        ws();
+        double v = 0.0;
+        auto res = std::from_chars(p, m_end, v);
+        if (res.ec != std::errc()) { fail("expected number"); return 0.0; }
+        p = res.ptr;
+        return v;
+    }
+
+    bool boolean() {
+        ws();
+        if (m_end - p >= 4 && std::memcmp(p, "true", 4) == 0) { p += 4; return true; }
+        if (m_end - p >= 5 && std::memcmp(p, "false", 5) == 0) { p += 5; return false; }
+        fail("expected boolean");
+        return false;
+    }
+
+    template <typename T>
+    void vec3(T out[3]) {
+        expect('[');
+        for (int i = 0; i < 3; ++i) {
+            if (i) expect(',');
+            out[i] = (T)number();
+        }
+        expect(']');
+    }
+    glm::vec3 vec3f() { float v[3]; vec3(v); return { v[0], v[1], v[2] }; }
+
+    // Object/array iteration: call after '{' / '[' until it returns false.
+    bool member(std::string_view& key) {
+        ws();
+        if (p < m_end && *p == ',') { ++p; ws(); }
+        if (p >= m_end || *p == '}') { if (p < m_end) ++p; else fail("unterminated object"); return false; }
+        key = string();
+        expect(':');
+        return ok();
+    }
+    bool element() {
+        ws();
+        if (p < m_end && *p == ',') { ++p; ws(); }
+        if (p >= m_end || *p == ']') { if (p < m_end) ++p; else fail("unterminated array"); return false; }
+        return ok();
+    }
+
+    void skip() {
+        ws();
+        if (p >= m_end) { fail("unexpected end"); return; }
+        std::string_view k;
+        switch (*p) {
+        case '{': ++p; while (member(k)) skip(); break;
+        case '[': ++p; while (element()) skip(); break;
+        case '"': string(); break;
+        case 't': case 'f': boolean(); break;
+        case 'n':
+            if (m_end - p >= 4 && std::memcmp(p, "null", 4) == 0) p += 4;
+            else fail("unexpected token");
+            break;
+        default: number(); break;
+        }
+    }
+};
+
+// Open-addressing name -> body index table over the scene's name blob. Much
+// cheaper than a node-based map when a catalog inserts a million names.
+class NameIndex {
+private:
+    std::vector<std::int32_t> m_slots;
+    std::size_t m_count = 0;
+
+    static std::uint64_t hash(std::string_view s) {
+        std::uint64_t h = 1469598103934665603ull;
+        for (char c : s) { h ^= (unsigned char)c; h *= 1099511628211ull; }
+        return h;
+    }
+
+    template <typename NameFn>
+    void grow(const NameFn& nameOf) {
+        std::vector<std::int32_t> old;
+        old.swap(m_slots);
+        m_slots.assign(old.empty() ? 1024 : old.size() * 2, -1);
+        std::size_t mask = m_slots.size() - 1;
+        for (std::int32_t idx : old) {
+            if (idx < 0) continue;
+            std::size_t i = hash(nameOf(idx)) & mask;
+            while (m_slots[i] >= 0) i = (i + 1) & mask;
+            m_slots[i] = idx;
+        }
+    }
+
+public:
+    void reserve(std::size_t n) {
+        std::size_t size = 1024;
+        while (size < n * 2) size *= 2;
+        m_slots.assign(size, -1);
+    }
+
+    template <typename NameFn>
+    void insert(std::string_view name, std::int32_t index, const NameFn& nameOf) {
+        if ((m_count + 1) * 2 > m_slots.size()) grow(nameOf);
+        std::size_t mask = m_slots.size() - 1;
+        std::size_t i = hash(name) & mask;
+        while (m_slots[i] >= 0) {
+            if (nameOf(m_slots[i]) == name) { m_slots[i] = index; return; }
+            i = (i + 1) & mask;
+        }
+        m_slots[i] = index;
+        ++m_count;
+    }
+
+    template <typename NameFn>
+    std::int32_t find(std::string_view name, const NameFn& nameOf) const {
+        if (m_slots.empty()) return -1;
+        std::size_t mask = m_slots.size() - 1;
+        for (std::size_t i = hash(name) & mask; m_slots[i] >= 0; i = (i + 1) & mask)
+            if (nameOf(m_slots[i]) == name) return m_slots[i];
+        return -1;
+    }
+};
+
+class SceneJsonParser {
+private:
+    JsonReader r;
+    SceneData& m_scene;
+    std::vector<std::pair<std::string, int>> m_materialIndex;
+    NameIndex m_bodyIndex;
+    int m_lastParentIndex = -1;
+
+    std::string_view ownedName(std::int32_t i) const {
+        const std::vector<std::uint32_t>& offsets = m_scene.m_ownedNameOffsets;
+        std::uint32_t end = (std::size_t)i + 1 < offsets.size() ? offsets[i + 1] : (std::uint32_t)m_scene.m_ownedNameChars.size();
+        return std::string_view(m_scene.m_ownedNameChars).substr(offsets[i], end - offsets[i]);
+    }
+
+    int findMaterial(std::string_view name) const {
+        for (const auto& m : m_materialIndex)
+            if (m.first == name) return m.second;
+        return -1;
+    }
+
+    int findParent(std::string_view name) {
+        // Catalogs list many children of the same parent in a row.
+        if (m_lastParentIndex >= 0 && ownedName(m_lastParentIndex) == name) return m_lastParentIndex;
+        int index = m_bodyIndex.find(name, [this](std::int32_t i) { return ownedName(i); });
+        if (index >= 0) m_lastParentIndex = index;
+        return index;
+    }
+
+    void parseMaterial(std::string_view name) {
+        MaterialDesc m;
+        std::string_view k;
+        r.expect('{');
+        while (r.member(k)) {
+            if (k == "texture") m.texture = std::string(r.string());
+            else if (k == "color") m.color = r.vec3f();
+            else if (k == "emissive") { m.emissive = true; m.emissiveColor = r.vec3f(); }
+            else if (k == "atmosphere") m.atmosphere = r.boolean();
+            else r.skip();
+        }
+        m_materialIndex.emplace_back(std::string(name), (int)m_scene.materials.size());
+        m_scene.materials.push_back(std::move(m));
+    }
+
+    void parseLight(BodyRecord& b) {
+        std::string_view k;
+        b.flags |= BODY_LIGHT;
+        r.expect('{');
+        while (r.member(k)) {
+            if (k == "ambient") r.vec3(b.lightAmbient);
+            else if (k == "diffuse") r.vec3(b.lightDiffuse);
+            else if (k == "specular") r.vec3(b.lightSpecular);
+            else if (k == "attenuation") r.vec3(b.attenuation);
+            else r.skip();
+        }
+    }
+
+    void parseBody() {
+        BodyRecord b{};
+        b.parent = -1;
+        b.material = -1;
+        b.radius = 1.0f;
+        b.spinAxis[1] = 1.0f;
+        b.lightAmbient[0] = b.lightAmbient[1] = b.lightAmbient[2] = 0.2f;
+        b.lightDiffuse[0] = b.lightDiffuse[1] = b.lightDiffuse[2] = 1.0f;
+        b.lightSpecular[0] = b.lightSpecular[1] = b.lightSpecular[2] = 1.0f;
+        b.attenuation[0] = 1.0f; b.attenuation[1] = 0.022f; b.attenuation[2] = 0.0019f;
+        std::string_view name;
+        std::string escapedName;
+
+        std::string_view k;
+        r.expect('{');
+        while (r.member(k)) {
+            if (k == "name") {
+                name = r.string();
+                if (!r.inBuffer(name)) { escapedName = name; name = escapedName; }
+            }
+            else if (k == "parent") {
+                b.parent = findParent(r.string());
+                if (b.parent < 0) { r.fail("parent must be declared before its children"); return; }
+            }
+            else if (k == "material") {
+                b.material = findMaterial(r.string());
+                if (b.material < 0) { r.fail("unknown material"); return; }
+            }
+            else if (k == "position") r.vec3(b.position);
+            else if (k == "radius") b.radius = (float)r.number();
+            else if (k == "orbit") {
+                std::string_view ok;
+                r.expect('{');
+                while (r.member(ok)) {
+                    if (ok == "radius") b.orbitRadius = r.number();
+                    else if (ok == "speed") b.orbitSpeed = r.number();
+                    else if (ok == "phase") b.orbitPhase = r.number();
+                    else r.skip();
+                }
+            }
+            else if (k == "spin") {
+                std::string_view sk;
+                r.expect('{');
+                while (r.member(sk)) {
+                    if (sk == "axis") r.vec3(b.spinAxis);
+                    else if (sk == "speed") b.spinSpeed = (float)r.number();
+                    else r.skip();
+                }
+            }
+            else if (k == "light") parseLight(b);
+            else if (k == "shadow") { if (r.boolean()) b.flags |= BODY_SHADOW; }
+            else r.skip();
+        }
+        std::int32_t index = (std::int32_t)m_scene.m_ownedBodies.size();
+        m_scene.m_ownedBodies.push_back(b);
+        m_scene.m_ownedNameOffsets.push_back((std::uint32_t)m_scene.m_ownedNameChars.size());
+        m_scene.m_ownedNameChars.append(name);
+        if (!name.empty()) m_bodyIndex.insert(name, index, [this](std::int32_t i) { return ownedName(i); });
+    }
+
+public:
+    SceneJsonParser(const char* begin, const char* end, SceneData& scene) : r(begin, end), m_scene(scene) {
+        // Rough guess at the body count from the file size.
+        std::size_t estimate = (std::size_t)(end - begin) / 160;
+        m_bodyIndex.reserve(estimate);
+        m_scene.m_ownedBodies.reserve(estimate);
+        m_scene.m_ownedNameOffsets.reserve(estimate + 1);
+    }
+
+    bool parse(std::string& error) {
+        std::string_view k;
+        r.expect('{');
+        while (r.member(k)) {
+            if (k == "materials") {
+                std::string_view name;
+                r.expect('{');
+                while (r.member(name)) parseMaterial(std::string(name));
+            }
+            else if (k == "bodies") {
+                r.expect('[');
+                while (r.element()) parseBody();
+            }
+            else r.skip();
+        }
+        m_scene.m_ownedNameOffsets.push_back((std::uint32_t)m_scene.m_ownedNameChars.size());
+        m_scene.m_bodies = m_scene.m_ownedBodies.data();
+        m_scene.m_bodyCount = m_scene.m_ownedBodies.size();
+        m_scene.m_nameOffsets = m_scene.m_ownedNameOffsets.data();
+        m_scene.m_nameChars = m_scene.m_ownedNameChars.data();
+        error = r.error();
+        return r.ok();
+    }
+};
+
+inline bool parseSceneJson(const char* begin, const char* end, SceneData& scene, std::string& error) {
+    return SceneJsonParser(begin, end, scene).parse(error);
+}
+
+inline bool loadSceneJson(const std::string& path, SceneData& scene, std::string& error) {
+    MappedFile file;
+    if (!file.open(path)) { error = "failed to open " + path; return false; }
+    return parseSceneJson(file.data(), file.data() + file.size(), scene, error);
+}
+
+inline bool loadBakedScene(const std::string& path, SceneData& scene, std::string& error) {
+    if (!scene.m_file.open(path)) { error = "failed to open " + path; return false; }
+    const char* base = scene.m_file.data();
+    std::size_t size = scene.m_file.size();
+    const BakedSceneHeader* h = (const BakedSceneHeader*)base;
+    // Each table must lie inside the file and sit at an offset its records
+    // can be read from in place (the mapping itself is page aligned).
+    auto table = [size](std::uint64_t offset, std::uint64_t bytes, std::size_t alignment) {
+        return offset <= size && bytes <= size - offset && offset % alignment == 0;
+    };
+    if (size < sizeof(BakedSceneHeader) || std::memcmp(h->magic, "SSB1", 4) != 0 || h->version != 1
+        || h->fileSize != size
+        || !table(h->materialOffset, (std::uint64_t)h->materialCount * sizeof(BakedMaterial), alignof(BakedMaterial))
+        || !table(h->bodyOffset, (std::uint64_t)h->bodyCount * sizeof(BodyRecord), alignof(BodyRecord))
+        || !table(h->nameOffset, ((std::uint64_t)h->bodyCount + 1) * sizeof(std::uint32_t), alignof(std::uint32_t))) {
+        error = "not a valid baked scene: " + path;
+        scene.m_file.close();
+        return false;
+    }
+
+    const BakedMaterial* mats = (const BakedMaterial*)(base + h->materialOffset);
+    for (std::uint32_t i = 0; i < h->materialCount; ++i) {
+        MaterialDesc m;
+        m.texture.assign(mats[i].texture, strnlen(mats[i].texture, sizeof(mats[i].texture)));
+        m.color = { mats[i].color[0], mats[i].color[1], mats[i].color[2] };
+        m.emissive = mats[i].emissive != 0;
+        m.emissiveColor = { mats[i].emissiveColor[0], mats[i].emissiveColor[1], mats[i].emissiveColor[2] };
+        m.atmosphere = mats[i].atmosphere != 0;
+        scene.materials.push_back(std::move(m));
+    }
+    scene.m_bodies = (const BodyRecord*)(base + h->bodyOffset);
+    scene.m_bodyCount = h->bodyCount;
+    scene.m_nameOffsets = (const std::uint32_t*)(base + h->nameOffset);
+    scene.m_nameChars = (const char*)(scene.m_nameOffsets + h->bodyCount + 1);
+    // name(i) reads [offsets[i], offsets[i + 1]), so the offsets must not
+    // decrease and the last one must end inside the file.
+    bool namesValid = (std::uint64_t)(scene.m_nameChars - base) + scene.m_nameOffsets[h->bodyCount] <= size;
+    for (std::uint32_t i = 0; namesValid && i < h->bodyCount; ++i)
+        namesValid = scene.m_nameOffsets[i] <= scene.m_nameOffsets[i + 1];
+    if (!namesValid) {
+        error = "corrupt name table: " + path;
+        scene.m_file.close();
+        scene.materials.clear();
+        scene.m_bodies = nullptr;
+        scene.m_bodyCount = 0;
+        scene.m_nameOffsets = nullptr;
+        scene.m_nameChars = nullptr;
+        return false;
+    }
+    return true;
+}
+
+inline bool loadScene(const std::string& path, SceneData& scene, std::string& error) {
+    if (path.size() > 4 && path.compare(path.size() - 4, 4, ".ssb") == 0) return loadBakedScene(path, scene, error);
+    return loadSceneJson(path, scene, error);
+}
+
+inline bool bakeScene(const SceneData& scene, const std::string& path) {
+    auto align = [](std::uint64_t v) { return (v + 15) & ~std::uint64_t(15); };
+    std::uint32_t bodyCount = (std::uint32_t)scene.bodyCount();
+
+    std::vector<std::uint32_t> nameOffsets(bodyCount + 1, 0);
+    std::string names;
+    for (std::uint32_t i = 0; i < bodyCount; ++i) {
+        nameOffsets[i] = (std::uint32_t)names.size();
+        names += scene.name(i);
+    }
+    nameOffsets[bodyCount] = (std::uint32_t)names.size();
+
+    BakedSceneHeader h{};
+    std::memcpy(h.magic, "SSB1", 4);
+    h.version = 1;
+    h.materialCount = (std::uint32_t)scene.materials.size();
+    h.bodyCount = bodyCount;
+    h.materialOffset = align(sizeof(BakedSceneHeader));
+    h.bodyOffset = align(h.materialOffset + h.materialCount * sizeof(BakedMaterial));
+    h.nameOffset = align(h.bodyOffset + (std::uint64_t)bodyCount * sizeof(BodyRecord));
+    h.fileSize = h.nameOffset + nameOffsets.size() * sizeof(std::uint32_t) + names.size();
+
+    std::vector<BakedMaterial> mats(h.materialCount);
+    for (std::size_t i = 0; i < mats.size(); ++i) {
+        const MaterialDesc& m = scene.materials[i];
+        BakedMaterial& b = mats[i];
+        std::memset(&b, 0, sizeof(b));
+        std::strncpy(b.texture, m.texture.c_str(), sizeof(b.texture) - 1);
+        b.color[0] = m.color.x; b.color[1] = m.color.y; b.color[2] = m.color.z;
+        b.emissiveColor[0] = m.emissiveColor.x; b.emissiveColor[1] = m.emissiveColor.y; b.emissiveColor[2] = m.emissiveColor.z;
+        b.emissive = m.emissive ? 1u : 0u;
+        b.atmosphere = m.atmosphere ? 1u : 0u;
+    }
+
+    FILE* f = std::fopen(path.c_str(), "wb");
+    if (!f) return false;
+    auto writeAt = [f](std::uint64_t offset, const void* data, std::size_t bytes) {
+        static const char zeros[16] = {};
+        long pos = std::ftell(f);
+        if ((std::uint64_t)pos < offset) std::fwrite(zeros, 1, (std::size_t)(offset - pos), f);
+        if (bytes) std::fwrite(data, 1, bytes, f);
+    };
+    writeAt(0, &h, sizeof(h));
+    writeAt(h.materialOffset, mats.data(), mats.size() * sizeof(BakedMaterial));
+    writeAt(h.bodyOffset, scene.bodies(), (std::size_t)bodyCount * sizeof(BodyRecord));
+    writeAt(h.nameOffset, nameOffsets.data(), nameOffsets.size() * sizeof(std::uint32_t));
+    writeAt(h.nameOffset + nameOffsets.size() * sizeof(std::uint32_t), names.data(), names.size());
+    bool ok = std::ferror(f) == 0;
+    std::fclose(f);
+    return ok;
+}
+
+// Creates one entity per body. `meshes` holds one sphere per material (may be
+// empty for GL-less tools, in which case nothing gets a RenderSphere).
+inline std::vector<Entity> instantiateScene(const SceneData& scene, Registry& reg, SceneGraph& graph,
+                                            const std::vector<Sphere*>& meshes) {
+    std::vector<Entity> entities(scene.bodyCount(), NULL_ENTITY);
+    const BodyRecord* bodies = scene.bodies();
+    for (std::size_t i = 0; i < scene.bodyCount(); ++i) {
+        const BodyRecord& b = bodies[i];
+        BodyDesc d;
+        if (b.parent >= 0 && (std::size_t)b.parent < i) d.parent = entities[b.parent];
+        d.position = glm::dvec3(b.position[0], b.position[1], b.position[2]);
+        d.orbitRadius = b.orbitRadius;
+        d.orbitSpeed = b.orbitSpeed;
+        d.orbitPhase = b.orbitPhase;
+        d.radius = b.radius;
+        d.spinAxis = glm::vec3(b.spinAxis[0], b.spinAxis[1], b.spinAxis[2]);
+        d.spinSpeed = b.spinSpeed;
+        d.castsShadow = (b.flags & BODY_SHADOW) != 0;
+        if (b.material >= 0 && (std::size_t)b.material < scene.materials.size()) {
+            const MaterialDesc& m = scene.materials[b.material];
+            d.color = m.color;
+            d.atmosphere = m.atmosphere;
+            if ((std::size_t)b.material < meshes.size()) d.mesh = meshes[b.material];
+            if (m.emissive || (b.flags & BODY_LIGHT)) {
+                d.emissive = true;
+                d.light = { m.emissiveColor,
+                            { b.lightAmbient[0], b.lightAmbient[1], b.lightAmbient[2] },
+                            { b.lightDiffuse[0], b.lightDiffuse[1], b.lightDiffuse[2] },
+                            { b.lightSpecular[0], b.lightSpecular[1], b.lightSpecular[2] },
+                            b.attenuation[0], b.attenuation[1], b.attenuation[2] };
+            }
+        }
+        entities[i] = createBody(reg, graph, d);
+    }
+    return entities;
+}
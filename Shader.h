@@ -1,83 +1,385 @@
 #pragma once
 #include <GL/glew.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <regex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include "glm.hpp"
+#include "CpuProfiler.h"
 
+// A shader file may be compiled as several permutations: bit i of a variant
+// key injects `#define features[i]` right after each stage's #version line
+// (a feature like "NUM_LIGHTS 2" defines a value). `constants` are defined
+// in every variant. Nothing is compiled until a variant is first selected
+// or precompiled; variants are kept, and setUniform* apply to the selected
+// one (bind() and the setters need a select() first).
+//
+// Sources are preprocessed on load: `#include "file"` is resolved relative to
+// the including file, once per stage, and #line directives keep compiler
+// messages pointing at the original file and line (the source-string numbers
+// are mapped back to file names when logs are printed).
+//
+// Linked programs are cached on disk with glGetProgramBinary, keyed by
+// sourceHash(), the variant's defines and the driver's vendor/renderer/version
+// strings; a missing, stale or rejected binary just falls back to compiling.
+// precompile() starts several variants at once so drivers with
+// KHR/ARB_parallel_shader_compile can build them on their own threads.
+//
+// A file with a `#shader compute` section is a compute program (GL 4.3 or
+// ARB_compute_shader); its other sections are ignored.
 class Shader {
 private:
     unsigned int m_ID = 0;
 
-    struct Src { std::string vertex, fragment; };
+    struct Src { std::string vertex, fragment, geometry, compute; };
+    struct Program {
+        unsigned int id = 0;
+        unsigned int stages[4] = {};   // until finished
+        std::uint64_t hash = 0;
+        bool finished = false;
+    };
+    Src m_src;
+    std::vector<std::string> m_files;   // #line source-string numbers
+    std::uint64_t m_sourceHash = 0;
+    std::vector<std::string> m_features;
+    std::vector<std::string> m_constants;
+    std::unordered_map<std::uint32_t, Program> m_variants;
+    std::uint32_t m_variant = 0;
+
+    static std::string& cacheDirectory() {
+        static std::string dir = "shader_cache";
+        return dir;
+    }
+
+    static bool binaryCache() {
+        if (cacheDirectory().empty() || !GLEW_ARB_get_program_binary) return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    static std::uint64_t fnv1a(const std::string& s, std::uint64_t h = 1469598103934665603ull) {
+        for (unsigned char c : s) h = (h ^ c) * 1099511628211ull;
+        return h;
+    }
+
+    static std::string driverString() {
+        std::string out;
+        for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+            const GLubyte* str = glGetString(name);
+            out += str ? reinterpret_cast<const char*>(str) : "";
+            out += '\n';
+        }
+        return out;
+    }
+
+    static std::string cachePath(std::uint64_t hash) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)hash);
+        return cacheDirectory() + "/" + name;
+    }
+
+    // File: "SPB1", hash, binary format, binary.
+    static bool loadBinary(unsigned int prog, std::uint64_t hash) {
+        std::ifstream in(cachePath(hash), std::ios::binary);
+        if (!in) return false;
+        char magic[4];
+        std::uint64_t storedHash = 0;
+        std::uint32_t format = 0;
+        in.read(magic, 4);
+        in.read(reinterpret_cast<char*>(&storedHash), sizeof(storedHash));
+        in.read(reinterpret_cast<char*>(&format), sizeof(format));
+        if (!in || std::string(magic, 4) != "SPB1" || storedHash != hash) return false;
+        std::vector<char> binary((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        if (binary.empty()) return false;
+        glProgramBinary(prog, format, binary.data(), (GLsizei)binary.size());
+        GLint linked = 0;
+        glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+        return linked != 0;
+    }
+
+    static void saveBinary(unsigned int prog, std::uint64_t hash) {
+        GLint length = 0;
+        glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(prog, length, nullptr, &format, binary.data());
+        std::error_code ec;
+        std::filesystem::create_directories(cacheDirectory(), ec);
+        std::ofstream out(cachePath(hash), std::ios::binary);
+        if (!out) return;
+        std::uint32_t format32 = format;
+        out.write("SPB1", 4);
+        out.write(reinterpret_cast<const char*>(&hash), sizeof(hash));
+        out.write(reinterpret_cast<const char*>(&format32), sizeof(format32));
+        out.write(binary.data(), binary.size());
+    }
+
+    std::string defines(std::uint32_t variant) const {
+        std::string out;
+        for (const std::string& c : m_constants) out += "#define " + c + "\n";
+        for (std::size_t i = 0; i < m_features.size(); ++i)
+            if (variant & (1u << i)) out += "#define " + m_features[i] + "\n";
+        return out;
+    }
+
+    static std::string inject(const std::string& src, const std::string& defs) {
+        if (src.empty() || defs.empty()) return src;
+        std::size_t version = src.find("#version");
+        if (version == std::string::npos) return defs + src;
+        std::size_t eol = src.find('\n', version);
+        if (eol == std::string::npos) return src + "\n" + defs;
+        return src.substr(0, eol + 1) + defs + src.substr(eol + 1);
+    }
+
+    int fileId(const std::string& path) {
+        auto it = std::find(m_files.begin(), m_files.end(), path);
+        if (it != m_files.end()) return (int)(it - m_files.begin());
+        m_files.push_back(path);
+        return (int)m_files.size() - 1;
+    }
+
+    static bool parseInclude(const std::string& line, std::string& target) {
+        std::size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0) return false;
+        std::size_t open = line.find('"', start + 8);
+        std::size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos) return false;
+        target = line.substr(open + 1, close - open - 1);
+        return true;
+    }
+
+    static std::string resolve(const std::string& from, const std::string& target) {
+        return (std::filesystem::path(from).parent_path() / target).lexically_normal().generic_string();
+    }
+
+    // Appends the file with its includes expanded. `included` holds what
+    // this stage already pulled in, so each file lands once.
+    void expand(const std::string& path, std::string& out, std::vector<std::string>& included, int depth) {
+        if (std::find(included.begin(), included.end(), path) != included.end()) return;
+        if (depth > 16) {
+            std::cerr << "Shader: includes nested too deep at " << path << std::endl;
+            return;
+        }
+        included.push_back(path);
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            std::cerr << "Shader: failed open " << path << std::endl;
+            return;
+        }
+        int id = fileId(path);
+        out += "#line 1 " + std::to_string(id) + "\n";
+        std::string line, target;
+        int lineNo = 0;
+        while (std::getline(file, line)) {
+            ++lineNo;
+            if (parseInclude(line, target)) {
+                expand(resolve(path, target), out, included, depth + 1);
+                out += "#line " + std::to_string(lineNo + 1) + " " + std::to_string(id) + "\n";
+            } else {
+                out += line + '\n';
+            }
+        }
+    }
 
     Src loadFromFile(const std::string& path) {
         std::ifstream file(path);
         if (!file.is_open()) std::cerr << "Shader: failed open " << path << std::endl;
+        int id = fileId(std::filesystem::path(path).lexically_normal().generic_string());
 
-        std::string line;
-        std::stringstream ss[2];
-        int mode = -1;
+        std::string line, target;
+        std::string out[4];
+        std::vector<std::string> included[4];
+        int mode = -1, lineNo = 0;
         while (std::getline(file, line)) {
+            ++lineNo;
             if (line.find("#shader") != std::string::npos) {
                 if (line.find("vertex") != std::string::npos) mode = 0;
+                else if (line.find("geometry") != std::string::npos) mode = 2;
+                else if (line.find("compute") != std::string::npos) mode = 3;
                 else mode = 1;
-            } else {
-                if (mode >= 0) ss[mode] << line << '\n';
+            } else if (mode >= 0) {
+                if (parseInclude(line, target)) {
+                    expand(resolve(path, target), out[mode], included[mode], 1);
+                    out[mode] += "#line " + std::to_string(lineNo + 1) + " " + std::to_string(id) + "\n";
+                    continue;
+                }
+                out[mode] += line + '\n';
+                // Stages start mid-file; #version must stay first, so the
+                // line mapping follows it (injected defines go in between).
+                if (line.find("#version") != std::string::npos)
+                    out[mode] += "#line " + std::to_string(lineNo + 1) + " " + std::to_string(id) + "\n";
             }
         }
-        return { ss[0].str(), ss[1].str() };
+        m_sourceHash = fnv1a(out[3], fnv1a(out[2], fnv1a(out[1], fnv1a(out[0]))));
+        return { out[0], out[1], out[2], out[3] };
     }
 
-    static void checkCompile(unsigned int id, const std::string& type) {
+    // Rewrites "N(line)" (NVIDIA) and "N:line:" (AMD, Intel, Mesa) source
+    // string references into file names.
+    std::string annotate(const std::string& log) const {
+        static const std::regex ref(R"(\b(\d+)(\((\d+)\)|:(\d+):))");
+        std::string out;
+        std::size_t last = 0;
+        for (auto it = std::sregex_iterator(log.begin(), log.end(), ref); it != std::sregex_iterator(); ++it) {
+            const std::smatch& m = *it;
+            std::size_t file = std::stoul(m[1].str());
+            if (file >= m_files.size()) continue;
+            out += log.substr(last, m.position() - last);
+            out += m_files[file] + (m[3].matched ? "(" + m[3].str() + ")" : ":" + m[4].str() + ":");
+            last = m.position() + m.length();
+        }
+        return out + log.substr(last);
+    }
+
+    void checkCompile(unsigned int id, const std::string& type) const {
         int success;
         char buf[1024];
         glGetShaderiv(id, GL_COMPILE_STATUS, &success);
         if (!success) {
             glGetShaderInfoLog(id, 1024, nullptr, buf);
-            std::cout << type << " SHADER ERROR:\n" << buf << std::endl;
+            std::cout << type << " SHADER ERROR:\n" << annotate(buf) << std::endl;
         }
     }
-    static void checkLink(unsigned int prog) {
+    static bool checkLink(unsigned int prog) {
         int success; char buf[1024];
         glGetProgramiv(prog, GL_LINK_STATUS, &success);
         if (!success) {
             glGetProgramInfoLog(prog, 1024, nullptr, buf);
             std::cout << "PROGRAM LINK ERROR:\n" << buf << std::endl;
         }
+        return success != 0;
     }
     unsigned int compile(unsigned int type, const std::string& src) {
         unsigned int id = glCreateShader(type);
         const char* c = src.c_str();
         glShaderSource(id, 1, &c, nullptr);
         glCompileShader(id);
-        if (type == GL_VERTEX_SHADER) checkCompile(id, "VERTEX");
-        else checkCompile(id, "FRAGMENT");
         return id;
     }
 
-    unsigned int createProgram(const std::string& vert, const std::string& frag) {
-        unsigned int prog = glCreateProgram();
-        unsigned int vs = compile(GL_VERTEX_SHADER, vert);
-        unsigned int fs = compile(GL_FRAGMENT_SHADER, frag);
-        glAttachShader(prog, vs);
-        glAttachShader(prog, fs);
-        glLinkProgram(prog);
-        checkLink(prog);
-        glValidateProgram(prog);
-        glDeleteShader(vs);
-        glDeleteShader(fs);
-        return prog;
+    // Loads the variant from the cache or issues its compile and link
+    // without waiting on the result; finish() collects it.
+    Program start(std::uint32_t variant) {
+        PROFILE_SCOPE("shader compile");
+        static bool threadsRequested = false;
+        if (!threadsRequested && parallelCompile()) {
+            if (GLEW_KHR_parallel_shader_compile) glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+            else glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+            threadsRequested = true;
+        }
+
+        std::string defs = defines(variant);
+        Program p;
+        p.id = glCreateProgram();
+        bool cached = binaryCache();
+        if (cached) {
+            p.hash = fnv1a(defs, fnv1a(driverString(), m_sourceHash));
+            if (loadBinary(p.id, p.hash)) {
+                p.finished = true;
+                return p;
+            }
+            glProgramParameteri(p.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        if (!m_src.compute.empty()) {
+            p.stages[3] = compile(GL_COMPUTE_SHADER, inject(m_src.compute, defs));
+        } else {
+            p.stages[0] = compile(GL_VERTEX_SHADER, inject(m_src.vertex, defs));
+            p.stages[1] = compile(GL_FRAGMENT_SHADER, inject(m_src.fragment, defs));
+            if (!m_src.geometry.empty()) p.stages[2] = compile(GL_GEOMETRY_SHADER, inject(m_src.geometry, defs));
+        }
+        for (unsigned int stage : p.stages)
+            if (stage) glAttachShader(p.id, stage);
+        glLinkProgram(p.id);
+        return p;
+    }
+
+    void finish(Program& p) {
+        if (p.finished) return;
+        PROFILE_SCOPE("shader link");
+        if (p.stages[0]) checkCompile(p.stages[0], "VERTEX");
+        if (p.stages[1]) checkCompile(p.stages[1], "FRAGMENT");
+        if (p.stages[2]) checkCompile(p.stages[2], "GEOMETRY");
+        if (p.stages[3]) checkCompile(p.stages[3], "COMPUTE");
+        bool linked = checkLink(p.id);
+        glValidateProgram(p.id);
+        for (unsigned int& stage : p.stages) {
+            if (!stage) continue;
+            glDetachShader(p.id, stage);
+            glDeleteShader(stage);
+            stage = 0;
+        }
+        if (linked && p.hash) saveBinary(p.id, p.hash);
+        p.finished = true;
     }
 
 public:
     Shader() = default;
-    Shader(const std::string& shaderFile) {
-        Src s = loadFromFile(shaderFile);
-        m_ID = createProgram(s.vertex, s.fragment);
+    Shader(const std::string& shaderFile, const std::vector<std::string>& features = {},
+           const std::vector<std::string>& constants = {})
+        : m_features(features), m_constants(constants) {
+        {
+            PROFILE_SCOPE("shader load");
+            m_src = loadFromFile(shaderFile);
+        }
+    }
+    ~Shader() {
+        for (auto& v : m_variants) {
+            for (unsigned int stage : v.second.stages)
+                if (stage) glDeleteShader(stage);
+            glDeleteProgram(v.second.id);
+        }
     }
-    ~Shader() { if (m_ID) glDeleteProgram(m_ID); }
+
+    // True when the driver builds precompiled variants on its own threads,
+    // so ready() can tell when one is done.
+    static bool parallelCompile() {
+        return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+    }
+
+    // Where linked programs are cached; empty disables the cache.
+    static void setCacheDirectory(const std::string& dir) { cacheDirectory() = dir; }
+
+    // Starts compiling every listed variant not built yet, without waiting.
+    void precompile(const std::vector<std::uint32_t>& variants) {
+        for (std::uint32_t v : variants)
+            if (!m_variants.count(v)) m_variants.emplace(v, start(v));
+    }
+
+    // True when select(variant) will not block on the compiler. Without
+    // parallel compile support only finished variants report ready.
+    bool ready(std::uint32_t variant) const {
+        auto it = m_variants.find(variant);
+        if (it == m_variants.end()) return false;
+        if (it->second.finished) return true;
+        if (!parallelCompile()) return false;
+        GLint done = 0;
+        glGetProgramiv(it->second.id, GL_COMPLETION_STATUS_KHR, &done);
+        return done != 0;
+    }
+
+    // Binds the permutation for `variant`, compiling it on first use.
+    // Uniforms are per program, so they must be set again after switching.
+    void select(std::uint32_t variant) {
+        auto it = m_variants.find(variant);
+        if (it == m_variants.end()) it = m_variants.emplace(variant, start(variant)).first;
+        finish(it->second);
+        m_variant = variant;
+        m_ID = it->second.id;
+        glUseProgram(m_ID);
+    }
+    std::uint32_t variant() const { return m_variant; }
+    // Hash of the preprocessed stages (includes expanded, before defines).
+    std::uint64_t sourceHash() const { return m_sourceHash; }
+    std::size_t variantCount() const { return m_variants.size(); }
 
     void bind() const { glUseProgram(m_ID); }
     void unbind() const { glUseProgram(0); }
@@ -87,6 +389,10 @@ public:
         int loc = glGetUniformLocation(m_ID, name.c_str());
         if (loc != -1) glUniformMatrix4fv(loc, 1, GL_FALSE, &m[0][0]);
     }
+    void setUniformMat3f(const std::string& name, const glm::mat3& m) const {
+        int loc = glGetUniformLocation(m_ID, name.c_str());
+        if (loc != -1) glUniformMatrix3fv(loc, 1, GL_FALSE, &m[0][0]);
+    }
     void setUniformVec4f(const std::string& name, const glm::vec4& v) const {
         int loc = glGetUniformLocation(m_ID, name.c_str());
         if (loc != -1) glUniform4f(loc, v.x, v.y, v.z, v.w);
@@ -99,6 +405,18 @@ public:
         int loc = glGetUniformLocation(m_ID, name.c_str());
         if (loc != -1) glUniform3f(loc, v1, v2, v3);
     }
+    void setUniformVec2f(const std::string& name, const glm::vec2& v) const {
+        int loc = glGetUniformLocation(m_ID, name.c_str());
+        if (loc != -1) glUniform2f(loc, v.x, v.y);
+    }
+    void setUniformVec2i(const std::string& name, const glm::ivec2& v) const {
+        int loc = glGetUniformLocation(m_ID, name.c_str());
+        if (loc != -1) glUniform2i(loc, v.x, v.y);
+    }
+    void setUniformVec3i(const std::string& name, const glm::ivec3& v) const {
+        int loc = glGetUniformLocation(m_ID, name.c_str());
+        if (loc != -1) glUniform3i(loc, v.x, v.y, v.z);
+    }
     void setUniform1i(const std::string& name, int v) const {
         int loc = glGetUniformLocation(m_ID, name.c_str());
         if (loc != -1) glUniform1i(loc, v);
@@ -107,6 +425,14 @@ public:
         int loc = glGetUniformLocation(m_ID, name.c_str());
         if (loc != -1) glUniform1f(loc, v);
     }
+    void setUniform1ui(const std::string& name, unsigned int v) const {
+        int loc = glGetUniformLocation(m_ID, name.c_str());
+        if (loc != -1) glUniform1ui(loc, v);
+    }
+    void setUniformVec4fv(const std::string& name, const glm::vec4* v, int count) const {
+        int loc = glGetUniformLocation(m_ID, name.c_str());
+        if (loc != -1) glUniform4fv(loc, count, &v[0].x);
+    }
 
     // دوال مساعدة للأضواء
     void setDirLight(const std::string& name,
@@ -0,0 +1,103 @@
+#pragma once
+#include <GL/glew.h>
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Shader.h"
+#include "Sphere.h"
+
+// Omnidirectional shadow map for the sun's point light. All casters are
+// drawn in a single instanced call; the geometry shader of shadow-depth.fs
+// routes each triangle to the six cube faces (layered rendering), and the
+// lighting shader samples it with PCF. Per-fragment cost no longer depends
+// on the number of casters.
+class CubeShadowMap {
+private:
+    unsigned int m_fbo = 0;
+    unsigned int m_depthCube = 0;
+    unsigned int m_instanceVBO = 0;
+    int m_resolution = 0;
+
+public:
+    // Largest power-of-two face size whose six 32-bit depth faces fit.
+    static int resolutionForBudget(std::size_t bytes) {
+        int res = 4096;
+        while (res > 64 && (std::size_t)res * res * 6 * 4 > bytes) res /= 2;
+        return res;
+    }
+
+    explicit CubeShadowMap(std::size_t budgetBytes) {
+        m_resolution = resolutionForBudget(budgetBytes);
+
+        glGenTextures(1, &m_depthCube);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_depthCube);
+        for (unsigned int i = 0; i < 6; ++i)
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_DEPTH_COMPONENT32F,
+                         m_resolution, m_resolution, 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+        glGenFramebuffers(1, &m_fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthCube, 0);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "Shadow map framebuffer incomplete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenBuffers(1, &m_instanceVBO);
+    }
+
+    ~CubeShadowMap() {
+        glDeleteBuffers(1, &m_instanceVBO);
+        glDeleteFramebuffers(1, &m_fbo);
+        glDeleteTextures(1, &m_depthCube);
+    }
+
+    int resolution() const { return m_resolution; }
+    std::size_t bytes() const { return (std::size_t)m_resolution * m_resolution * 6 * 4; }
+
+    // `casters` are the model matrices of every shadow-casting body.
+    void render(const Shader& depthShader, Sphere& mesh, const glm::vec3& lightPos, float farPlane,
+                const std::vector<glm::mat4>& casters) {
+        GLint viewport[4], framebuffer;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+        glViewport(0, 0, m_resolution, m_resolution);
+        glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+        glClear(GL_DEPTH_BUFFER_BIT);
+
+        if (!casters.empty()) {
+            glm::mat4 proj = glm::perspective(glm::radians(90.0f), 1.0f, 0.05f, farPlane);
+            const glm::vec3 dirs[6] = { {1,0,0}, {-1,0,0}, {0,1,0}, {0,-1,0}, {0,0,1}, {0,0,-1} };
+            const glm::vec3 ups[6]  = { {0,-1,0}, {0,-1,0}, {0,0,1}, {0,0,-1}, {0,-1,0}, {0,-1,0} };
+
+            depthShader.bind();
+            for (int i = 0; i < 6; ++i)
+                depthShader.setUniformMat4f("shadowMatrices[" + std::to_string(i) + "]",
+                                            proj * glm::lookAt(lightPos, lightPos + dirs[i], ups[i]));
+            depthShader.setUniformVec3f("lightPos", lightPos);
+            depthShader.setUniform1f("farPlane", farPlane);
+
+            glBindBuffer(GL_ARRAY_BUFFER, m_instanceVBO);
+            glBufferData(GL_ARRAY_BUFFER, casters.size() * sizeof(glm::mat4), casters.data(), GL_STREAM_DRAW);
+            mesh.setInstanceBuffer(m_instanceVBO);
+            mesh.DrawInstanced((int)casters.size());
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    void bind(unsigned int unit) const {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, m_depthCube);
+        glActiveTexture(GL_TEXTURE0);
+    }
+};
@@ -2,15 +2,20 @@
 #include <GL/glew.h>
 #include <glm.hpp>
 #include "stb_image.h"
+#include <cstdint>
 #include <vector>
 #include <iostream>
 #include "Shader.h"
+#include "CpuProfiler.h"
 
 class Sphere {
 private:
     unsigned int VAO, VBO, EBO;
     unsigned int textureID;
     int indexCount;
+    unsigned int instanceVBO = 0;
+    unsigned int instanceSphereVBO = 0;
+    std::size_t bufferBytes = 0, textureBytes = 0;
 
     void generateSphere(float radius, unsigned int sectorCount, unsigned int stackCount) {
         std::vector<float> vertices;
@@ -71,6 +76,7 @@ private:
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER,EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size()*sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
+        bufferBytes = vertices.size()*sizeof(float) + indices.size()*sizeof(unsigned int);
 
         glVertexAttribPointer(0,3,GL_FLOAT,GL_FALSE,8*sizeof(float),(void*)0);
         glEnableVertexAttribArray(0);
@@ -84,25 +90,22 @@ private:
 
 public:
     Sphere(float radius=1.0f, unsigned int sectorCount=36, unsigned int stackCount=18, const char* texPath=nullptr) {
+        PROFILE_SCOPE("sphere mesh");
         generateSphere(radius, sectorCount, stackCount);
-        std::cout<<3;
 
         if(texPath){
-            std::cout<<4;
-
             glGenTextures(1, &textureID);
             glBindTexture(GL_TEXTURE_2D, textureID);
-            std::cout<<5;
 
             int width, height, nrChannels;
             stbi_set_flip_vertically_on_load(true);
-            std::cout<<6;
-
-            unsigned char *data = stbi_load(texPath, &width, &height, &nrChannels, 0);
-            std::cout<<7;
+            unsigned char *data;
+            {
+                PROFILE_SCOPE("texture decode");
+                data = stbi_load(texPath, &width, &height, &nrChannels, 0);
+            }
 
             if(data){
-                std::cout<<3;
                 //GLenum format = nrChannels == 3 ? GL_RGB : GL_RGBA;
                 GLenum format;
                 if (nrChannels == 1) format = GL_RED;
@@ -116,6 +119,7 @@ public:
                 }
                 glTexImage2D(GL_TEXTURE_2D,0,format,width,height,0,format,GL_UNSIGNED_BYTE,data);
                 glGenerateMipmap(GL_TEXTURE_2D);
+                textureBytes = (std::size_t)width*height*nrChannels*4/3;   // with mips
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
                 glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
@@ -130,6 +134,67 @@ public:
         }
     }
 
+    // Per-instance model matrices (mat4 at attribute locations 3..6) for
+    // instanced passes; the VAO is set up once per buffer.
+    void setInstanceBuffer(unsigned int buffer){
+        if(instanceVBO == buffer) return;
+        instanceVBO = buffer;
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for(unsigned int i = 0; i < 4; ++i){
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void*)(i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    bool isTextured() const { return textureID != 0; }
+    // GPU memory of the mesh buffers and the texture (per-instance buffers
+    // belong to their owners).
+    std::size_t getBufferBytes() const { return bufferBytes; }
+    std::size_t getTextureBytes() const { return textureBytes; }
+
+    // Per-instance spheres instead: vec4 (center, radius) at location 3 and
+    // vec4 color at location 4, 32 bytes per instance (InstanceField). A
+    // mesh uses either this or setInstanceBuffer, not both.
+    void setInstanceSpheres(unsigned int buffer){
+        if(instanceSphereVBO == buffer) return;
+        instanceSphereVBO = buffer;
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        for(unsigned int i = 0; i < 2; ++i){
+            glEnableVertexAttribArray(3 + i);
+            glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec4), (void*)(i * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + i, 1);
+        }
+        glBindVertexArray(0);
+    }
+
+    // Instanced draw whose DrawElementsIndirectCommand is in the bound
+    // GL_DRAW_INDIRECT_BUFFER at `offset` (GL 4.0).
+    void DrawIndirect(std::size_t offset = 0){
+        glBindVertexArray(VAO);
+        glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const void*)offset);
+        ++drawCalls();
+        glBindVertexArray(0);
+    }
+
+    int getIndexCount() const { return indexCount; }
+
+    // Draw calls issued through every Sphere, for benchmarks; callers reset it.
+    static std::uint64_t& drawCalls(){
+        static std::uint64_t calls = 0;
+        return calls;
+    }
+
+    void DrawInstanced(int count){
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0, count);
+        ++drawCalls();
+        glBindVertexArray(0);
+    }
+
     void Draw(Shader &shader){
         if(textureID){
             glActiveTexture(GL_TEXTURE0);
@@ -139,6 +204,7 @@ public:
         }
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
+        ++drawCalls();
         glBindVertexArray(0);
     }
 };
@@ -0,0 +1,359 @@
+#pragma once
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+#include <gtc/quaternion.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Atmosphere.h"
+#include "Components.h"
+#include "CpuProfiler.h"
+#include "FrustumCulling.h"
+#include "SceneGraph.h"
+#include "Shader.h"
+#include "LightClusters.h"
+#include "OccluderCulling.h"
+#include "OcclusionBuffer.h"
+#include "OcclusionRasterizer.h"
+#include "ShadowMap.h"
+#include "Sphere.h"
+
+// Shader permutation bits shared by HW-model.fs, gbuffer.fs and
+// deferred-lighting.fs; the names are what Shader injects as #defines.
+enum ShaderFeature : std::uint32_t {
+    FEATURE_EMISSIVE     = 1u << 0,
+    FEATURE_TEXTURED     = 1u << 1,
+    FEATURE_SHADOWS      = 1u << 2,
+    FEATURE_SHADOW_MAP   = 1u << 3,
+    FEATURE_NUM_LIGHTS_1 = 1u << 4,   // .. FEATURE_NUM_LIGHTS_1 << 3 for 4 lights
+    FEATURE_ATMOSPHERE   = 1u << 8,
+};
+
+inline std::vector<std::string> shaderFeatureNames() {
+    return { "EMISSIVE", "TEXTURED", "SHADOWS", "SHADOW_MAP", "NUM_LIGHTS 1", "NUM_LIGHTS 2", "NUM_LIGHTS 3", "NUM_LIGHTS 4",
+             "ATMOSPHERE" };
+}
+
+// Up to four lights get a fixed-count variant; more use the cluster lists.
+inline std::uint32_t lightCountFeature(std::size_t lights) {
+    return lights >= 1 && lights <= 4 ? FEATURE_NUM_LIGHTS_1 << (lights - 1) : 0u;
+}
+
+// Plain description of a body; everything main.cpp used to hard-code.
+struct BodyDesc {
+    Entity parent = NULL_ENTITY;
+    glm::dvec3 position = glm::dvec3(0.0);   // used when there is no orbit
+    double orbitRadius = 0.0, orbitSpeed = 0.0, orbitPhase = 0.0;
+    float radius = 1.0f;
+    glm::vec3 color = glm::vec3(1.0f);
+    Sphere* mesh = nullptr;
+    glm::vec3 spinAxis = glm::vec3(0.0f, 1.0f, 0.0f);
+    float spinSpeed = 0.0f;
+    bool emissive = false;
+    Emissive light{};
+    bool castsShadow = false;
+    bool atmosphere = false;
+};
+
+inline Entity createBody(Registry& reg, SceneGraph& graph, const BodyDesc& d) {
+    Entity e = reg.create();
+    SceneGraph::NodeId parentNode = d.parent == NULL_ENTITY ? SceneGraph::NONE : reg.get<Transform>(d.parent).node;
+    SceneGraph::NodeId node = graph.createNode(parentNode);
+    SceneGraph::NodeId body = graph.createNode(node);
+    graph.setTranslation(node, d.position);
+    graph.setScale(body, glm::vec3(d.radius));
+    reg.add(e, Transform{ node, body, d.position, glm::vec3(0.0f) });
+
+    if (d.orbitRadius > 0.0)
+        reg.add(e, OrbitalElements{ d.orbitRadius, d.orbitPhase, d.orbitSpeed, d.orbitSpeed, node });
+    if (d.spinSpeed != 0.0f)
+        reg.add(e, Spin{ glm::normalize(d.spinAxis), d.spinSpeed, body });
+    if (d.mesh)
+        reg.add(e, RenderSphere{ d.mesh, d.radius, d.color });
+    if (d.emissive)
+        reg.add(e, d.light);
+    if (d.castsShadow)
+        reg.add(e, ShadowCaster{ d.radius });
+    if (d.atmosphere)
+        reg.add(e, Atmosphere{ d.radius });
+    return e;
+}
+
+inline void orbitSystem(Registry& reg, SceneGraph& graph, double dt) {
+    PROFILE_SCOPE("orbits");
+    ComponentPool<OrbitalElements>& orbits = reg.pool<OrbitalElements>();
+    OrbitalElements* o = orbits.data();
+    for (std::size_t i = 0; i < orbits.size(); ++i) {
+        o[i].angle += o[i].speed * dt;
+        graph.setTranslation(o[i].node,
+                             glm::dvec3(o[i].radius * std::cos(o[i].angle), 0.0, o[i].radius * std::sin(o[i].angle)));
+    }
+}
+
+inline void spinSystem(Registry& reg, SceneGraph& graph, float time) {
+    PROFILE_SCOPE("spins");
+    ComponentPool<Spin>& spins = reg.pool<Spin>();
+    const Spin* s = spins.data();
+    for (std::size_t i = 0; i < spins.size(); ++i)
+        graph.setRotation(s[i].body, glm::angleAxis(time * s[i].speed, s[i].axis));
+}
+
+// Copies graph results back after SceneGraph::update.
+inline void transformSystem(Registry& reg, const SceneGraph& graph) {
+    PROFILE_SCOPE("transforms");
+    ComponentPool<Transform>& transforms = reg.pool<Transform>();
+    Transform* t = transforms.data();
+    for (std::size_t i = 0; i < transforms.size(); ++i) {
+        t[i].position = graph.worldPosition(t[i].node);
+        t[i].renderPos = graph.renderPosition(t[i].node);
+    }
+}
+
+// Every emissive body is a point light, binned into the view clusters. The
+// first one stays light 0, the sun that casts the eclipse shadows; its
+// position is returned.
+inline glm::vec3 lightSystem(Registry& reg, LightClusters& clusters, const glm::mat4& view) {
+    PROFILE_SCOPE("lights");
+    ComponentPool<Emissive>& pool = reg.pool<Emissive>();
+    std::vector<ClusterLight> lights(pool.size());
+    for (std::size_t i = 0; i < pool.size(); ++i) {
+        const Emissive& l = pool.data()[i];
+        lights[i] = { reg.get<Transform>(pool.entities()[i]).renderPos,
+                      lightRange(l.constant, l.linear, l.quadratic, l.ambient + l.diffuse + l.specular),
+                      l.ambient, l.diffuse, l.specular, l.constant, l.linear, l.quadratic };
+    }
+    clusters.build(lights.data(), lights.size(), view);
+    clusters.upload();
+    return lights.empty() ? glm::vec3(0.0f) : lights[0].position;
+}
+
+// Builds the per-receiver occluder lists for the analytic shadow path. Lists
+// are indexed like the RenderSphere pool, which renderSystem walks.
+inline void occluderSystem(Registry& reg, OccluderLists& lists) {
+    PROFILE_SCOPE("occluder lists");
+    ComponentPool<RenderSphere>& spheres = reg.pool<RenderSphere>();
+    ComponentPool<ShadowCaster>& casters = reg.pool<ShadowCaster>();
+    ComponentPool<Emissive>& lights = reg.pool<Emissive>();
+
+    lists.clearCasters();
+    std::vector<glm::vec3> receivers(spheres.size());
+    std::vector<float> radii(spheres.size());
+    for (std::size_t i = 0; i < spheres.size(); ++i) {
+        receivers[i] = reg.get<Transform>(spheres.entities()[i]).renderPos;
+        radii[i] = spheres.data()[i].radius;
+    }
+    if (lights.size() > 0) {
+        for (std::size_t i = 0; i < casters.size(); ++i) {
+            Entity e = casters.entities()[i];
+            lists.addCaster(reg.get<Transform>(e).renderPos, casters.data()[i].radius, spheres.indexOf(e));
+        }
+    }
+    glm::vec3 light = lights.size() > 0 ? reg.get<Transform>(lights.entities()[0]).renderPos : glm::vec3(0.0f);
+    lists.build(light, receivers.data(), radii.data(), receivers.size());
+    lists.upload();
+}
+
+// Renders every ShadowCaster into the cube map around the first emissive
+// body. Returns the far plane used, which the lighting shader needs to
+// rescale stored depths (0 when there is no light).
+inline float shadowMapSystem(Registry& reg, const SceneGraph& graph, CubeShadowMap& shadowMap,
+                             const Shader& depthShader, Sphere& casterMesh) {
+    PROFILE_SCOPE("shadow map");
+    ComponentPool<Emissive>& lights = reg.pool<Emissive>();
+    if (lights.size() == 0) return 0.0f;
+    glm::vec3 lightPos = reg.get<Transform>(lights.entities()[0]).renderPos;
+
+    std::vector<glm::mat4> casters;
+    ComponentPool<ShadowCaster>& pool = reg.pool<ShadowCaster>();
+    for (std::size_t i = 0; i < pool.size(); ++i)
+        casters.push_back(graph.renderMatrix(reg.get<Transform>(pool.entities()[i]).body));
+    // The depth range covers every receiver, not just the casters: a body
+    // beyond the farthest caster still has to compare against the map.
+    float farPlane = 1.0f;
+    ComponentPool<RenderSphere>& spheres = reg.pool<RenderSphere>();
+    for (std::size_t i = 0; i < spheres.size(); ++i)
+        farPlane = std::max(farPlane, glm::length(reg.get<Transform>(spheres.entities()[i]).renderPos - lightPos)
+                                          + spheres.data()[i].radius);
+    shadowMap.render(depthShader, casterMesh, lightPos, farPlane, casters);
+    return farPlane;
+}
+
+// RenderSphere pool indices of the spheres inside the view frustum
+// (bounding sphere = render position and radius), in pool order.
+inline void visibilitySystem(Registry& reg, FrustumCuller& culler, const glm::mat4& viewProjection,
+                             std::vector<std::uint32_t>& visible) {
+    PROFILE_SCOPE("frustum cull");
+    ComponentPool<RenderSphere>& spheres = reg.pool<RenderSphere>();
+    culler.setPlanes(viewProjection);
+    culler.clear();
+    culler.reserve(spheres.size());
+    for (std::size_t i = 0; i < spheres.size(); ++i)
+        culler.add(reg.get<Transform>(spheres.entities()[i]).renderPos, spheres.data()[i].radius, (std::uint32_t)i);
+    culler.cull(visible);
+}
+
+// Removes from `visible` the spheres hidden behind the largest visible ones
+// (by angular size, at most `maxOccluders` of them): those are drawn into
+// `buffer`, every other sphere is tested against its Hi-Z. With a
+// rasterizer the occluders are their drawn meshes' proxies, otherwise exact
+// spheres. Returns how many were removed.
+inline std::size_t occlusionSystem(Registry& reg, const SceneGraph& graph, OcclusionBuffer& buffer,
+                                   OcclusionRasterizer* rasterizer, const glm::mat4& view, const glm::mat4& projection,
+                                   float zNear, std::vector<std::uint32_t>& visible, std::size_t maxOccluders = 8) {
+    PROFILE_SCOPE("occlusion cull");
+    ComponentPool<RenderSphere>& spheres = reg.pool<RenderSphere>();
+    std::vector<glm::vec3> centers(visible.size());
+    std::vector<std::pair<float, std::size_t>> bySize(visible.size());
+    for (std::size_t k = 0; k < visible.size(); ++k) {
+        centers[k] = glm::vec3(view * glm::vec4(reg.get<Transform>(spheres.entities()[visible[k]]).renderPos, 1.0f));
+        bySize[k] = { -spheres.data()[visible[k]].radius / std::max(glm::length(centers[k]), 1e-6f), k };
+    }
+    std::size_t occluders = std::min(maxOccluders, bySize.size());
+    std::partial_sort(bySize.begin(), bySize.begin() + occluders, bySize.end());
+
+    buffer.begin(projection, zNear);
+    if (rasterizer) rasterizer->begin(buffer.width(), buffer.height());
+    std::vector<bool> isOccluder(visible.size(), false);
+    for (std::size_t k = 0; k < occluders; ++k) {
+        std::size_t i = bySize[k].second;
+        isOccluder[i] = true;
+        if (rasterizer)
+            rasterizer->addSphere(projection * view * graph.renderMatrix(reg.get<Transform>(spheres.entities()[visible[i]]).body));
+        else
+            buffer.addOccluder(centers[i], spheres.data()[visible[i]].radius);
+    }
+    if (rasterizer) rasterizer->render(buffer);
+    if (buffer.occluderCount() == 0) return 0;
+    buffer.buildHiZ();
+
+    std::size_t kept = 0;
+    for (std::size_t k = 0; k < visible.size(); ++k)
+        if (isOccluder[k] || buffer.visible(centers[k], spheres.data()[visible[k]].radius))
+            visible[kept++] = visible[k];
+    std::size_t removed = visible.size() - kept;
+    visible.resize(kept);
+    return removed;
+}
+
+// Front-to-back order of the visible spheres by the distance from the
+// camera (the render-space origin) to each sphere's near surface, so early-Z
+// rejects as much as possible.
+inline void drawOrderSystem(Registry& reg, const std::vector<std::uint32_t>& visible, std::vector<std::uint32_t>& order) {
+    PROFILE_SCOPE("draw order");
+    ComponentPool<RenderSphere>& spheres = reg.pool<RenderSphere>();
+    std::vector<std::pair<float, std::uint32_t>> keyed(visible.size());
+    for (std::size_t k = 0; k < visible.size(); ++k) {
+        std::uint32_t i = visible[k];
+        glm::vec3 p = reg.get<Transform>(spheres.entities()[i]).renderPos;
+        keyed[k] = { glm::length(p) - spheres.data()[i].radius, i };
+    }
+    std::sort(keyed.begin(), keyed.end());
+    order.resize(keyed.size());
+    for (std::size_t i = 0; i < keyed.size(); ++i) order[i] = keyed[i].second;
+}
+
+// Depth-only pass with depth-only.fs; the shading pass then runs with
+// GL_EQUAL and pays for each covered pixel once.
+inline void depthPrepassSystem(Registry& reg, const SceneGraph& graph, Shader& depthShader,
+                               const std::vector<std::uint32_t>& order) {
+    PROFILE_SCOPE("depth prepass");
+    ComponentPool<RenderSphere>& spheres = reg.pool<RenderSphere>();
+    for (std::uint32_t i : order) {
+        depthShader.setUniformMat4f("model", graph.renderMatrix(reg.get<Transform>(spheres.entities()[i]).body));
+        spheres.data()[i].mesh->Draw(depthShader);
+    }
+}
+
+// Draws are grouped by shader variant (`frameFeatures` plus EMISSIVE and
+// TEXTURED per body), keeping `order` within each group. ATMOSPHERE in
+// `frameFeatures` only reaches lit bodies with an Atmosphere. Uniforms are per
+// program, so `setFrameUniforms` runs after each variant is selected.
+inline void renderSystem(Registry& reg, const SceneGraph& graph, Shader& shader, const OccluderLists& occluders,
+                         const std::vector<std::uint32_t>& order, std::uint32_t frameFeatures,
+                         const std::function<void(Shader&)>& setFrameUniforms) {
+    PROFILE_SCOPE("draw submit");
+    ComponentPool<RenderSphere>& spheres = reg.pool<RenderSphere>();
+    const RenderSphere* r = spheres.data();
+    const std::vector<Entity>& ents = spheres.entities();
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> draws;
+    draws.reserve(order.size());
+    for (std::uint32_t i : order) {
+        std::uint32_t key = frameFeatures & ~FEATURE_ATMOSPHERE;
+        if (reg.has<Emissive>(ents[i])) key |= FEATURE_EMISSIVE;
+        else if ((frameFeatures & FEATURE_ATMOSPHERE) && reg.has<Atmosphere>(ents[i])) key |= FEATURE_ATMOSPHERE;
+        if (r[i].mesh->isTextured()) key |= FEATURE_TEXTURED;
+        draws.emplace_back(key, i);
+    }
+    std::stable_sort(draws.begin(), draws.end(),
+                     [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    for (std::size_t d = 0; d < draws.size(); ++d) {
+        std::uint32_t key = draws[d].first, i = draws[d].second;
+        if (d == 0 || key != draws[d - 1].first) {
+            shader.select(key);
+            setFrameUniforms(shader);
+        }
+        Entity e = ents[i];
+        SceneGraph::NodeId body = reg.get<Transform>(e).body;
+        shader.setUniformMat4f("model", graph.renderMatrix(body));
+        shader.setUniformMat3f("normalMatrix", graph.normalMatrix(body));
+        if (key & FEATURE_EMISSIVE) {
+            shader.setUniformVec3f("emissiveColor", reg.get<Emissive>(e).color);
+        } else {
+            shader.setUniformVec3f("objectColor", r[i].color);
+            if (i < occluders.receiverCount()) {
+                shader.setUniform1i("occluderOffset", occluders.offset(i));
+                shader.setUniform1i("occluderCount", occluders.count(i));
+            }
+            if (key & FEATURE_ATMOSPHERE)
+                shader.setUniformVec3f("planetCenter", reg.get<Transform>(e).renderPos);
+        }
+        r[i].mesh->Draw(shader);
+    }
+}
+
+// Atmosphere shells (atmosphere.fs) after the opaque pass, far to near. Each
+// shell shades the whole view ray through its atmosphere, so it is drawn
+// from outside (front faces) and only from inside (back faces) when the
+// camera is within it. Expects the tables bound and the frame uniforms set.
+inline void atmosphereSystem(Registry& reg, Shader& shader, Sphere& shellMesh, float top,
+                             const glm::vec3& sunPos, const glm::vec3& sunIntensity) {
+    PROFILE_SCOPE("atmosphere");
+    ComponentPool<Atmosphere>& pool = reg.pool<Atmosphere>();
+    if (pool.size() == 0) return;
+    // shellMesh is inscribed in its unit sphere; this keeps it outside the
+    // analytic shell the fragment shader intersects.
+    const float coverage = 1.01f;
+
+    std::vector<std::pair<float, std::uint32_t>> keyed(pool.size());
+    for (std::size_t i = 0; i < pool.size(); ++i)
+        keyed[i] = { -glm::length(reg.get<Transform>(pool.entities()[i]).renderPos), (std::uint32_t)i };
+    std::sort(keyed.begin(), keyed.end());
+
+    shader.setUniformVec3f("sunPos", sunPos);
+    shader.setUniformVec3f("sunIntensity", sunIntensity);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_SRC_ALPHA);
+    glDepthMask(GL_FALSE);
+    glEnable(GL_CULL_FACE);
+    for (const auto& k : keyed) {
+        float radius = pool.data()[k.second].radius;
+        float shell = radius * top * coverage;
+        glm::vec3 center = reg.get<Transform>(pool.entities()[k.second]).renderPos;
+        glCullFace(-k.first < shell ? GL_FRONT : GL_BACK);
+        glm::mat4 model = glm::scale(glm::translate(glm::mat4(1.0f), center), glm::vec3(shell));
+        shader.setUniformMat4f("model", model);
+        shader.setUniformVec3f("planetCenter", center);
+        shader.setUniform1f("planetRadius", radius);
+        shellMesh.Draw(shader);
+    }
+    glDisable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_BLEND);
+}
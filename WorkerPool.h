@@ -0,0 +1,129 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "CpuProfiler.h"
+
+// Persistent worker threads shared by the per-frame parallel loops
+// (OcclusionRasterizer, LightClusters) and the atmosphere table build, so
+// none of them spawns and joins threads per call.
+//
+//   WorkerPool::shared().run(jobs, [&](unsigned job) { ... });
+//
+// run() hands out job indices [0, jobs) to the workers and the calling
+// thread alike and returns once every job has finished; callers split their
+// work by job index as they used to split it by thread. One run() at a time:
+// concurrent callers queue on a mutex. The threads start with the first run()
+// that has more than one job and sleep on a condition variable in between.
+class WorkerPool {
+private:
+    std::mutex m_runMutex;   // one run() at a time
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake, m_done;
+    std::vector<std::thread> m_threads;
+    unsigned m_size;
+    std::uint64_t m_generation = 0;
+    bool m_stop = false;
+
+    // The current run, under m_mutex; m_jobs is 0 between runs.
+    using Call = void (*)(void*, unsigned);
+    Call m_call = nullptr;
+    void* m_context = nullptr;
+    unsigned m_jobs = 0;
+    unsigned m_busy = 0;   // workers inside the current run
+    std::atomic<unsigned> m_next{0};
+
+    void drainJobs(Call call, void* context, unsigned jobs) {
+        for (unsigned job; (job = m_next.fetch_add(1, std::memory_order_relaxed)) < jobs;)
+            call(context, job);
+    }
+
+    void workerLoop(unsigned index) {
+        char name[32];
+        std::snprintf(name, sizeof(name), "worker %u", index);
+        CpuProfiler::setThreadName(name);
+        std::uint64_t seen = 0;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_wake.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) return;
+            seen = m_generation;
+            // Woke after the run it was meant for had finished.
+            if (m_jobs == 0) continue;
+            Call call = m_call;
+            void* context = m_context;
+            unsigned jobs = m_jobs;
+            ++m_busy;
+            lock.unlock();
+            drainJobs(call, context, jobs);
+            lock.lock();
+            if (--m_busy == 0) m_done.notify_one();
+        }
+    }
+
+    void start() {
+        for (unsigned i = 1; i < m_size; ++i) m_threads.emplace_back([this, i] { workerLoop(i); });
+    }
+
+public:
+    // `threads` counts the calling thread; 0 means one per hardware thread.
+    explicit WorkerPool(unsigned threads = 0)
+        : m_size(threads ? threads : std::max(1u, std::thread::hardware_concurrency())) {}
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (std::thread& t : m_threads) t.join();
+    }
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    static WorkerPool& shared() {
+        static WorkerPool pool;
+        return pool;
+    }
+
+    // Threads working on a run, the caller included.
+    unsigned size() const { return m_size; }
+
+    // Calls fn(job) for every job in [0, jobs), spread over the pool.
+    template <typename Fn>
+    void run(unsigned jobs, Fn&& fn) {
+        if (jobs <= 1 || m_size == 1) {
+            for (unsigned job = 0; job < jobs; ++job) fn(job);
+            return;
+        }
+        std::lock_guard<std::mutex> runLock(m_runMutex);
+        using F = std::remove_reference_t<Fn>;
+        Call call = [](void* context, unsigned job) { (*static_cast<F*>(context))(job); };
+        void* context = const_cast<void*>(static_cast<const void*>(&fn));
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_threads.empty()) start();
+            m_call = call;
+            m_context = context;
+            m_jobs = jobs;
+            m_next.store(0, std::memory_order_relaxed);
+            ++m_generation;
+        }
+        m_wake.notify_all();
+        drainJobs(call, context, jobs);
+        // Every job has been taken; wait for the workers still running one.
+        // Clearing m_jobs in the same critical section keeps workers that
+        // wake from now on out of this run.
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [&] { return m_busy == 0; });
+        m_jobs = 0;
+    }
+};
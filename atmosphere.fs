@@ -0,0 +1,45 @@
+#shader vertex
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+out vec3 FragPos;
+out float ViewDepth;
+
+#include "glsl/transform.glsl"
+
+void main()
+{
+    gl_Position = transformVertex(aPos, FragPos, ViewDepth);
+}
+
+#shader fragment
+#version 330 core
+
+// Shell around a planet with an atmosphere, drawn after the opaque pass with
+// glBlendFunc(GL_ONE, GL_SRC_ALPHA): whatever is behind is dimmed by the view
+// ray's transmittance and the precomputed inscatter is added on top.
+
+out vec4 FragColor;
+
+in vec3 FragPos;
+in float ViewDepth;
+
+#include "glsl/atmosphere.glsl"
+
+// Camera-relative, so the camera is at the origin.
+uniform vec3 planetCenter;
+uniform float planetRadius;
+uniform vec3 sunPos;
+// Sun color times exposure.
+uniform vec3 sunIntensity;
+
+void main()
+{
+    vec3 v = normalize(FragPos);
+    vec3 x = -planetCenter / planetRadius;
+    vec3 s = normalize(sunPos - planetCenter);
+    vec3 transmit;
+    vec3 inscatter = atmosphereScattering(x, v, s, transmit);
+    FragColor = vec4(1.0 - exp(-sunIntensity * inscatter), dot(transmit, vec3(1.0 / 3.0)));
+}
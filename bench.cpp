@@ -0,0 +1,477 @@
+// solar_bench: frame-time benchmark over generated scenes, and a compare
+// mode that checks a run against a stored baseline.
+//
+//   solar_bench [scene options] [--out bench.json]
+//   solar_bench --compare baseline.json result.json [--threshold 10]
+//
+// Scene options: --bodies N, --lights N, --tess SECTORS, --shadows
+// none|analytic|map, --resolution WxH, --frames N, --warmup N, --seed N,
+// --name NAME. Without any, the built-in suite runs. Each scene is generated
+// from its seed, simulated at a fixed 60 Hz step and seen from a scripted
+// camera, so two runs on the same machine render the same frames.
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm.hpp>
+#include <gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HeadlessContext.h"
+#include "RenderTarget.h"
+#include "SceneLoader.h"
+#include "Systems.h"
+
+// Every allocation in the process is counted, so a frame's share is the
+// difference across it. The deletes stay out of line so GCC does not take
+// the free() in them for a mismatch with operator new.
+static std::atomic<std::uint64_t> allocationCount{0}, allocationBytes{0};
+#if defined(__GNUC__)
+#define BENCH_NOINLINE __attribute__((noinline))
+#else
+#define BENCH_NOINLINE
+#endif
+
+void* operator new(std::size_t size) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(std::size_t size, std::align_val_t align) {
+    allocationCount.fetch_add(1, std::memory_order_relaxed);
+    allocationBytes.fetch_add(size, std::memory_order_relaxed);
+    std::size_t a = (std::size_t)align;
+#ifdef _WIN32
+    if (void* p = _aligned_malloc(size ? size : 1, a)) return p;
+#else
+    // aligned_alloc wants a multiple of the alignment.
+    if (void* p = std::aligned_alloc(a, ((size ? size : 1) + a - 1) / a * a)) return p;
+#endif
+    throw std::bad_alloc();
+}
+BENCH_NOINLINE void operator delete(void* p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+#ifdef _WIN32
+BENCH_NOINLINE void operator delete(void* p, std::align_val_t) noexcept { _aligned_free(p); }
+BENCH_NOINLINE void operator delete(void* p, std::size_t, std::align_val_t) noexcept { _aligned_free(p); }
+#else
+BENCH_NOINLINE void operator delete(void* p, std::align_val_t) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void* p, std::size_t, std::align_val_t) noexcept { std::free(p); }
+#endif
+
+struct BenchScene {
+    std::string name = "custom";
+    int bodies = 256;
+    int lights = 1;
+    int tessellation = 36;        // sectors; stacks are half
+    int shadows = 2;              // 0 none, 1 analytic occluders, 2 cube shadow map
+    int width = 1280, height = 720;
+    int frames = 300;
+    int warmup = 30;              // rendered but not measured
+    std::uint32_t seed = 1;
+};
+
+struct BenchResult {
+    std::vector<double> cpuMs, gpuMs;
+    double drawCalls = 0.0, triangles = 0.0, allocations = 0.0, allocatedBytes = 0.0;
+};
+
+static const char* shadowName(int mode) {
+    return mode == 0 ? "none" : mode == 1 ? "analytic" : "map";
+}
+
+// A sun at the origin, lights - 1 small lamps and `bodies` planets and moons
+// on orbits around it, all drawn from `seed`. Written as scene JSON so the
+// bench goes through the same loader as the viewer.
+static std::string generateScene(const BenchScene& s) {
+    std::mt19937 rng(s.seed);
+    std::uniform_real_distribution<double> u(0.0, 1.0);
+    const double TWO_PI = 6.28318530717958647692;
+    std::ostringstream json;
+    json << "{\"materials\":{"
+         << "\"sun\":{\"color\":[1,1,1],\"emissive\":[1.0,0.6,0.2]},"
+         << "\"lamp\":{\"color\":[1,1,1],\"emissive\":[0.6,0.8,1.0]},"
+         << "\"rock0\":{\"color\":[0.7,0.7,0.7]},\"rock1\":{\"color\":[0.8,0.5,0.3]},"
+         << "\"rock2\":{\"color\":[0.3,0.5,0.8]},\"rock3\":{\"color\":[0.6,0.7,0.4]}},\"bodies\":[";
+    json << "{\"name\":\"sun\",\"material\":\"sun\",\"radius\":1.0,"
+         << "\"light\":{\"diffuse\":[1.0,0.9,0.7],\"specular\":[1.0,0.9,0.7],\"attenuation\":[1.0,0.005,0.0002]}}";
+    for (int i = 1; i < s.lights; ++i) {
+        double r = 4.0 + 20.0 * u(rng);
+        json << ",{\"name\":\"lamp" << i << "\",\"parent\":\"sun\",\"material\":\"lamp\",\"radius\":0.2,"
+             << "\"orbit\":{\"radius\":" << r << ",\"speed\":" << 0.4 / std::sqrt(r) << ",\"phase\":" << TWO_PI * u(rng) << "},"
+             << "\"light\":{\"ambient\":[0,0,0],\"diffuse\":[0.6,0.8,1.0],\"specular\":[0.6,0.8,1.0],\"attenuation\":[1.0,0.35,0.44]}}";
+    }
+    // About a quarter of the bodies are moons of an earlier planet.
+    std::vector<std::pair<int, double>> planets;   // index, radius
+    for (int i = 0; i < s.bodies; ++i) {
+        bool moon = !planets.empty() && u(rng) < 0.25;
+        double radius, orbit, speed;
+        std::string parent = "sun";
+        if (moon) {
+            const auto& p = planets[(std::size_t)(u(rng) * planets.size()) % planets.size()];
+            parent = "body" + std::to_string(p.first);
+            radius = p.second * (0.15 + 0.25 * u(rng));
+            orbit = p.second * (1.6 + 2.0 * u(rng));
+            speed = 1.0 + u(rng);
+        } else {
+            radius = 0.1 + 0.3 * u(rng) * u(rng);
+            orbit = 3.0 + 27.0 * u(rng);
+            speed = 0.3 / std::sqrt(orbit);
+            planets.emplace_back(i, radius);
+        }
+        json << ",{\"name\":\"body" << i << "\",\"parent\":\"" << parent << "\",\"material\":\"rock" << i % 4 << "\","
+             << "\"radius\":" << radius << ",\"orbit\":{\"radius\":" << orbit << ",\"speed\":" << speed
+             << ",\"phase\":" << TWO_PI * u(rng) << "},\"spin\":{\"axis\":[" << u(rng) - 0.5 << ",1," << u(rng) - 0.5
+             << "],\"speed\":" << 0.2 + u(rng) << "},\"shadow\":true}";
+    }
+    json << "]}";
+    return json.str();
+}
+
+static BenchResult runScene(const BenchScene& s) {
+    BenchResult result;
+    SceneData sceneData;
+    std::string error, json = generateScene(s);
+    if (!parseSceneJson(json.data(), json.data() + json.size(), sceneData, error)) {
+        std::cerr << s.name << ": generated scene does not parse: " << error << std::endl;
+        return result;
+    }
+
+    Registry reg;
+    SceneGraph graph;
+    Sphere mesh(1.0f, s.tessellation, std::max(s.tessellation / 2, 2));
+    Sphere casterMesh(1.0f, 24, 12);
+    std::vector<Sphere*> meshes(sceneData.materials.size(), &mesh);
+    instantiateScene(sceneData, reg, graph, meshes);
+
+    Shader lightingShader("../HW-model.fs", shaderFeatureNames(), LightClusters::shaderConstants());
+    Shader depthShader("../shadow-depth.fs");
+    std::uint32_t lightFeature = lightCountFeature(reg.pool<Emissive>().size());
+    std::uint32_t shadowFeatures = s.shadows == 0 ? 0u : s.shadows == 1 ? (std::uint32_t)FEATURE_SHADOWS
+                                                                        : (std::uint32_t)(FEATURE_SHADOWS | FEATURE_SHADOW_MAP);
+    std::vector<std::uint32_t> variants = { lightFeature | shadowFeatures, lightFeature | shadowFeatures | FEATURE_EMISSIVE };
+    lightingShader.precompile(variants);
+    depthShader.precompile({ 0u });
+    for (std::uint32_t v : variants) lightingShader.select(v);
+    depthShader.select(0);
+
+    RenderTarget target(s.width, s.height);
+    CubeShadowMap shadowMap(32u << 20);
+    OccluderLists occluderLists;
+    LightClusters lightClusters;
+    FrustumCuller frustumCuller;
+    OcclusionBuffer occlusionBuffer(256, 128);
+    OcclusionRasterizer occlusionRasterizer;
+    std::vector<std::uint32_t> visible, drawOrder;
+    unsigned int queries[3];
+    glGenQueries(3, queries);   // frame start, frame end timestamps; primitives
+    glEnable(GL_DEPTH_TEST);
+    glDisable(GL_CULL_FACE);
+
+    const float zNear = 0.1f, zFar = 200.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)s.width / s.height, zNear, zFar);
+    lightClusters.setProjection(projection, zNear, zFar);
+    const double dt = 1.0 / 60.0;
+    int total = s.warmup + s.frames;
+    for (int frame = 0; frame < total; ++frame) {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::uint64_t allocs = allocationCount.load(), bytes = allocationBytes.load();
+        Sphere::drawCalls() = 0;
+        target.bind();
+        glQueryCounter(queries[0], GL_TIMESTAMP);
+        glBeginQuery(GL_PRIMITIVES_GENERATED, queries[2]);
+
+        // One slow turn around the system, from above the orbital plane.
+        double angle = 1.5 * (double)frame / total;
+        glm::dvec3 camPos(40.0 * std::cos(angle), 12.0, 40.0 * std::sin(angle));
+        glm::vec3 camFront = glm::normalize(glm::vec3(-camPos));
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), camFront, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        orbitSystem(reg, graph, dt);
+        spinSystem(reg, graph, (float)(frame * dt));
+        graph.update(camPos);
+        transformSystem(reg, graph);
+
+        float shadowFar = 0.0f;
+        if (s.shadows == 2) shadowFar = shadowMapSystem(reg, graph, shadowMap, depthShader, casterMesh);
+        if (s.shadows == 1) occluderSystem(reg, occluderLists);
+        visibilitySystem(reg, frustumCuller, projection * view, visible);
+        occlusionSystem(reg, graph, occlusionBuffer, &occlusionRasterizer, view, projection, zNear, visible);
+        drawOrderSystem(reg, visible, drawOrder);
+        glm::vec3 sunPos = lightSystem(reg, lightClusters, view);
+        lightClusters.bind(3);
+        occluderLists.bind(2);
+        shadowMap.bind(1);
+        renderSystem(reg, graph, lightingShader, occluderLists, drawOrder, lightFeature | shadowFeatures, [&](Shader& shader) {
+            shader.setUniformMat4f("projection", projection);
+            shader.setUniformMat4f("view", view);
+            shader.setUniformVec3f("viewPos", glm::vec3(0.0f));
+            shader.setUniformVec3f("sunPos", sunPos);
+            shader.setUniform1i("clusterLights", 3);
+            shader.setUniform1i("clusterGrid", 4);
+            shader.setUniform1i("clusterIndices", 5);
+            shader.setUniformVec2f("clusterScreen", glm::vec2(s.width, s.height));
+            shader.setUniformVec2f("clusterDepth", glm::vec2(lightClusters.depthScale(), lightClusters.depthBias()));
+            shader.setUniform1f("material.shininess", 50.0f);
+            shader.setUniform1i("occluderList", 2);
+            shader.setUniform1i("shadowMap", 1);
+            shader.setUniform1f("shadowFar", shadowFar);
+        });
+
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        glQueryCounter(queries[1], GL_TIMESTAMP);
+        // CPU time is the simulation and submission only; the wait for the
+        // GPU is what gpu_ms measures.
+        double cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        glFinish();
+        if (frame < s.warmup) continue;
+        GLuint64 stamps[2] = {}, primitives = 0;
+        glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &stamps[0]);
+        glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &stamps[1]);
+        glGetQueryObjectui64v(queries[2], GL_QUERY_RESULT, &primitives);
+        result.cpuMs.push_back(cpuMs);
+        result.gpuMs.push_back((stamps[1] - stamps[0]) * 1e-6);
+        result.drawCalls += (double)Sphere::drawCalls() / s.frames;
+        result.triangles += (double)primitives / s.frames;
+        result.allocations += (double)(allocationCount.load() - allocs) / s.frames;
+        result.allocatedBytes += (double)(allocationBytes.load() - bytes) / s.frames;
+    }
+    glDeleteQueries(3, queries);
+    return result;
+}
+
+static void writeTimes(std::ostream& out, const char* key, std::vector<double> t) {
+    double sum = 0.0;
+    for (double v : t) sum += v;
+    std::sort(t.begin(), t.end());
+    auto pct = [&](double p) { return t.empty() ? 0.0 : t[std::min((std::size_t)(p * t.size()), t.size() - 1)]; };
+    out << "\"" << key << "\": { \"mean\": " << (t.empty() ? 0.0 : sum / t.size()) << ", \"p50\": " << pct(0.5)
+        << ", \"p95\": " << pct(0.95) << ", \"p99\": " << pct(0.99) << ", \"max\": " << (t.empty() ? 0.0 : t.back()) << " }";
+}
+
+static void writeScene(std::ostream& out, const BenchScene& s, const BenchResult& r) {
+    out << "    { \"name\": \"" << s.name << "\", \"bodies\": " << s.bodies << ", \"lights\": " << s.lights
+        << ", \"tessellation\": " << s.tessellation << ", \"shadows\": \"" << shadowName(s.shadows) << "\""
+        << ", \"width\": " << s.width << ", \"height\": " << s.height << ", \"frames\": " << s.frames
+        << ", \"seed\": " << s.seed << ",\n      ";
+    writeTimes(out, "cpu_ms", r.cpuMs);
+    out << ",\n      ";
+    writeTimes(out, "gpu_ms", r.gpuMs);
+    out << ",\n      \"draw_calls\": " << r.drawCalls << ", \"triangles\": " << r.triangles
+        << ", \"allocations\": " << r.allocations << ", \"allocated_bytes\": " << r.allocatedBytes << " }";
+}
+
+// --- compare -------------------------------------------------------------
+
+// The metrics of one scene in a result file, flattened to "cpu_ms.p95" etc.
+struct SceneMetrics {
+    std::string name;
+    std::vector<std::pair<std::string, double>> values;
+    const double* find(const std::string& key) const {
+        for (const auto& v : values)
+            if (v.first == key) return &v.second;
+        return nullptr;
+    }
+};
+
+static bool readResults(const std::string& path, std::vector<SceneMetrics>& scenes, std::string& error) {
+    MappedFile file;
+    if (!file.open(path)) { error = "failed to open " + path; return false; }
+    JsonReader r(file.data(), file.data() + file.size());
+    std::string_view k;
+    r.expect('{');
+    while (r.member(k)) {
+        if (k != "scenes") { r.skip(); continue; }
+        r.expect('[');
+        while (r.element()) {
+            SceneMetrics scene;
+            r.expect('{');
+            while (r.member(k)) {
+                std::string key(k);
+                if (key == "name") scene.name = std::string(r.string());
+                else if (r.peek('{')) {
+                    std::string_view sub;
+                    r.expect('{');
+                    while (r.member(sub)) {
+                        std::string subKey = key + "." + std::string(sub);
+                        scene.values.emplace_back(subKey, r.number());
+                    }
+                }
+                else if (r.peek('"')) r.skip();
+                else scene.values.emplace_back(key, r.number());
+            }
+            scenes.push_back(std::move(scene));
+        }
+    }
+    if (!r.ok()) { error = path + ": " + r.error(); return false; }
+    return true;
+}
+
+// Flags every timing percentile and per-frame count that got worse by more
+// than `threshold` percent. Timings below a small floor are ignored, where
+// scheduler noise is bigger than any real change.
+static int compareResults(const std::string& baselinePath, const std::string& currentPath, double threshold) {
+    std::vector<SceneMetrics> baseline, current;
+    std::string error;
+    if (!readResults(baselinePath, baseline, error) || !readResults(currentPath, current, error)) {
+        std::cerr << "compare: " << error << std::endl;
+        return 2;
+    }
+    const char* metrics[] = { "cpu_ms.p50", "cpu_ms.p95", "cpu_ms.p99", "gpu_ms.p50", "gpu_ms.p95", "gpu_ms.p99",
+                              "draw_calls", "triangles", "allocations" };
+    const double timeFloor = 0.05;
+    int regressions = 0;
+    for (const SceneMetrics& cur : current) {
+        const SceneMetrics* base = nullptr;
+        for (const SceneMetrics& b : baseline)
+            if (b.name == cur.name) base = &b;
+        if (!base) {
+            std::cout << cur.name << ": not in the baseline" << std::endl;
+            continue;
+        }
+        for (const char* m : metrics) {
+            const double* before = base->find(m);
+            const double* after = cur.find(m);
+            if (!before || !after) continue;
+            double change = *before > 0.0 ? 100.0 * (*after - *before) / *before : (*after > 0.0 ? 100.0 : 0.0);
+            bool timing = std::strstr(m, "_ms.") != nullptr;
+            bool regressed = change > threshold && !(timing && *after - *before < timeFloor);
+            regressions += regressed;
+            char line[160];
+            std::snprintf(line, sizeof(line), "%-16s %-12s %12.4g -> %-12.4g %+7.1f%%%s", cur.name.c_str(), m,
+                          *before, *after, change, regressed ? "  REGRESSION" : "");
+            std::cout << line << std::endl;
+        }
+    }
+    std::cout << regressions << " regression" << (regressions == 1 ? "" : "s") << " over " << threshold << "%" << std::endl;
+    return regressions > 0 ? 1 : 0;
+}
+
+// --- main ----------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    BenchScene custom;
+    bool customScene = false;
+    std::string outPath = "bench.json";
+    for (int i = 1; i < argc; ++i) {
+        auto next = [&](const char* fallback) { return i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : fallback; };
+        if (std::strcmp(argv[i], "--compare") == 0 && i + 2 < argc) {
+            std::string baseline = argv[i + 1], current = argv[i + 2];
+            double threshold = i + 4 < argc && std::strcmp(argv[i + 3], "--threshold") == 0 ? std::atof(argv[i + 4]) : 10.0;
+            return compareResults(baseline, current, threshold);
+        }
+        else if (std::strcmp(argv[i], "--out") == 0) outPath = next("bench.json");
+        else if (std::strcmp(argv[i], "--frames") == 0) custom.frames = std::max(std::atoi(next("300")), 1);
+        else if (std::strcmp(argv[i], "--warmup") == 0) custom.warmup = std::max(std::atoi(next("30")), 0);
+        else if (std::strcmp(argv[i], "--seed") == 0) custom.seed = (std::uint32_t)std::strtoul(next("1"), nullptr, 10);
+        else if (std::strcmp(argv[i], "--resolution") == 0)
+            std::sscanf(next("1280x720"), "%dx%d", &custom.width, &custom.height);
+        else {
+            customScene = true;
+            if (std::strcmp(argv[i], "--name") == 0) custom.name = next("custom");
+            else if (std::strcmp(argv[i], "--bodies") == 0) custom.bodies = std::max(std::atoi(next("256")), 0);
+            else if (std::strcmp(argv[i], "--lights") == 0) custom.lights = std::max(std::atoi(next("1")), 1);
+            else if (std::strcmp(argv[i], "--tess") == 0) custom.tessellation = std::max(std::atoi(next("36")), 3);
+            else if (std::strcmp(argv[i], "--shadows") == 0) {
+                std::string mode = next("map");
+                custom.shadows = mode == "none" ? 0 : mode == "analytic" ? 1 : 2;
+            }
+            else {
+                std::cerr << "unknown option " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+    }
+    custom.width = std::max(custom.width, 1);
+    custom.height = std::max(custom.height, 1);
+
+    // The suite shares frames, warmup, seed and resolution with the command
+    // line; a scene option replaces it with that one scene.
+    std::vector<BenchScene> scenes;
+    if (customScene) {
+        scenes.push_back(custom);
+    } else {
+        auto preset = [&](const char* name, int bodies, int lights, int tess, int shadows) {
+            BenchScene s = custom;
+            s.name = name;
+            s.bodies = bodies;
+            s.lights = lights;
+            s.tessellation = tess;
+            s.shadows = shadows;
+            scenes.push_back(s);
+        };
+        preset("few-bodies", 16, 1, 72, 2);
+        preset("many-bodies", 2048, 1, 24, 2);
+        preset("many-lights", 256, 32, 36, 1);
+        preset("no-shadows", 1024, 4, 36, 0);
+        // Vertex bound: what per-vertex work (e.g. the normal matrix) costs.
+        preset("high-tess", 32, 1, 256, 0);
+    }
+
+    // Offscreen either way; without a headless backend a hidden window
+    // provides the context.
+    HeadlessContext headlessContext;
+    GLFWwindow* window = nullptr;
+    std::string contextError;
+    bool headless = HeadlessContext::available() && headlessContext.create(contextError);
+    if (!headless) {
+        if (!glfwInit()) {
+            std::cerr << "no GL context: " << (contextError.empty() ? "glfwInit failed" : contextError) << std::endl;
+            return 2;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(64, 64, "solar_bench", nullptr, nullptr);
+        if (!window) { glfwTerminate(); return 2; }
+        glfwMakeContextCurrent(window);
+    }
+    glewExperimental = GL_TRUE;
+    GLenum glewError = glewInit();
+    if (glewError != GLEW_OK && !(headless && glewError == GLEW_ERROR_NO_GLX_DISPLAY)) {
+        std::cerr << "GLEW init failed" << std::endl;
+        return 2;
+    }
+
+    std::ostringstream json;
+    json << "{\n  \"renderer\": \"" << glGetString(GL_RENDERER) << "\",\n  \"scenes\": [\n";
+    for (std::size_t i = 0; i < scenes.size(); ++i) {
+        const BenchScene& s = scenes[i];
+        BenchResult r = runScene(s);
+        std::vector<double> sorted = r.cpuMs;
+        std::sort(sorted.begin(), sorted.end());
+        std::cerr << s.name << ": " << s.bodies << " bodies, " << s.lights << " lights, " << shadowName(s.shadows)
+                  << " shadows, CPU p50 " << (sorted.empty() ? 0.0 : sorted[sorted.size() / 2]) << " ms, "
+                  << r.drawCalls << " draws" << std::endl;
+        writeScene(json, s, r);
+        json << (i + 1 < scenes.size() ? ",\n" : "\n");
+    }
+    json << "  ]\n}\n";
+
+    std::ofstream out(outPath);
+    out << json.str();
+    if (!out) {
+        std::cerr << "cannot write " << outPath << std::endl;
+        return 2;
+    }
+    std::cerr << "wrote " << outPath << std::endl;
+    if (window) glfwTerminate();
+    return 0;
+}
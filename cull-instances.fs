@@ -0,0 +1,53 @@
+#shader compute
+#version 430 core
+
+// GPU culling for InstanceField.h: one invocation per instance. Survivors of
+// the frustum test (and, with HIZ, the occlusion test against last frame's
+// pyramid) are appended to `visible`, and the count they are appended with
+// is the instance count of the indirect draw that consumes them, so the CPU
+// never reads anything back. The instance count is zeroed before dispatch.
+
+layout(local_size_x = 256) in;
+
+struct Instance {
+    vec4 sphere;    // center relative to the field origin, radius
+    vec4 color;
+};
+
+layout(std430, binding = 0) readonly buffer Instances { Instance instances[]; };
+layout(std430, binding = 1) writeonly buffer Visible { Instance visible[]; };
+layout(std430, binding = 2) buffer Command {
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+uniform uint count;
+// The field origin in render space (camera-relative).
+uniform vec3 origin;
+// frustumPlanes() of projection * view, normals pointing inwards.
+uniform vec4 frustum[6];
+
+#ifdef HIZ
+#include "glsl/hiz.glsl"
+#endif
+
+void main()
+{
+    uint i = gl_GlobalInvocationID.x;
+    if(i >= count)
+        return;
+    Instance instance = instances[i];
+    vec3 center = origin + instance.sphere.xyz;
+    float radius = instance.sphere.w;
+    for(int p = 0; p < 6; p++)
+        if(!(dot(frustum[p].xyz, center) + frustum[p].w >= -radius))
+            return;
+#ifdef HIZ
+    if(hiZOccluded(center, radius))
+        return;
+#endif
+    visible[atomicAdd(instanceCount, 1u)] = instance;
+}
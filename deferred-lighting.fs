@@ -0,0 +1,78 @@
+#shader vertex
+#version 330 core
+
+// Full-screen triangle, no vertex buffer.
+out vec2 ScreenUV;
+
+void main()
+{
+    ScreenUV = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(ScreenUV * 2.0 - 1.0, 0.0, 1.0);
+}
+
+#shader fragment
+#version 330 core
+
+// Lighting pass of the deferred path: the same clustered lights and eclipse
+// shadows as HW-model.fs, evaluated once per visible pixel from the G-buffer.
+// Variants: SHADOWS, SHADOW_MAP, ATMOSPHERE and NUM_LIGHTS as in HW-model.fs;
+// ATMOSPHERE filters the sunlight of the pixels gbuffer.fs flagged.
+out vec4 FragColor;
+
+in vec2 ScreenUV;
+
+#include "glsl/lighting.glsl"
+#include "glsl/shadows.glsl"
+#include "glsl/octahedral.glsl"
+#ifdef ATMOSPHERE
+#include "glsl/atmosphere.glsl"
+#endif
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform usampler2D gOccluders;
+uniform sampler2D gDepth;
+uniform mat4 inverseProjection;
+uniform mat4 inverseView;
+
+uniform vec3 viewPos;
+
+void main()
+{
+    float depth = texture(gDepth, ScreenUV).r;
+    if(depth == 1.0)
+        discard;
+
+    vec4 viewSpace = inverseProjection * vec4(vec3(ScreenUV, depth) * 2.0 - 1.0, 1.0);
+    viewSpace /= viewSpace.w;
+    vec3 FragPos = vec3(inverseView * viewSpace);
+
+    vec4 albedo = texture(gAlbedo, ScreenUV);
+    if(albedo.a > 0.75) {
+        FragColor = vec4(albedo.rgb, 1.0);
+        return;
+    }
+    vec3 baseColor = albedo.rgb;
+    vec3 norm = octDecode(texture(gNormal, ScreenUV).xy);
+    vec3 viewDir = normalize(viewPos - FragPos);
+
+    float shadow = 0.0;
+#ifdef SHADOWS
+#ifdef SHADOW_MAP
+    shadow = cubeShadow(FragPos, sunPos);
+#else
+    uvec2 occluders = texelFetch(gOccluders, ivec2(gl_FragCoord.xy), 0).xy;
+    shadow = occluderShadow(FragPos, int(occluders.x), int(occluders.y));
+#endif
+#endif
+
+    vec3 sunFilter = vec3(1.0);
+#ifdef ATMOSPHERE
+    // As in HW-model.fs; on a sphere the normal is the local up.
+    if(albedo.a > 0.25)
+        sunFilter = atmosphereTransmittance(1.0, dot(norm, normalize(sunPos - FragPos)));
+#endif
+
+    vec3 result = shadePointLights(norm, FragPos, viewDir, baseColor, -viewSpace.z, shadow, sunFilter);
+    FragColor = vec4(result, 1.0);
+}
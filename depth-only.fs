@@ -0,0 +1,21 @@
+#shader vertex
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+
+// Same transform as HW-model.fs, so the GL_EQUAL pass matches exactly.
+#include "glsl/transform.glsl"
+
+void main()
+{
+    vec3 worldPos;
+    float viewDepth;
+    gl_Position = transformVertex(aPos, worldPos, viewDepth);
+}
+
+#shader fragment
+#version 330 core
+
+void main()
+{
+}
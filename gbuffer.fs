@@ -0,0 +1,58 @@
+#shader vertex
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoord;
+
+out vec3 Normal;
+out vec2 TexCoord;
+
+#include "glsl/transform.glsl"
+
+void main()
+{
+    vec3 worldPos;
+    float viewDepth;
+    gl_Position = transformVertex(aPos, worldPos, viewDepth);
+    Normal  = normalMatrix * aNormal;
+    TexCoord = aTexCoord;
+}
+
+#shader fragment
+#version 330 core
+
+// Geometry pass of the deferred path; layout in GBuffer.h.
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+layout (location = 2) out uvec2 gOccluders;
+
+in vec3 Normal;
+in vec2 TexCoord;
+
+#include "glsl/octahedral.glsl"
+
+uniform vec3 objectColor;
+uniform sampler2D textureSample;
+uniform int occluderOffset;
+uniform int occluderCount;
+
+uniform vec3 emissiveColor;
+
+void main()
+{
+#ifdef TEXTURED
+    vec3 texColor = texture(textureSample, TexCoord).rgb;
+#else
+    vec3 texColor = vec3(1.0);
+#endif
+#ifdef EMISSIVE
+    gAlbedo = vec4(texColor + emissiveColor, 1.0);
+#elif defined(ATMOSPHERE)
+    gAlbedo = vec4(texColor * objectColor, 0.5);
+#else
+    gAlbedo = vec4(texColor * objectColor, 0.0);
+#endif
+    gNormal = octEncode(normalize(Normal));
+    gOccluders = uvec2(occluderOffset, occluderCount);
+}
@@ -0,0 +1,100 @@
+// Lookups into the precomputed atmosphere tables (Atmosphere.h); the
+// mappings here must match the ones the tables are built with. Lengths are
+// in planet radii: the ground is r = 1, the top ATMOSPHERE_TOP.
+
+#ifndef ATMOSPHERE_TOP
+#error ATMOSPHERE_* must be injected (see Atmosphere.h)
+#endif
+
+uniform sampler2D transmittanceLUT;
+uniform sampler3D inscatterLUT;
+
+const float ATMOSPHERE_PI = 3.14159265;
+
+float atmosphereHorizon(float r)
+{
+    return -sqrt(max(1.0 - 1.0 / (r * r), 0.0));
+}
+
+// x in [0, 1] to the centers of the first and last texel.
+float atmosphereCoord(float x, float size)
+{
+    return (0.5 + x * (size - 1.0)) / size;
+}
+
+float atmosphereRadiusCoord(float r)
+{
+    return sqrt(clamp((r - 1.0) / (ATMOSPHERE_TOP - 1.0), 0.0, 1.0));
+}
+
+// From r along mu to the top; mu below the horizon is clamped to it.
+vec3 atmosphereTransmittance(float r, float mu)
+{
+    float muH = atmosphereHorizon(r);
+    float x = sqrt(clamp((mu - muH) / (1.0 - muH), 0.0, 1.0));
+    vec2 size = ATMOSPHERE_TRANSMITTANCE_SIZE;
+    return texture(transmittanceLUT, vec2(atmosphereCoord(x, size.x), atmosphereCoord(atmosphereRadiusCoord(r), size.y))).rgb;
+}
+
+vec4 atmosphereInscatter(float r, float mu, float muS)
+{
+    vec3 size = ATMOSPHERE_INSCATTER_SIZE;
+    float halfMu = size.x * 0.5;
+    float muH = atmosphereHorizon(r);
+    float u;
+    if(mu < muH) {
+        float x = sqrt(clamp((muH - mu) / (1.0 + muH), 0.0, 1.0));
+        u = (0.5 + (1.0 - x) * (halfMu - 1.0)) / size.x;
+    } else {
+        float x = sqrt(clamp((mu - muH) / (1.0 - muH), 0.0, 1.0));
+        u = (halfMu + 0.5 + x * (halfMu - 1.0)) / size.x;
+    }
+    float v = atmosphereCoord(clamp((muS + 0.2) / 1.2, 0.0, 1.0), size.y);
+    float w = atmosphereCoord(atmosphereRadiusCoord(r), size.z);
+    return texture(inscatterLUT, vec3(u, v, w));
+}
+
+// Light scattered towards the eye along the view ray from x (planet-centered)
+// in direction v, with the sun in direction s, per unit of sun irradiance.
+// `transmit` is what reaches the eye from behind: from the ground when the
+// ray hits it, from space otherwise.
+vec3 atmosphereScattering(vec3 x, vec3 v, vec3 s, out vec3 transmit)
+{
+    transmit = vec3(1.0);
+    float r = length(x);
+    float rmu = dot(x, v);
+    float toTop = rmu * rmu - r * r + ATMOSPHERE_TOP * ATMOSPHERE_TOP;
+    if(toTop < 0.0)
+        return vec3(0.0);
+    if(r > ATMOSPHERE_TOP) {
+        // Outside: start where the ray enters the atmosphere.
+        float t = -rmu - sqrt(toTop);
+        if(t < 0.0)
+            return vec3(0.0);
+        x += t * v;
+        rmu += t;
+        r = ATMOSPHERE_TOP;
+    }
+    float mu = rmu / r;
+    float muS = dot(x, s) / r;
+    float nu = dot(v, s);
+
+    if(mu < atmosphereHorizon(r)) {
+        // T(x, ground) = T(ground, -mu0) / T(x, -mu), both rays going up.
+        float d = -rmu - sqrt(max(rmu * rmu - r * r + 1.0, 0.0));
+        float mu0 = rmu + d;
+        transmit = clamp(atmosphereTransmittance(1.0, -mu0) / max(atmosphereTransmittance(r, -mu), vec3(1e-4)), 0.0, 1.0);
+    } else {
+        transmit = atmosphereTransmittance(r, mu);
+    }
+
+    // Mie RGB from its red channel (Bruneton & Neyret, eq. 7).
+    vec4 S = atmosphereInscatter(r, mu, muS);
+    vec3 mie = S.rgb * S.a / max(S.r, 1e-4) * (ATMOSPHERE_RAYLEIGH.r / ATMOSPHERE_RAYLEIGH);
+
+    float g = ATMOSPHERE_MIE_G;
+    float phaseR = 3.0 / (16.0 * ATMOSPHERE_PI) * (1.0 + nu * nu);
+    float phaseM = 3.0 / (8.0 * ATMOSPHERE_PI) * (1.0 - g * g) * (1.0 + nu * nu)
+                 / ((2.0 + g * g) * pow(max(1.0 + g * g - 2.0 * g * nu, 1e-4), 1.5));
+    return S.rgb * phaseR + mie * phaseM;
+}
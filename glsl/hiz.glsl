@@ -0,0 +1,44 @@
+// Occlusion test against a Hi-Z pyramid (HiZPyramid.h) built from an earlier
+// frame: level 0 is that frame's depth buffer, every level above holds the
+// farthest depth of the texels under it.
+
+uniform sampler2D hiZ;
+// The frame the pyramid comes from: its projection * view and the offset from
+// this frame's render space to its render space (the camera moved).
+uniform mat4 hiZViewProjection;
+uniform vec3 hiZOffset;
+
+// True when the sphere is certainly behind what that frame drew. Tests the
+// sphere's box: its screen rect picks the level where it spans at most 2x2
+// texels, and its nearest corner is compared with the farthest of those.
+bool hiZOccluded(vec3 center, float radius)
+{
+    center += hiZOffset;
+    vec2 lo = vec2(1.0), hi = vec2(-1.0);
+    float nearest = 1.0;
+    for(int i = 0; i < 8; i++) {
+        vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+        vec4 clip = hiZViewProjection * vec4(corner, 1.0);
+        // Reaches behind the near plane: no screen rect to test.
+        if(clip.w <= 0.0 || clip.z < -clip.w)
+            return false;
+        vec3 ndc = clip.xyz / clip.w;
+        lo = min(lo, ndc.xy);
+        hi = max(hi, ndc.xy);
+        nearest = min(nearest, ndc.z);
+    }
+    vec2 size = vec2(textureSize(hiZ, 0));
+    vec2 pixelLo = clamp(lo * 0.5 + 0.5, 0.0, 1.0) * size;
+    vec2 pixelHi = clamp(hi * 0.5 + 0.5, 0.0, 1.0) * size;
+    vec2 extent = pixelHi - pixelLo;
+    int lod = min(int(ceil(log2(max(max(extent.x, extent.y), 1.0)))), textureQueryLevels(hiZ) - 1);
+
+    // Level sizes round down, so the last texel of a level also covers the
+    // remainder; clamping keeps the lookup on it.
+    ivec2 last = textureSize(hiZ, lod) - 1;
+    ivec2 a = min(ivec2(pixelLo) >> lod, last);
+    ivec2 b = min(ivec2(pixelHi) >> lod, last);
+    float farthest = max(max(texelFetch(hiZ, a, lod).r, texelFetch(hiZ, ivec2(b.x, a.y), lod).r),
+                         max(texelFetch(hiZ, ivec2(a.x, b.y), lod).r, texelFetch(hiZ, b, lod).r));
+    return nearest * 0.5 + 0.5 > farthest;
+}
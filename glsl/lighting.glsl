@@ -0,0 +1,102 @@
+// Phong point lights fed from the clustered light buffers (LightClusters.h).
+// CLUSTER_DIM_X/Y/Z are injected as constants; NUM_LIGHTS n selects the
+// fixed-count loop over lights 0..n-1 instead of the cluster lists.
+
+struct Material {
+    float shininess;
+};
+
+struct PointLight {
+    vec3 position;
+    float constant;
+    float linear;
+    float quadratic;
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+uniform Material material;
+// Four texels per light, an (offset, count) pair per cluster and the light
+// index lists.
+uniform samplerBuffer clusterLights;
+uniform usamplerBuffer clusterGrid;
+uniform usamplerBuffer clusterIndices;
+uniform vec2 clusterScreen;
+// slice = log(viewDepth) * x + y
+uniform vec2 clusterDepth;
+
+#ifndef CLUSTER_DIM_X
+#error CLUSTER_DIM_X/Y/Z must be injected (see LightClusters.h)
+#endif
+const ivec3 clusterDims = ivec3(CLUSTER_DIM_X, CLUSTER_DIM_Y, CLUSTER_DIM_Z);
+
+vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir, vec3 color)
+{
+    vec3 lightDir = normalize(light.position - fragPos);
+
+    float diff = max(dot(normal, lightDir), 0.0);
+
+    vec3 reflectDir = reflect(-lightDir, normal);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
+
+    float distance = length(light.position - fragPos);
+    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * distance * distance);
+
+    vec3 ambient  = light.ambient  * color;
+    vec3 diffuse  = light.diffuse  * diff * color;
+    vec3 specular = light.specular * spec;
+
+    return (ambient + diffuse + specular) * attenuation;
+}
+
+PointLight fetchLight(int index)
+{
+    vec4 t0 = texelFetch(clusterLights, 4 * index);
+    vec4 t1 = texelFetch(clusterLights, 4 * index + 1);
+    vec4 t2 = texelFetch(clusterLights, 4 * index + 2);
+    vec4 t3 = texelFetch(clusterLights, 4 * index + 3);
+    PointLight light;
+    light.position = t0.xyz;
+    light.ambient = t1.rgb;
+    light.constant = t1.a;
+    light.diffuse = t2.rgb;
+    light.linear = t2.a;
+    light.specular = t3.rgb;
+    light.quadratic = t3.a;
+    return light;
+}
+
+uvec2 fetchCluster(float viewDepth)
+{
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / clusterScreen * vec2(clusterDims.xy)), ivec2(0), clusterDims.xy - 1);
+    int slice = clamp(int(floor(log(viewDepth) * clusterDepth.x + clusterDepth.y)), 0, clusterDims.z - 1);
+    return texelFetch(clusterGrid, (slice * clusterDims.y + tile.y) * clusterDims.x + tile.x).xy;
+}
+
+// Sum of all lights reaching this fragment. Light 0 is the sun; `shadow`
+// only darkens it (down to its ambient term) and `sunFilter` tints what is
+// left of it (the atmosphere's transmittance, 1 without one).
+vec3 shadePointLights(vec3 norm, vec3 fragPos, vec3 viewDir, vec3 baseColor, float viewDepth, float shadow, vec3 sunFilter)
+{
+    vec3 result = vec3(0.0);
+#ifdef NUM_LIGHTS
+    // Few lights: no cluster lookup, and a loop the compiler can unroll.
+    for(int index=0; index<NUM_LIGHTS; index++) {
+#else
+    uvec2 cluster = fetchCluster(viewDepth);
+    for(uint i=0u; i<cluster.y; i++) {
+        int index = int(texelFetch(clusterIndices, int(cluster.x + i)).r);
+#endif
+        PointLight light = fetchLight(index);
+        vec3 lit = CalcPointLight(light, norm, fragPos, viewDir, baseColor);
+#if defined(SHADOWS) || defined(ATMOSPHERE)
+        if(index == 0) {
+            vec3 ambient = light.ambient * baseColor;
+            lit = ambient + (lit - ambient) * sunFilter * (1.0 - shadow);
+        }
+#endif
+        result += lit;
+    }
+    return result;
+}
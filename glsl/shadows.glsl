@@ -0,0 +1,72 @@
+// Eclipse shadows from the sun (light 0): analytic sphere occluders culled
+// per receiver on the CPU (OccluderCulling.h), or the cube shadow map
+// (ShadowMap.h) with SHADOW_MAP.
+
+uniform vec3 sunPos;
+// All receivers' occluder lists back to back; xyz = position, w = radius.
+uniform samplerBuffer occluderList;
+uniform samplerCube shadowMap;
+uniform float shadowFar;
+
+float simpleShadow(vec3 fragPos, vec3 lightPos, vec3 occluderPos, float occluderRadius)
+{
+    vec3 L = lightPos - fragPos;
+    vec3 Ldir = normalize(L);
+    float Ldist = length(L);
+
+    vec3 O = occluderPos - fragPos;
+
+    float t = dot(O, Ldir);
+
+    if(t <= 0.0 || t >= Ldist)
+        return 0.0;
+
+    vec3 closestPoint = fragPos + Ldir * t;
+
+    float d = length(occluderPos - closestPoint);
+
+    if(d > occluderRadius)
+        return 0.0;
+
+
+    float softness = 1.0 - smoothstep(0.0, occluderRadius, d);
+    return softness;
+}
+
+// Texels [offset, offset + count) of occluderList.
+float occluderShadow(vec3 fragPos, int offset, int count)
+{
+    float shadow = 0.0;
+    for(int i=0; i<count; i++) {
+        vec4 occluder = texelFetch(occluderList, offset + i);
+        shadow = max(shadow, simpleShadow(fragPos, sunPos, occluder.xyz, occluder.w));
+    }
+    return shadow;
+}
+
+const vec3 pcfOffsets[20] = vec3[](
+    vec3( 1,  1,  1), vec3( 1, -1,  1), vec3(-1, -1,  1), vec3(-1,  1,  1),
+    vec3( 1,  1, -1), vec3( 1, -1, -1), vec3(-1, -1, -1), vec3(-1,  1, -1),
+    vec3( 1,  1,  0), vec3( 1, -1,  0), vec3(-1, -1,  0), vec3(-1,  1,  0),
+    vec3( 1,  0,  1), vec3(-1,  0,  1), vec3( 1,  0, -1), vec3(-1,  0, -1),
+    vec3( 0,  1,  1), vec3( 0, -1,  1), vec3( 0, -1, -1), vec3( 0,  1, -1)
+);
+
+float cubeShadow(vec3 fragPos, vec3 lightPos)
+{
+    vec3 toFrag = fragPos - lightPos;
+    float current = length(toFrag);
+    // Past the map's range nothing was recorded, so nothing shadows it.
+    if(current >= shadowFar)
+        return 0.0;
+    float bias = 0.02;
+    float diskRadius = 0.005 * current;
+    float shadow = 0.0;
+    for(int i = 0; i < 20; ++i)
+    {
+        float closest = texture(shadowMap, toFrag + pcfOffsets[i] * diskRadius).r * shadowFar;
+        if(current - bias > closest)
+            shadow += 1.0;
+    }
+    return shadow / 20.0;
+}
@@ -0,0 +1,20 @@
+// Object to clip space for every sphere pass. Keeping the expressions in one
+// place (and gl_Position invariant) is what lets the depth pre-pass and the
+// GL_EQUAL shading pass agree bit for bit.
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+// Computed per object on the CPU (SceneGraph::normalMatrix); may carry a
+// uniform scale, so normalize after interpolation.
+uniform mat3 normalMatrix;
+
+invariant gl_Position;
+
+// Returns the clip position; worldPos is camera-relative world space.
+vec4 transformVertex(vec3 position, out vec3 worldPos, out float viewDepth)
+{
+    worldPos = vec3(model * vec4(position, 1.0));
+    vec4 viewPos = view * vec4(worldPos, 1.0);
+    viewDepth = -viewPos.z;
+    return projection * viewPos;
+}
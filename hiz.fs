@@ -0,0 +1,41 @@
+#shader vertex
+#version 330 core
+
+// Full-screen triangle from gl_VertexID.
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
+
+#shader fragment
+#version 330 core
+
+// One level of the Hi-Z pyramid (HiZPyramid.h): the farthest depth of the
+// source texels under this texel. FIRST copies the depth buffer as level 0.
+
+out float Depth;
+
+// The level below (its base level is set to it) or the depth copy.
+uniform sampler2D source;
+uniform ivec2 sourceSize;
+
+void main()
+{
+    ivec2 dst = ivec2(gl_FragCoord.xy);
+#ifdef FIRST
+    Depth = texelFetch(source, dst, 0).r;
+#else
+    // Sizes halve rounding down, so with an odd source size the last
+    // column/row also takes the texel past its pair.
+    ivec2 src = dst * 2;
+    ivec2 last = sourceSize - 1;
+    int nx = src.x + 2 == last.x ? 3 : 2;
+    int ny = src.y + 2 == last.y ? 3 : 2;
+    float d = 0.0;
+    for(int y = 0; y < ny; y++)
+        for(int x = 0; x < nx; x++)
+            d = max(d, texelFetch(source, min(src + ivec2(x, y), last), 0).r);
+    Depth = d;
+#endif
+}
@@ -0,0 +1,35 @@
+#shader vertex
+#version 330 core
+
+// ImGui vertices (HudRenderer.h), in pixels from the top left.
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec4 aColor;
+
+out vec2 TexCoord;
+out vec4 Color;
+
+uniform vec2 displaySize;
+
+void main()
+{
+    TexCoord = aTexCoord;
+    Color = aColor;
+    vec2 ndc = aPos / displaySize * 2.0 - 1.0;
+    gl_Position = vec4(ndc.x, -ndc.y, 0.0, 1.0);
+}
+
+#shader fragment
+#version 330 core
+
+out vec4 FragColor;
+
+in vec2 TexCoord;
+in vec4 Color;
+
+uniform sampler2D fontAtlas;
+
+void main()
+{
+    FragColor = Color * texture(fontAtlas, TexCoord);
+}
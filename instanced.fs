@@ -0,0 +1,44 @@
+#shader vertex
+#version 330 core
+
+// Instances of InstanceField.h: a unit sphere placed and scaled per instance.
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 3) in vec4 instanceSphere;   // center relative to origin, radius
+layout (location = 4) in vec4 instanceColor;
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec3 Color;
+
+uniform mat4 projection;
+uniform mat4 view;
+// The field origin in render space.
+uniform vec3 origin;
+
+void main()
+{
+    FragPos = origin + instanceSphere.xyz + instanceSphere.w * aPos;
+    Normal = aNormal;
+    Color = instanceColor.rgb;
+    gl_Position = projection * view * vec4(FragPos, 1.0);
+}
+
+#shader fragment
+#version 330 core
+
+out vec4 FragColor;
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec3 Color;
+
+uniform vec3 sunPos;
+uniform vec3 sunAmbient;
+uniform vec3 sunDiffuse;
+
+void main()
+{
+    float diffuse = max(dot(normalize(Normal), normalize(sunPos - FragPos)), 0.0);
+    FragColor = vec4(Color * (sunAmbient + sunDiffuse * diffuse), 1.0);
+}
@@ -7,14 +7,12 @@ layout(location = 1) in vec3 aNormal;
 out vec3 FragPos;
 out vec3 Normal;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "glsl/transform.glsl"
 
 void main(){
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
-    gl_Position = projection * view * vec4(FragPos, 1.0);
+    float viewDepth;
+    gl_Position = transformVertex(aPos, FragPos, viewDepth);
+    Normal = normalMatrix * aNormal;
 }
 
 #shader fragment
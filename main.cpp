@@ -5,11 +5,33 @@
 #include <glm.hpp>
 #include <gtc/matrix_transform.hpp>
 #include <array>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
 
 #include "Shader.h"
 #include "Sphere.h"
+#include "EclipsePredictor.h"
+#include "SceneGraph.h"
+#include "Systems.h"
+#include "SceneLoader.h"
+#include "GBuffer.h"
+#include "PipelineStats.h"
+#include "MeshBVH.h"
+#include "InstanceField.h"
+#include "HeadlessContext.h"
+#include "RenderTarget.h"
+#include "GpuProfiler.h"
+#include "CpuProfiler.h"
+#include "WorkerPool.h"
+#ifdef SOLAR_IMGUI
+#include "PerfHud.h"
+#endif
+#include <algorithm>
+#include <cstdio>
+#include <memory>
 
-glm::vec3 camPos   = glm::vec3(0.0f, 0.0f, 8.0f);
+glm::dvec3 camPos  = glm::dvec3(0.0, 0.0, 8.0);
 glm::vec3 camFront = glm::vec3(0.0f, 0.0f, -1.0f);
 glm::vec3 camUp    = glm::vec3(0.0f, 1.0f, 0.0f);
 float yaw = -90.0f, pitch = 0.0f;
@@ -17,214 +39,1395 @@ float lastX = 400, lastY = 300;
 bool firstMouse = true;
 float fov = 45.0f;
 float deltaTime = 0.0f, lastFrame = 0.0f;
-float moonOrbitSpeed = 0.5f;
-float earthOrbitSpeed = 0.01f;
-float currentMoonSpeed = moonOrbitSpeed; 
-float currentEarthSpeed = earthOrbitSpeed;
-glm::vec3 sunPos = glm::vec3(-1.0f, 0.0f, 0.0f);
-glm::vec3 earthPos;
-glm::vec3 moonPos;
-std::array<glm::vec3, 3> lastPos;
-float earthAngle = 0.0f;
-float moonAngle = 0.0f;
-bool moonInfront = false;   
+std::string scenePath = "../scenes/solar.json";
+// Body state lives in the registry; world positions are double and the scene
+// graph hands the GPU camera-relative float matrices (floating origin).
+Registry registry;
+SceneGraph scene;
+Entity earthEntity = NULL_ENTITY;
+Entity moonEntity = NULL_ENTITY;
+double simTime = 0.0;
+// 0: analytic occluders in the shader, 1: cube shadow map (M toggles)
+int shadowMode = 1;
+const std::size_t shadowMapBudget = 32u << 20;
+// 0: forward, 1: deferred G-buffer (N toggles, --deferred starts with it)
+int renderPath = 0;
+// Forward path only: depth-only pre-pass, then shading with GL_EQUAL
+// (P toggles, --prepass starts with it)
+bool depthPrepass = false;
+// Atmosphere shells and sunlight filtering for Atmosphere bodies (B toggles)
+bool atmosphereEnabled = true;
+const float atmosphereExposure = 30.0f;
+// --field N: a ring of N instanced asteroids around the sun, culled by a
+// compute pass with Hi-Z occlusion when GL 4.3 is there (C toggles the CPU
+// frustum culling path instead)
+int fieldCount = 0;
+bool gpuCulling = true;
+// Bodies hidden behind the largest ones are not drawn (O toggles)
+bool occlusionCulling = true;
+// --flyby [frames]: scripted pass over the largest planet, flown once with
+// occlusion culling and once without, then the frame times are printed
+int flybyFrames = 0;
+// --headless [WxH]: no window; --frames N frames (default 300) of a scripted
+// pass over the largest planet are rendered offscreen at a fixed 60 Hz step,
+// then the frame times are printed (--screenshot writes the last frame)
+bool headless = false;
+int headlessWidth = 1280, headlessHeight = 720;
+int headlessFrames = 300;
+std::string screenshotPath;
+// --trace file.json: GPU pass timings of the last frames as a Chrome trace,
+// written on exit
+std::string tracePath;
+// Performance HUD (F1 shows it, F2 frees the mouse to use its toggles);
+// built with SOLAR_IMGUI. --hud draws it in headless runs too and reports
+// what it costs
+bool hudVisible = false;
+bool hudCursor = false;
+EclipsePredictor eclipses;
+bool stopAtEclipse = false;
+bool haltedAtEclipse = false;
+EclipseType eclipseTarget = EclipseType::Solar;
 
 
 void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-bool areAlignedOrSmth(glm::vec3 sunPos, glm::vec3 earthPos, glm::vec3 moonPos);
-bool isMoonInFront(glm::vec3 sunPos, glm::vec3 earthPos, glm::vec3 moonPos);
+void stepOrbits(double dt);
+bool keyPressedOnce(GLFWwindow* window, int key);
+int listEclipses(double years);
+int benchEcs(int count);
+int bakeSceneFile(const std::string& in, const std::string& out);
+int benchScene(int count);
+int benchOccluders(int moons);
+int benchLights(int maxLights);
+int benchNormals(int objects);
+int benchAtmosphere(int runs);
+int benchCull(int count);
+int benchBvh(int meshes);
+int benchOcclusion(int bodies);
+int benchRaster(int occluders);
+void flybyCamera(double t, const glm::dvec3& center, double radius, glm::dvec3& pos, glm::vec3& front);
+void printGpuPasses(const GpuProfiler& profiler);
 
-int main() {
-    std::cout << 1 ;
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        auto next = [&](const char* fallback) { return i + 1 < argc && argv[i + 1][0] != '-' ? argv[++i] : fallback; };
+        if (std::strcmp(argv[i], "--scene") == 0) scenePath = next(scenePath.c_str());
+        else if (std::strcmp(argv[i], "--eclipses") == 0) return listEclipses(std::atof(next("100")));
+        else if (std::strcmp(argv[i], "--bench-ecs") == 0) return benchEcs(std::atoi(next("10000")));
+        else if (std::strcmp(argv[i], "--bench-scene") == 0) return benchScene(std::atoi(next("1000000")));
+        else if (std::strcmp(argv[i], "--bench-occluders") == 0) return benchOccluders(std::atoi(next("1000")));
+        else if (std::strcmp(argv[i], "--bench-lights") == 0) return benchLights(std::atoi(next("4096")));
+        else if (std::strcmp(argv[i], "--bench-normals") == 0) return benchNormals(std::atoi(next("10000")));
+        else if (std::strcmp(argv[i], "--bench-atmosphere") == 0) return benchAtmosphere(std::atoi(next("5")));
+        else if (std::strcmp(argv[i], "--bench-cull") == 0) return benchCull(std::atoi(next("1000000")));
+        else if (std::strcmp(argv[i], "--bench-bvh") == 0) return benchBvh(std::atoi(next("10000")));
+        else if (std::strcmp(argv[i], "--bench-occlusion") == 0) return benchOcclusion(std::atoi(next("10000")));
+        else if (std::strcmp(argv[i], "--bench-raster") == 0) return benchRaster(std::atoi(next("8")));
+        else if (std::strcmp(argv[i], "--flyby") == 0) flybyFrames = std::max(std::atoi(next("600")), 1);
+        else if (std::strcmp(argv[i], "--deferred") == 0) renderPath = 1;
+        else if (std::strcmp(argv[i], "--prepass") == 0) depthPrepass = true;
+        else if (std::strcmp(argv[i], "--field") == 0) fieldCount = std::atoi(next("100000"));
+        else if (std::strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+            std::sscanf(next("1280x720"), "%dx%d", &headlessWidth, &headlessHeight);
+            headlessWidth = std::max(headlessWidth, 1);
+            headlessHeight = std::max(headlessHeight, 1);
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0) headlessFrames = std::max(std::atoi(next("300")), 1);
+        else if (std::strcmp(argv[i], "--screenshot") == 0) screenshotPath = next("headless.ppm");
+        else if (std::strcmp(argv[i], "--trace") == 0) tracePath = next("trace.json");
+        else if (std::strcmp(argv[i], "--hud") == 0) hudVisible = true;
+        else if (std::strcmp(argv[i], "--bake") == 0 && i + 2 < argc) return bakeSceneFile(argv[i + 1], argv[i + 2]);
+    }
+
+    // CPU scopes are recorded from here on for --trace, startup included.
+    if (!tracePath.empty()) {
+        CpuProfiler::setThreadName("main");
+        CpuProfiler::setEnabled(true);
+    }
+
+    SceneData sceneData;
+    std::string sceneError;
+    bool sceneLoaded;
+    {
+        PROFILE_SCOPE("scene load");
+        sceneLoaded = loadScene(scenePath, sceneData, sceneError);
+    }
+    if (!sceneLoaded) {
+        std::cout << "Scene: " << sceneError << std::endl;
+        return -1;
+    }
 
-    if (!glfwInit()) return -1;
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    std::cout << 1 ;
+    GLFWwindow* window = nullptr;
+    HeadlessContext headlessContext;
+    if (headless) {
+        PROFILE_SCOPE("context");
+        std::string contextError;
+        if (!headlessContext.create(contextError)) {
+            std::cout << "Headless: " << contextError << std::endl;
+            return -1;
+        }
+    } else {
+        PROFILE_SCOPE("context");
+        if (!glfwInit()) return -1;
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-    GLFWwindow* window = glfwCreateWindow(800, 600, "Sphere Light Test", nullptr, nullptr);
-    if (!window) { glfwTerminate(); return -1; }
-    glfwMakeContextCurrent(window);
-    std::cout << 1 ;
+        window = glfwCreateWindow(800, 600, "Sphere Light Test", nullptr, nullptr);
+        if (!window) { glfwTerminate(); return -1; }
+        glfwMakeContextCurrent(window);
 
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-    std::cout << 1 ;
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    }
 
     glewExperimental = GL_TRUE;
-    if (glewInit() != GLEW_OK) {
+    GLenum glewError;
+    {
+        PROFILE_SCOPE("glew init");
+        glewError = glewInit();
+    }
+    // A GLX build of GLEW has loaded every entry point by the time it finds
+    // no X display, and an EGL or OSMesa context needs nothing more.
+    if (glewError != GLEW_OK && !(headless && glewError == GLEW_ERROR_NO_GLX_DISPLAY)) {
         std::cout << "GLEW init failed\n";
     }
-    std::cout << 1 ;
 
     glEnable(GL_DEPTH_TEST);
-    std::cout << 1 ;
 
-    Shader lightingShader("../HW-model.fs");
+    auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    // Scattering tables; the shader constants only need the parameters, the
+    // tables themselves are filled in once the scene turns out to use them.
+    AtmosphereTables atmosphereTables;
+    std::vector<std::string> lightingConstants = LightClusters::shaderConstants();
+    for (const std::string& c : atmosphereTables.shaderConstants()) lightingConstants.push_back(c);
 
-    Sphere sun(0.5f, 36, 18 ,"../textures/Sun.jpg");
-    std::cout << 2 ;
+    auto shaderStart = std::chrono::high_resolution_clock::now();
+    Shader lightingShader("../HW-model.fs", shaderFeatureNames(), lightingConstants);
+    Shader depthShader("../shadow-depth.fs");
+    Shader gbufferShader("../gbuffer.fs", shaderFeatureNames());
+    Shader deferredShader("../deferred-lighting.fs", shaderFeatureNames(), lightingConstants);
+    Shader depthOnlyShader("../depth-only.fs");
+    Shader atmosphereShader("../atmosphere.fs", {}, atmosphereTables.shaderConstants());
+    double shaderMs = ms(shaderStart, std::chrono::high_resolution_clock::now());
+    CubeShadowMap shadowMap(shadowMapBudget);
+    Sphere casterMesh(1.0f, 24, 12);
+    Sphere shellMesh(1.0f, 48, 24);
+    OccluderLists occluderLists;
+    LightClusters lightClusters;
+    // Headless frames go to an offscreen target instead of the window.
+    int fbWidth = headlessWidth, fbHeight = headlessHeight;
+    std::unique_ptr<RenderTarget> renderTarget;
+    if (headless) {
+        renderTarget = std::make_unique<RenderTarget>(fbWidth, fbHeight);
+        std::cout << "Headless (" << HeadlessContext::backend() << "): " << glGetString(GL_RENDERER)
+                  << ", GL " << glGetString(GL_VERSION) << ", " << fbWidth << "x" << fbHeight << std::endl;
+    } else {
+        glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    }
+    unsigned int targetFbo = renderTarget ? renderTarget->fbo() : 0;
+    GBuffer gbuffer(fbWidth, fbHeight);
+    FrustumCuller frustumCuller;
+    OcclusionBuffer occlusionBuffer(256, 128);
+    OcclusionRasterizer occlusionRasterizer;
+    std::vector<std::uint32_t> visibleSpheres, drawOrder;
+    std::size_t occludedSpheres = 0;
+    FragmentStats fragmentStats;
+    GpuProfiler gpuProfiler;
+    // The trace keeps the last 64K scopes of each kind, drained every frame.
+    const std::size_t traceCapacity = 1u << 16;
+    std::vector<TraceEvent> cpuTrace, cpuFrame;
+#ifdef SOLAR_IMGUI
+    std::unique_ptr<PerfHud> hud;
+    if (!headless || hudVisible) {
+        hud = std::make_unique<PerfHud>(window, "../hud.fs");
+        if (headless) hud->setDisplaySize(fbWidth, fbHeight);
+        CpuProfiler::setThreadName("main");
+    }
+    PrimitiveStats primitiveStats;
+#endif
+    // The HUD reads the scopes of each frame as they are drained; only a
+    // trace keeps them.
+    auto drainCpuTrace = [&]() {
+        cpuFrame.clear();
+        CpuProfiler::drain(cpuFrame);
+#ifdef SOLAR_IMGUI
+        if (hud && hudVisible) hud->addCpuFrame(cpuFrame.data(), cpuFrame.size());
+#endif
+        if (tracePath.empty()) return;
+        cpuTrace.insert(cpuTrace.end(), cpuFrame.begin(), cpuFrame.end());
+        if (cpuTrace.size() > 2 * traceCapacity)
+            cpuTrace.erase(cpuTrace.begin(), cpuTrace.end() - traceCapacity);
+    };
+    if (!tracePath.empty()) gpuProfiler.setTraceCapacity(traceCapacity);
+    auto writeTrace = [&]() {
+        if (tracePath.empty()) return;
+        drainCpuTrace();
+        std::vector<TraceEvent> events;
+        gpuProfiler.appendTrace(events);
+        std::size_t keep = std::min(cpuTrace.size(), traceCapacity);
+        events.insert(events.end(), cpuTrace.end() - keep, cpuTrace.end());
+        if (CpuProfiler::dropped() > 0)
+            std::cout << "Trace: " << CpuProfiler::dropped() << " CPU scopes dropped (buffer full)" << std::endl;
+        if (writeChromeTrace(tracePath, events)) std::cout << "Trace: " << tracePath << std::endl;
+        else std::cout << "Trace: cannot write " << tracePath << std::endl;
+    };
 
-    Sphere earth(0.3f, 36, 18, "../textures/Earth.jpg");
-    std::cout << 2 ;
+    // One unit sphere per material, scaled per body by its radius.
+    std::vector<std::unique_ptr<Sphere>> sphereMeshes;
+    std::vector<Sphere*> meshes;
+    for (const MaterialDesc& m : sceneData.materials) {
+        sphereMeshes.push_back(std::make_unique<Sphere>(1.0f, 36, 18, m.texture.empty() ? nullptr : m.texture.c_str()));
+        meshes.push_back(sphereMeshes.back().get());
+    }
 
-    Sphere moon(0.15, 36, 18, "../textures/Moon.jpg");
-    std::cout << 2 ;
+    std::vector<Entity> bodies = instantiateScene(sceneData, registry, scene, meshes);
+    int earthIndex = sceneData.find("earth"), moonIndex = sceneData.find("moon");
+    if (earthIndex >= 0 && moonIndex >= 0
+        && registry.has<OrbitalElements>(bodies[earthIndex]) && registry.has<OrbitalElements>(bodies[moonIndex])) {
+        earthEntity = bodies[earthIndex];
+        moonEntity = bodies[moonIndex];
+    }
 
+    // Built once on every core, then loaded from the cache; a scene without
+    // atmospheres never touches them.
+    if (registry.pool<Atmosphere>().size() > 0) {
+        auto atmosphereStart = std::chrono::high_resolution_clock::now();
+        bool atmosphereCached = atmosphereTables.loadOrBuild("atmosphere_cache");
+        atmosphereTables.upload();
+        std::cout << "Atmosphere: tables " << (atmosphereCached ? "loaded" : "built") << " in "
+                  << ms(atmosphereStart, std::chrono::high_resolution_clock::now()) << " ms" << std::endl;
+    }
+
+    // The asteroid field circles the first light, or the world origin.
+    std::unique_ptr<InstanceField> field;
+    std::unique_ptr<Shader> instancedShader, cullShader;
+    std::unique_ptr<HiZPyramid> hiZ;
+    Sphere fieldMesh(1.0f, 12, 6);
+    Entity fieldAnchor = registry.pool<Emissive>().size() > 0 ? registry.pool<Emissive>().entities()[0] : NULL_ENTITY;
+    bool hiZValid = false;
+    glm::mat4 hiZViewProjection(1.0f);
+    glm::dvec3 hiZCamPos(0.0);
+    if (fieldCount > 0) {
+        std::vector<FieldInstance> instances(fieldCount);
+        for (int i = 0; i < fieldCount; ++i) {
+            float t = (float)i;
+            float angle = t * 2.39996f;
+            float r = 4.0f + 3.0f * std::fmod(t * 0.618034f, 1.0f);
+            float y = 0.3f * (2.0f * std::fmod(t * 0.414214f, 1.0f) - 1.0f);
+            float shade = 0.3f + 0.3f * std::fmod(t * 0.732051f, 1.0f);
+            instances[i].sphere = glm::vec4(r * std::cos(angle), y, r * std::sin(angle), 0.005f + 0.025f * std::fmod(t * 0.236068f, 1.0f));
+            instances[i].color = glm::vec4(shade, shade * 0.9f, shade * (i % 3 == 0 ? 0.7f : 0.85f), 1.0f);
+        }
+        field = std::make_unique<InstanceField>(std::move(instances), fieldMesh.getIndexCount());
+        instancedShader = std::make_unique<Shader>("../instanced.fs");
+        if (InstanceField::gpuSupported()) {
+            cullShader = std::make_unique<Shader>("../cull-instances.fs", std::vector<std::string>{ "HIZ" });
+            hiZ = std::make_unique<HiZPyramid>("../hiz.fs");
+        } else {
+            std::cout << "Field: no compute shaders (GL 4.3), culling on the CPU" << std::endl;
+        }
+    }
+
+    // Issue every variant this scene can use before waiting on any, so a
+    // driver with parallel shader compile builds them concurrently (and the
+    // binary cache makes later launches skip compiling altogether).
+    std::uint32_t lightFeature = lightCountFeature(registry.pool<Emissive>().size());
+    std::vector<std::uint32_t> lightingVariants, deferredVariants;
+    std::vector<std::uint32_t> bodyFeatures = { 0u, FEATURE_TEXTURED, FEATURE_EMISSIVE, FEATURE_EMISSIVE | FEATURE_TEXTURED };
+    if (registry.pool<Atmosphere>().size() > 0) {
+        bodyFeatures.push_back(FEATURE_ATMOSPHERE);
+        bodyFeatures.push_back(FEATURE_ATMOSPHERE | FEATURE_TEXTURED);
+    }
+    for (std::uint32_t shadows : { 0u, (std::uint32_t)FEATURE_SHADOWS, (std::uint32_t)(FEATURE_SHADOWS | FEATURE_SHADOW_MAP) }) {
+        deferredVariants.push_back(lightFeature | shadows);
+        if (registry.pool<Atmosphere>().size() > 0) deferredVariants.push_back(lightFeature | shadows | FEATURE_ATMOSPHERE);
+        for (std::uint32_t body : bodyFeatures)
+            lightingVariants.push_back(lightFeature | shadows | body);
+    }
+    std::vector<std::uint32_t> gbufferVariants = { 0u, FEATURE_TEXTURED, FEATURE_EMISSIVE, FEATURE_EMISSIVE | FEATURE_TEXTURED };
+    if (registry.pool<Atmosphere>().size() > 0) {
+        gbufferVariants.push_back(FEATURE_ATMOSPHERE);
+        gbufferVariants.push_back(FEATURE_ATMOSPHERE | FEATURE_TEXTURED);
+    }
+    std::vector<Shader*> singleShaders = { &depthShader, &depthOnlyShader, &atmosphereShader };
+    if (instancedShader) singleShaders.push_back(instancedShader.get());
+    shaderStart = std::chrono::high_resolution_clock::now();
+    lightingShader.precompile(lightingVariants);
+    deferredShader.precompile(deferredVariants);
+    gbufferShader.precompile(gbufferVariants);
+    for (Shader* shader : singleShaders) shader->precompile({ 0u });
+    if (cullShader) cullShader->precompile({ 0u, 1u });
+    // With parallel compile, variants still building are collected between
+    // frames once ready() says so instead of waited on here; a frame that
+    // needs one sooner waits for that one alone.
+    struct PendingVariants {
+        Shader* shader;
+        std::vector<std::uint32_t> variants;
+    };
+    std::vector<PendingVariants> pendingShaders = {
+        { &lightingShader, lightingVariants }, { &deferredShader, deferredVariants }, { &gbufferShader, gbufferVariants } };
+    auto collectShaders = [&](bool wait) {
+        for (PendingVariants& p : pendingShaders) {
+            p.variants.erase(std::remove_if(p.variants.begin(), p.variants.end(), [&](std::uint32_t v) {
+                if (!wait && !p.shader->ready(v)) return false;
+                p.shader->select(v);
+                return true;
+            }), p.variants.end());
+        }
+    };
+    collectShaders(!Shader::parallelCompile());
+    std::size_t compiling = 0;
+    for (const PendingVariants& p : pendingShaders) compiling += p.variants.size();
+    for (Shader* shader : singleShaders) shader->select(0);
+    shaderMs += ms(shaderStart, std::chrono::high_resolution_clock::now());
+    std::cout << "Shaders: " << lightingShader.variantCount() + deferredShader.variantCount() + gbufferShader.variantCount()
+                                + singleShaders.size() + (cullShader ? cullShader->variantCount() : 0)
+              << " programs in " << shaderMs << " ms";
+    if (compiling > 0) std::cout << ", " << compiling << " still compiling";
+    std::cout << std::endl;
 
     glDisable(GL_CULL_FACE);
 
-    while(!glfwWindowShouldClose(window)){
-        float currentFrame = glfwGetTime();
+    // The flyby passes the largest body that is not a light.
+    Entity flybyTarget = NULL_ENTITY;
+    float flybyRadius = 0.0f;
+    for (std::size_t i = 0; i < registry.pool<RenderSphere>().size(); ++i) {
+        Entity e = registry.pool<RenderSphere>().entities()[i];
+        if (!registry.has<Emissive>(e) && registry.pool<RenderSphere>().data()[i].radius > flybyRadius) {
+            flybyTarget = e;
+            flybyRadius = registry.pool<RenderSphere>().data()[i].radius;
+        }
+    }
+    if (flybyFrames > 0 && flybyTarget == NULL_ENTITY) {
+        std::cout << "Flyby: the scene has no planet" << std::endl;
+        flybyFrames = 0;
+    }
+    if (flybyFrames > 0 && headless) {
+        std::cout << "Flyby: --headless flies its own pass" << std::endl;
+        flybyFrames = 0;
+    }
+    if (flybyFrames > 0) glfwSwapInterval(0);
+    int flybyFrame = 0;
+    double flybyMs[2] = {}, flybyOcclusionMs[2] = {};
+    std::size_t flybyVisible[2] = {}, flybyOccluded[2] = {};
+
+    // Headless runs time each frame to the end of its GPU work, on the CPU
+    // and with a pair of timestamps.
+    int headlessFrame = 0;
+    std::vector<double> headlessCpuMs, headlessGpuMs;
+    std::size_t headlessVisible = 0, headlessOccluded = 0;
+    unsigned int frameStamps[2] = {};
+    if (headless) glGenQueries(2, frameStamps);
+
+    double frameTimeSum = 0.0;
+    int frameCount = 0;
+    while (headless ? headlessFrame < headlessFrames : !glfwWindowShouldClose(window)) {
+#ifdef SOLAR_IMGUI
+        bool hudShown = hud && hudVisible;
+        CpuProfiler::setEnabled(!tracePath.empty() || hudShown);
+        std::uint64_t frameDrawCalls = Sphere::drawCalls();
+#endif
+        drainCpuTrace();
+        PROFILE_SCOPE("frame");
+        collectShaders(false);
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        float currentFrame = headless ? headlessFrame / 60.0f : (float)glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
-        processInput(window);
-
-        glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-        glm::mat4 projection = glm::perspective(glm::radians(fov), 800.0f/600.0f, 0.1f, 100.0f);
-        glm::mat4 view = glm::lookAt(camPos, camPos + camFront, camUp);
-
-        lightingShader.bind();
-        lightingShader.setUniformMat4f("projection", projection);
-        lightingShader.setUniformMat4f("view", view);
-        lightingShader.setUniformVec3f("viewPos", camPos);
-
-        lightingShader.setPointLight("pointLights[0]",
-                                     sunPos,
-                                     1.0f, 0.022f, 0.0019f,
-                                     {0.2f,0.2f,0.2f},
-                                     { 1.0f, 0.8f, 0.5f },
-                                     { 1.0f, 0.8f, 0.5f });
-        lightingShader.setUniform1f("material.shininess", 50.0f);
-
-        glm::mat4 modelSun = glm::translate(glm::mat4(1.0f), sunPos);
-        modelSun = glm::scale(modelSun, glm::vec3(0.5f));
-        lightingShader.setUniformMat4f("model", modelSun);
-        lightingShader.setUniform1i("isEmissive", true);
-        lightingShader.setUniformVec3f("emissiveColor", glm::vec3(1.0f, 0.2f, 0.0f));
-        sun.Draw(lightingShader);
-        earthAngle += currentEarthSpeed * deltaTime;
-        moonAngle += currentMoonSpeed * deltaTime;
-        float earthOrbitRadius = 3.0f;
-        earthPos = sunPos + glm::vec3(
-            earthOrbitRadius * cos(earthAngle),
-            0.0f,
-            earthOrbitRadius * sin(earthAngle)
-        );
-
-        float moonOrbitRadius = 0.5f;
-         moonPos = earthPos + glm::vec3(
-            moonOrbitRadius * cos(moonAngle),
-            0.0f,
-            moonOrbitRadius * sin(moonAngle)
-        );
-
-        glm::mat4 earthModel = glm::translate(glm::mat4(1.0f), earthPos);
-        float selfRotateSpeed = 0.5f;
-        earthModel = glm::rotate(earthModel, currentFrame * selfRotateSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-        earthModel = glm::scale(earthModel, glm::vec3(0.3f));
-
-
-        lightingShader.setUniformMat4f("model", earthModel);
-        lightingShader.setUniform1i("isEmissive", false);
-        lightingShader.setUniformVec3f("objectColor", glm::vec3(0.2f, 0.4f, 0.8f));
-         lightingShader.setUniformVec3f("moonPos", moonPos);
-         lightingShader.setUniform1f("moonRadius", 0.15f);
-
-
-        earth.Draw(lightingShader);
-
-
-        glm::mat4 moonModel = glm::translate(glm::mat4(1.0f), moonPos);
-        moonModel = glm::rotate(moonModel, currentFrame * selfRotateSpeed, glm::vec3(0.7f, 0.7f, 0.7f));
-        moonModel = glm::scale(moonModel, glm::vec3(0.15f));
-
-        lightingShader.setUniformMat4f("model", moonModel);
-        lightingShader.setUniform1i("isEmissive", false);
-        lightingShader.setUniformVec3f("objectColor", glm::vec3(0.7f, 0.7f, 0.7f));
-        lightingShader.setUniformVec3f("earthPos", earthPos);
-        lightingShader.setUniform1f("earthRadius", 0.3f);
-        lightingShader.setUniformVec3f("sunPos", sunPos);
-
-        moon.Draw(lightingShader);
+        if (headless) {
+            renderTarget->bind();
+            glQueryCounter(frameStamps[0], GL_TIMESTAMP);
+            if (flybyTarget != NULL_ENTITY)
+                flybyCamera((double)headlessFrame / headlessFrames, registry.get<Transform>(flybyTarget).position,
+                            flybyRadius, camPos, camFront);
+        } else {
+            processInput(window);
+        }
+        gpuProfiler.beginFrame();
+#ifdef SOLAR_IMGUI
+        if (hudShown) primitiveStats.begin();
+#endif
+        if (flybyFrames > 0) {
+            int pass = flybyFrame / flybyFrames;
+            if (pass > 0 || flybyFrame % flybyFrames > 0)
+                flybyMs[(flybyFrame - 1) / flybyFrames] += deltaTime * 1000.0;
+            if (pass == 2) {
+                for (int p = 0; p < 2; ++p)
+                    std::cout << "flyby, occlusion culling " << (p == 0 ? "on:  " : "off: ") << flybyMs[p] / flybyFrames
+                              << " ms/frame, " << (double)flybyVisible[p] / flybyFrames << " bodies in the frustum, "
+                              << 100.0 * flybyOccluded[p] / std::max<std::size_t>(flybyVisible[p], 1) << "% occluded, occlusion pass "
+                              << flybyOcclusionMs[p] / flybyFrames << " ms" << std::endl;
+                std::cout << "flyby: occlusion culling saves " << (flybyMs[1] - flybyMs[0]) / flybyFrames << " ms/frame" << std::endl;
+                break;
+            }
+            occlusionCulling = pass == 0;
+            flybyCamera((double)(flybyFrame % flybyFrames) / flybyFrames, registry.get<Transform>(flybyTarget).position,
+                        flybyRadius, camPos, camFront);
+        }
+
+        {
+            GpuScope scope(gpuProfiler, "clear");
+            glClearColor(0.05f, 0.05f, 0.1f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        }
+
+        const float zNear = 0.1f, zFar = 100.0f;
+        float aspect = headless ? (float)headlessWidth / headlessHeight : 800.0f / 600.0f;
+        glm::mat4 projection = glm::perspective(glm::radians(fov), aspect, zNear, zFar);
+        // The camera sits at the origin of render space.
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), camFront, camUp);
+
+        {
+            PROFILE_SCOPE("simulation");
+            stepOrbits(deltaTime);
+            spinSystem(registry, scene, currentFrame);
+            scene.update(camPos);
+            transformSystem(registry, scene);
+        }
+
+        float shadowFar = 0.0f;
+        if (shadowMode == 1) {
+            GpuScope scope(gpuProfiler, "shadows");
+            shadowFar = shadowMapSystem(registry, scene, shadowMap, depthShader, casterMesh);
+        }
+
+        // Occluders are set once per frame so every draw sees this frame's
+        // camera-relative positions.
+        if (shadowMode == 0) occluderSystem(registry, occluderLists);
+        visibilitySystem(registry, frustumCuller, projection * view, visibleSpheres);
+        std::size_t frustumVisible = visibleSpheres.size();
+        auto occlusionStart = std::chrono::high_resolution_clock::now();
+        occludedSpheres = occlusionCulling ? occlusionSystem(registry, scene, occlusionBuffer, &occlusionRasterizer,
+                                                             view, projection, zNear, visibleSpheres) : 0;
+        if (flybyFrames > 0) {
+            int pass = flybyFrame++ / flybyFrames;
+            flybyOcclusionMs[pass] += ms(occlusionStart, std::chrono::high_resolution_clock::now());
+            flybyVisible[pass] += frustumVisible;
+            flybyOccluded[pass] += occludedSpheres;
+        }
+        drawOrderSystem(registry, visibleSpheres, drawOrder);
+        if (!headless) glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+        lightClusters.setProjection(projection, zNear, zFar);
+        glm::vec3 sunPos = lightSystem(registry, lightClusters, view);
+
+        lightClusters.bind(3);
+        occluderLists.bind(2);
+        shadowMap.bind(1);
+        atmosphereTables.bind(10);
+        // Compile-time features shared by every draw this frame.
+        std::uint32_t frameFeatures = lightCountFeature(lightClusters.lightCount());
+        if (lightClusters.lightCount() > 0 && registry.pool<ShadowCaster>().size() > 0) {
+            frameFeatures |= FEATURE_SHADOWS;
+            if (shadowMode == 1 && shadowFar > 0.0f) frameFeatures |= FEATURE_SHADOW_MAP;
+        }
+        bool drawAtmosphere = atmosphereEnabled && lightClusters.lightCount() > 0 && registry.pool<Atmosphere>().size() > 0;
+        if (drawAtmosphere) frameFeatures |= FEATURE_ATMOSPHERE;
+        auto setFrameUniforms = [&](Shader& shader) {
+            shader.setUniformMat4f("projection", projection);
+            shader.setUniformMat4f("view", view);
+            shader.setUniformVec3f("viewPos", glm::vec3(0.0f));
+            shader.setUniformVec3f("sunPos", sunPos);
+            shader.setUniform1i("clusterLights", 3);
+            shader.setUniform1i("clusterGrid", 4);
+            shader.setUniform1i("clusterIndices", 5);
+            shader.setUniformVec2f("clusterScreen", glm::vec2(fbWidth, fbHeight));
+            shader.setUniformVec2f("clusterDepth", glm::vec2(lightClusters.depthScale(), lightClusters.depthBias()));
+            shader.setUniform1f("material.shininess", 50.0f);
+            shader.setUniform1i("occluderList", 2);
+            shader.setUniform1i("shadowMap", 1);
+            shader.setUniform1f("shadowFar", shadowFar);
+            shader.setUniform1i("transmittanceLUT", 10);
+            shader.setUniform1i("inscatterLUT", 11);
+        };
+
+        // Deferred: fill the G-buffer first, then light each pixel once.
+        if (renderPath == 1) {
+            gbuffer.resize(fbWidth, fbHeight);
+            {
+                GpuScope scope(gpuProfiler, "gbuffer");
+                gbuffer.bindForGeometry();
+                renderSystem(registry, scene, gbufferShader, occluderLists, drawOrder,
+                             frameFeatures & FEATURE_ATMOSPHERE, [&](Shader& shader) {
+                    shader.setUniformMat4f("projection", projection);
+                    shader.setUniformMat4f("view", view);
+                });
+            }
+            GpuScope scope(gpuProfiler, "lighting");
+            glBindFramebuffer(GL_FRAMEBUFFER, targetFbo);
+            glViewport(0, 0, fbWidth, fbHeight);
+
+            deferredShader.select(frameFeatures);
+            setFrameUniforms(deferredShader);
+            gbuffer.bindTextures(6);
+            deferredShader.setUniform1i("gAlbedo", 6);
+            deferredShader.setUniform1i("gNormal", 7);
+            deferredShader.setUniform1i("gOccluders", 8);
+            deferredShader.setUniform1i("gDepth", 9);
+            deferredShader.setUniformMat4f("inverseProjection", glm::inverse(projection));
+            deferredShader.setUniformMat4f("inverseView", glm::inverse(view));
+            glDisable(GL_DEPTH_TEST);
+            gbuffer.drawFullscreen();
+            glEnable(GL_DEPTH_TEST);
+            // The passes after this one (field, shells) test against the scene.
+            gbuffer.blitDepth(targetFbo);
+        } else {
+            if (depthPrepass) {
+                GpuScope scope(gpuProfiler, "prepass");
+                depthOnlyShader.bind();
+                depthOnlyShader.setUniformMat4f("projection", projection);
+                depthOnlyShader.setUniformMat4f("view", view);
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                depthPrepassSystem(registry, scene, depthOnlyShader, drawOrder);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                glDepthFunc(GL_EQUAL);
+                glDepthMask(GL_FALSE);
+            }
+            GpuScope scope(gpuProfiler, "bodies");
+            fragmentStats.begin();
+            renderSystem(registry, scene, lightingShader, occluderLists, drawOrder, frameFeatures, setFrameUniforms);
+            fragmentStats.end();
+            glDepthFunc(GL_LESS);
+            glDepthMask(GL_TRUE);
+        }
+
+        // Asteroid field, on either path now that both leave the scene depth
+        // in the target. The GPU path tests against the Hi-Z pyramid of the
+        // previous frame, rebuilt here from this frame's depth once the field
+        // is in it.
+        bool gpuField = field && cullShader && gpuCulling;
+        double fieldCullMs = 0.0;
+        if (field) {
+            glm::vec3 origin = fieldAnchor != NULL_ENTITY ? registry.get<Transform>(fieldAnchor).renderPos : glm::vec3(-camPos);
+            if (gpuField) {
+                GpuScope scope(gpuProfiler, "field cull");
+                field->cullGpu(*cullShader, projection * view, origin, hiZValid ? hiZ.get() : nullptr,
+                               hiZViewProjection, glm::vec3(camPos - hiZCamPos));
+            } else {
+                auto cullStart = std::chrono::high_resolution_clock::now();
+                field->cullCpu(projection * view, origin);
+                fieldCullMs = ms(cullStart, std::chrono::high_resolution_clock::now());
+            }
+            GpuScope scope(gpuProfiler, "field");
+            instancedShader->bind();
+            instancedShader->setUniformMat4f("projection", projection);
+            instancedShader->setUniformMat4f("view", view);
+            instancedShader->setUniformVec3f("origin", origin);
+            instancedShader->setUniformVec3f("sunPos", sunPos);
+            const Emissive* sun = registry.pool<Emissive>().size() > 0 ? &registry.pool<Emissive>().data()[0] : nullptr;
+            instancedShader->setUniformVec3f("sunAmbient", sun ? sun->ambient : glm::vec3(0.1f));
+            instancedShader->setUniformVec3f("sunDiffuse", sun ? sun->diffuse : glm::vec3(0.0f));
+            field->draw(fieldMesh);
+        }
+        if (gpuField) {
+            GpuScope scope(gpuProfiler, "hi-z");
+            hiZ->build(targetFbo, fbWidth, fbHeight);
+            hiZViewProjection = projection * view;
+            hiZCamPos = camPos;
+        }
+        hiZValid = gpuField;
+
+        if (drawAtmosphere) {
+            GpuScope scope(gpuProfiler, "atmosphere");
+            atmosphereShader.bind();
+            atmosphereShader.setUniformMat4f("projection", projection);
+            atmosphereShader.setUniformMat4f("view", view);
+            atmosphereShader.setUniform1i("transmittanceLUT", 10);
+            atmosphereShader.setUniform1i("inscatterLUT", 11);
+            glm::vec3 sunColor = registry.pool<Emissive>().data()[0].diffuse;
+            atmosphereSystem(registry, atmosphereShader, shellMesh, atmosphereTables.params().top,
+                             sunPos, sunColor * atmosphereExposure);
+        }
+
+#ifdef SOLAR_IMGUI
+        if (hudShown) {
+            primitiveStats.end();
+            GpuScope scope(gpuProfiler, "ui");
+            PROFILE_SCOPE("hud");
+            HudStats stats;
+            stats.frameMs = deltaTime * 1000.0f;
+            stats.drawCalls = Sphere::drawCalls() - frameDrawCalls;
+            stats.primitives = primitiveStats.last();
+            stats.textureBytes = shadowMap.bytes() + gbuffer.bytes() + atmosphereTables.bytes() + (hiZ ? hiZ->bytes() : 0);
+            stats.bufferBytes = casterMesh.getBufferBytes() + shellMesh.getBufferBytes() + fieldMesh.getBufferBytes()
+                              + (field ? field->bufferBytes() : 0);
+            for (const std::unique_ptr<Sphere>& s : sphereMeshes) {
+                stats.textureBytes += s->getTextureBytes();
+                stats.bufferBytes += s->getBufferBytes();
+            }
+            stats.bodies = registry.pool<RenderSphere>().size();
+            stats.inFrustum = frustumVisible;
+            stats.drawn = visibleSpheres.size();
+            if (field) {
+                // Reading the GPU cull's count back stalls, so only the CPU
+                // path reports it.
+                stats.fieldSize = field->size();
+                stats.fieldGpuCulled = gpuField;
+                if (!gpuField) stats.fieldDrawn = field->visibleCount();
+            }
+            HudToggles toggles = { &shadowMode, &renderPath, &depthPrepass, &atmosphereEnabled, &occlusionCulling, &gpuCulling };
+            hud->draw(stats, gpuProfiler, toggles);
+        }
+#endif
+        gpuProfiler.endFrame();
+
+        if (headless) {
+            glQueryCounter(frameStamps[1], GL_TIMESTAMP);
+            // Simulation and submission only; the GPU wait is the GPU frame.
+            headlessCpuMs.push_back(ms(frameStart, std::chrono::high_resolution_clock::now()));
+            glFinish();
+            GLuint64 stamps[2] = {};
+            glGetQueryObjectui64v(frameStamps[0], GL_QUERY_RESULT, &stamps[0]);
+            glGetQueryObjectui64v(frameStamps[1], GL_QUERY_RESULT, &stamps[1]);
+            headlessGpuMs.push_back((stamps[1] - stamps[0]) * 1e-6);
+            headlessVisible += visibleSpheres.size();
+            headlessOccluded += occludedSpheres;
+            ++headlessFrame;
+            continue;
+        }
 
         glfwSwapBuffers(window);
         glfwPollEvents();
+
+        // Average frame time per path, to compare forward and deferred on
+        // the same scene.
+        frameTimeSum += deltaTime;
+        if (++frameCount == 120) {
+            std::cout << (renderPath == 1 ? "deferred: " : depthPrepass ? "forward+prepass: " : "forward: ")
+                      << frameTimeSum * 1000.0 / frameCount << " ms/frame";
+            std::cout << ", " << visibleSpheres.size() << "/" << registry.pool<RenderSphere>().size() << " visible";
+            if (occlusionCulling) std::cout << " (" << occludedSpheres << " occluded)";
+            if (renderPath == 0 && fragmentStats.supported())
+                std::cout << ", " << fragmentStats.last() << " shading pass fragments";
+            if (field) {
+                std::cout << ", field " << field->visibleCount() << "/" << field->size() << " drawn";
+                if (gpuField) std::cout << " (GPU cull)";
+                else std::cout << " (CPU cull " << fieldCullMs << " ms)";
+            }
+            std::cout << std::endl;
+            printGpuPasses(gpuProfiler);
+            frameTimeSum = 0.0;
+            frameCount = 0;
+        }
+    }
+
+    if (headless) {
+        // The first frames compile shader variants and fill caches, so the
+        // spread matters as much as the mean.
+        auto report = [&](const char* name, std::vector<double> t) {
+            double sum = 0.0;
+            for (double v : t) sum += v;
+            std::sort(t.begin(), t.end());
+            auto pct = [&](double p) { return t[std::min((std::size_t)(p * t.size()), t.size() - 1)]; };
+            std::cout << name << " mean " << sum / t.size() << " ms, p50 " << pct(0.5) << ", p95 " << pct(0.95)
+                      << ", max " << t.back() << std::endl;
+        };
+        std::cout << "headless " << (renderPath == 1 ? "deferred" : depthPrepass ? "forward+prepass" : "forward") << ", "
+                  << headlessFrames << " frames at " << fbWidth << "x" << fbHeight << ", "
+                  << (double)headlessVisible / headlessFrames << " bodies visible, "
+                  << (double)headlessOccluded / headlessFrames << " occluded" << std::endl;
+        report("  CPU frame:", headlessCpuMs);
+        report("  GPU frame:", headlessGpuMs);
+        gpuProfiler.flush();
+        printGpuPasses(gpuProfiler);
+#ifdef SOLAR_IMGUI
+        if (hud) std::cout << "  HUD: ui " << gpuProfiler.averageMs("ui") << " ms GPU, hud "
+                           << hud->cpuAverageMs("hud") << " ms CPU" << std::endl;
+#endif
+        writeTrace();
+        if (!screenshotPath.empty()) {
+            if (renderTarget->savePpm(screenshotPath)) std::cout << "Screenshot: " << screenshotPath << std::endl;
+            else std::cout << "Screenshot: cannot write " << screenshotPath << std::endl;
+        }
+        glDeleteQueries(2, frameStamps);
+        return 0;
     }
 
+    gpuProfiler.flush();
+    writeTrace();
+#ifdef SOLAR_IMGUI
+    hud.reset();
+#endif
     glfwTerminate();
     return 0;
 }
 
+// Rolling average GPU time of each pass.
+void printGpuPasses(const GpuProfiler& profiler)
+{
+    std::cout << "  GPU ms:";
+    for (const GpuProfiler::PassStats& s : profiler.stats())
+        std::cout << "  " << s.name << " " << s.averageMs;
+    if (profiler.droppedFrames() > 0) std::cout << " (" << profiler.droppedFrames() << " frames not ready in time)";
+    std::cout << std::endl;
+}
+
 void processInput(GLFWwindow *window){
-    float speed = 5.0f * deltaTime;
-    if(glfwGetKey(window, GLFW_KEY_W)==GLFW_PRESS) camPos += speed * camFront;
-    if(glfwGetKey(window, GLFW_KEY_S)==GLFW_PRESS) camPos -= speed * camFront;
-    if(glfwGetKey(window, GLFW_KEY_A)==GLFW_PRESS) camPos -= glm::normalize(glm::cross(camFront, camUp)) * speed;
-    if(glfwGetKey(window, GLFW_KEY_D)==GLFW_PRESS) camPos += glm::normalize(glm::cross(camFront, camUp)) * speed;
+    double speed = 5.0 * deltaTime;
+    glm::dvec3 front = glm::dvec3(camFront);
+    glm::dvec3 right = glm::dvec3(glm::normalize(glm::cross(camFront, camUp)));
+    if(glfwGetKey(window, GLFW_KEY_W)==GLFW_PRESS) camPos += speed * front;
+    if(glfwGetKey(window, GLFW_KEY_S)==GLFW_PRESS) camPos -= speed * front;
+    if(glfwGetKey(window, GLFW_KEY_A)==GLFW_PRESS) camPos -= right * speed;
+    if(glfwGetKey(window, GLFW_KEY_D)==GLFW_PRESS) camPos += right * speed;
+    if (keyPressedOnce(window, GLFW_KEY_M)) shadowMode = 1 - shadowMode;
+    if (keyPressedOnce(window, GLFW_KEY_N)) renderPath = 1 - renderPath;
+    if (keyPressedOnce(window, GLFW_KEY_P)) depthPrepass = !depthPrepass;
+    if (keyPressedOnce(window, GLFW_KEY_B)) atmosphereEnabled = !atmosphereEnabled;
+    if (keyPressedOnce(window, GLFW_KEY_C)) gpuCulling = !gpuCulling;
+    if (keyPressedOnce(window, GLFW_KEY_O)) occlusionCulling = !occlusionCulling;
+#ifdef SOLAR_IMGUI
+    bool wasCursor = hudCursor;
+    if (keyPressedOnce(window, GLFW_KEY_F1)) hudVisible = !hudVisible;
+    if (keyPressedOnce(window, GLFW_KEY_F2)) hudCursor = !hudCursor;
+    if (!hudVisible) hudCursor = false;
+    if (hudCursor != wasCursor)
+        glfwSetInputMode(window, GLFW_CURSOR, hudCursor ? GLFW_CURSOR_NORMAL : GLFW_CURSOR_DISABLED);
+#endif
+    // G: speed up and stop exactly at the next solar eclipse (moon in front),
+    // H: the same for a lunar eclipse. The stop itself happens in stepOrbits.
+    stopAtEclipse = false;
     if (glfwGetKey(window, GLFW_KEY_G) == GLFW_PRESS) {
-        if (!areAlignedOrSmth(sunPos, earthPos, moonPos)) {
-            currentEarthSpeed += 0.1f * deltaTime;
-            currentMoonSpeed += 0.1f * deltaTime;
-
-        }
-        else if (isMoonInFront(sunPos, earthPos, moonPos)) {
-            currentEarthSpeed = 0.0f;
-            currentMoonSpeed = 0.0f;
-        }
+        stopAtEclipse = true;
+        eclipseTarget = EclipseType::Solar;
     }
     else if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS) {
-		currentEarthSpeed = earthOrbitSpeed;    
-		currentMoonSpeed = moonOrbitSpeed;
+        ComponentPool<OrbitalElements>& orbits = registry.pool<OrbitalElements>();
+        for (std::size_t i = 0; i < orbits.size(); ++i)
+            orbits.data()[i].speed = orbits.data()[i].baseSpeed;
+        haltedAtEclipse = false;
         }
     
 if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS) {
-    if (!areAlignedOrSmth(sunPos, earthPos, moonPos)) {
-        currentEarthSpeed += 0.1f * deltaTime;
-        currentMoonSpeed += 0.1f * deltaTime;
+    stopAtEclipse = true;
+    eclipseTarget = EclipseType::Lunar;
+}
+    if (stopAtEclipse && !haltedAtEclipse) {
+        ComponentPool<OrbitalElements>& orbits = registry.pool<OrbitalElements>();
+        for (std::size_t i = 0; i < orbits.size(); ++i)
+            orbits.data()[i].speed += 0.1 * deltaTime;
+    }
+}
+
+bool keyPressedOnce(GLFWwindow* window, int key)
+{
+    static bool wasDown[GLFW_KEY_LAST + 1] = {};
+    bool down = glfwGetKey(window, key) == GLFW_PRESS;
+    bool pressed = down && !wasDown[key];
+    wasDown[key] = down;
+    return pressed;
+}
+
+void stepOrbits(double dt)
+{
+    // Eclipse prediction needs an earth and a moon on orbits.
+    if (earthEntity == NULL_ENTITY) {
+        orbitSystem(registry, scene, dt);
+        simTime += dt;
+        return;
+    }
+
+    const OrbitalElements& earthOrbit = registry.get<OrbitalElements>(earthEntity);
+    const OrbitalElements& moonOrbit = registry.get<OrbitalElements>(moonEntity);
+    const OrbitPhase& predicted = eclipses.phase();
+    if (predicted.earthSpeed != earthOrbit.speed || predicted.moonSpeed != moonOrbit.speed)
+        eclipses.reset({ earthOrbit.angle, moonOrbit.angle, earthOrbit.speed, moonOrbit.speed }, simTime);
+
+    // Events inside this step are consumed in order; an armed stop clamps the
+    // step so the bodies land on the syzygy instead of overshooting it.
+    double step = dt;
+    bool halt = false;
+    while (!eclipses.empty() && eclipses.peek().time <= simTime + dt) {
+        EclipseEvent e = eclipses.pop();
+        if (stopAtEclipse && e.type == eclipseTarget) {
+            step = e.time - simTime;
+            halt = true;
+            break;
+        }
+    }
+
+    orbitSystem(registry, scene, step);
+    simTime += step;
+
+    if (halt) {
+        ComponentPool<OrbitalElements>& orbits = registry.pool<OrbitalElements>();
+        for (std::size_t i = 0; i < orbits.size(); ++i)
+            orbits.data()[i].speed = 0.0;
+        haltedAtEclipse = true;
+    }
+}
+
+// Batch mode (--eclipses [years]): every eclipse at the scene's orbit speeds,
+// one earth orbit per year, timed for throughput comparisons.
+int listEclipses(double years)
+{
+    SceneData sceneData;
+    std::string error;
+    if (!loadScene(scenePath, sceneData, error)) {
+        std::cout << "Scene: " << error << std::endl;
+        return -1;
+    }
+    int earthIndex = sceneData.find("earth"), moonIndex = sceneData.find("moon");
+    if (earthIndex < 0 || moonIndex < 0 || sceneData.bodies()[earthIndex].orbitSpeed == 0.0) {
+        std::cout << "Scene has no orbiting earth and moon" << std::endl;
+        return -1;
+    }
+    const BodyRecord& earthRec = sceneData.bodies()[earthIndex];
+    const BodyRecord& moonRec = sceneData.bodies()[moonIndex];
+
+    const double TWO_PI = 6.28318530717958647692;
+    double yearLength = TWO_PI / std::abs(earthRec.orbitSpeed);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    EclipsePredictor predictor;
+    std::vector<EclipseEvent> events = predictor.listEvents(
+        { earthRec.orbitPhase, moonRec.orbitPhase, earthRec.orbitSpeed, moonRec.orbitSpeed }, 0.0, years * yearLength);
+    auto end = std::chrono::high_resolution_clock::now();
 
+    for (const EclipseEvent& e : events) {
+        std::cout << (e.type == EclipseType::Solar ? "solar " : "lunar ")
+                  << "year " << int(e.time / yearLength)
+                  << " t=" << e.time << "s\n";
     }
-    else if ( !isMoonInFront(sunPos, earthPos, moonPos)) {
-        currentEarthSpeed = 0.0f;
-        currentMoonSpeed = 0.0f;
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << events.size() << " eclipses in " << years << " years, predicted in "
+              << ms << " ms (" << (ms > 0.0 ? events.size() / ms : 0.0) << " events/ms)" << std::endl;
+    return 0;
+}
+
+// Microbenchmark (--bench-ecs [count]): `count` orbiting, spinning bodies
+// without GL, timing each system per entity.
+int benchEcs(int count)
+{
+    Registry reg;
+    SceneGraph graph;
+    BodyDesc root;
+    Entity center = createBody(reg, graph, root);
+    for (int i = 0; i < count; ++i) {
+        BodyDesc d;
+        d.parent = center;
+        d.orbitRadius = 2.0 + (i % 1000) * 0.001;
+        d.orbitSpeed = 0.01 + (i % 97) * 0.0001;
+        d.orbitPhase = i * 0.618;
+        d.radius = 0.01f;
+        d.spinSpeed = 0.5f;
+        d.castsShadow = true;
+        createBody(reg, graph, d);
+    }
+    graph.update(glm::dvec3(0.0));
+
+    const int frames = 100;
+    double orbitMs = 0.0, spinMs = 0.0, graphMs = 0.0, transformMs = 0.0;
+    auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    for (int f = 0; f < frames; ++f) {
+        auto t0 = std::chrono::high_resolution_clock::now();
+        orbitSystem(reg, graph, 0.016);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        spinSystem(reg, graph, f * 0.016f);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        graph.update(glm::dvec3(0.0, 0.0, 8.0));
+        auto t3 = std::chrono::high_resolution_clock::now();
+        transformSystem(reg, graph);
+        auto t4 = std::chrono::high_resolution_clock::now();
+        orbitMs += ms(t0, t1); spinMs += ms(t1, t2); graphMs += ms(t2, t3); transformMs += ms(t3, t4);
     }
+
+    auto report = [&](const char* name, double total, std::size_t n) {
+        std::cout << name << ": " << total / frames << " ms/frame, "
+                  << (n ? total * 1e6 / frames / n : 0.0) << " ns/entity (" << n << ")\n";
+    };
+    report("orbitSystem", orbitMs, reg.pool<OrbitalElements>().size());
+    report("spinSystem", spinMs, reg.pool<Spin>().size());
+    report("SceneGraph::update", graphMs, graph.size());
+    report("transformSystem", transformMs, reg.pool<Transform>().size());
+    return 0;
 }
-  //else if (glfwGetKey(window, GLFW_KEY_G) == GLFW_RELEASE) {
-  //    currentEarthSpeed = earthOrbitSpeed;    
-  //    currentMoonSpeed = moonOrbitSpeed;
-  //    }
+
+int bakeSceneFile(const std::string& in, const std::string& out)
+{
+    SceneData sceneData;
+    std::string error;
+    if (!loadScene(in, sceneData, error)) {
+        std::cout << "Scene: " << error << std::endl;
+        return -1;
+    }
+    if (!bakeScene(sceneData, out)) {
+        std::cout << "Scene: failed to write " << out << std::endl;
+        return -1;
+    }
+    std::cout << "Baked " << sceneData.bodyCount() << " bodies into " << out << std::endl;
+    return 0;
 }
-bool areAlignedOrSmth(glm::vec3 sunPos, glm::vec3 earthPos, glm::vec3 moonPos)
+
+// Loader benchmark (--bench-scene [count]): a generated catalog of `count`
+// asteroids, parsed from JSON, baked, mapped back and instantiated.
+int benchScene(int count)
 {
-    glm::vec3 sunToEarth = sunPos - earthPos;
-    glm::vec3 EarthToMoon = moonPos - earthPos;
-	glm::vec3 sunToMoon = sunPos - moonPos;
-    glm::vec3 cross = glm::cross(sunToEarth, EarthToMoon);
-    return glm::length(cross) < 0.01f;
+    std::string json = "{\"materials\":{\"sun\":{\"emissive\":[1,0.2,0]},\"rock\":{\"color\":[0.5,0.45,0.4]}},\"bodies\":[\n"
+                        "{\"name\":\"sun\",\"material\":\"sun\",\"radius\":0.5}";
+    json.reserve((std::size_t)count * 190);
+    char buf[256];
+    for (int i = 0; i < count; ++i) {
+        std::snprintf(buf, sizeof(buf),
+                      ",\n{\"name\":\"a%d\",\"parent\":\"sun\",\"material\":\"rock\",\"radius\":%.4f,"
+                      "\"orbit\":{\"radius\":%.5f,\"speed\":%.5f,\"phase\":%.5f},\"spin\":{\"axis\":[0,1,0],\"speed\":0.5}}",
+                      i, 0.01 + (i % 7) * 0.002, 2.0 + (i % 1000) * 0.002, 0.01 + (i % 97) * 0.0001, i * 0.618);
+        json += buf;
+    }
+    json += "]}";
+
+    auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    std::string error;
+    SceneData parsed;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    bool ok = parseSceneJson(json.data(), json.data() + json.size(), parsed, error);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    if (!ok) { std::cout << "Scene: " << error << std::endl; return -1; }
+
+    const std::string bakedPath = "bench_scene.ssb";
+    if (!bakeScene(parsed, bakedPath)) { std::cout << "Scene: failed to write " << bakedPath << std::endl; return -1; }
+    SceneData baked;
+    auto t2 = std::chrono::high_resolution_clock::now();
+    ok = loadBakedScene(bakedPath, baked, error);
+    auto t3 = std::chrono::high_resolution_clock::now();
+    if (!ok) { std::cout << "Scene: " << error << std::endl; return -1; }
+
+    Registry reg;
+    SceneGraph graph;
+    auto t4 = std::chrono::high_resolution_clock::now();
+    instantiateScene(baked, reg, graph, {});
+    auto t5 = std::chrono::high_resolution_clock::now();
+
+    std::cout << parsed.bodyCount() << " bodies, " << json.size() / (1024.0 * 1024.0) << " MiB JSON\n"
+              << "json parse:   " << ms(t0, t1) << " ms\n"
+              << "baked map:    " << ms(t2, t3) << " ms\n"
+              << "instantiate:  " << ms(t4, t5) << " ms" << std::endl;
+    std::remove(bakedPath.c_str());
+    return 0;
 }
 
-bool isMoonInFront(glm::vec3 sunPos, glm::vec3 earthPos, glm::vec3 moonPos)
+// Occluder culling benchmark (--bench-occluders [moons]): an earth with
+// `moons` moons on slightly inclined orbits. Every body receives and casts;
+// reports how many occluders the shader still loops over per fragment
+// (receivers weighted by radius^2 as a stand-in for screen area).
+int benchOccluders(int moons)
 {
-    double sunToEarth = glm::length(sunPos - earthPos);
-    double sunToMoon = glm::length(sunPos - moonPos);
-    
-    if (sunToMoon > sunToEarth)
-        return false;
-    else
-        return true;
+    glm::vec3 light(0.0f);
+    glm::vec3 earth(3.0f, 0.0f, 0.0f);
+    std::vector<glm::vec3> pos{ earth };
+    std::vector<float> radii{ 0.3f };
+    for (int i = 0; i < moons; ++i) {
+        float a = i * 2.39996f;
+        float r = 0.5f + 1.5f * (i % 101) / 100.0f;
+        float incline = 0.1f * std::sin(i * 0.7f);
+        pos.push_back(earth + glm::vec3(r * std::cos(a), r * std::sin(a) * incline, r * std::sin(a)));
+        radii.push_back(0.005f + 0.02f * (i % 13) / 12.0f);
+    }
+
+    OccluderLists lists;
+    for (std::size_t i = 0; i < pos.size(); ++i)
+        lists.addCaster(pos[i], radii[i], (std::uint32_t)i);
 
+    const int runs = 20;
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < runs; ++r)
+        lists.build(light, pos.data(), radii.data(), pos.size());
+    auto end = std::chrono::high_resolution_clock::now();
 
+    double weighted = 0.0, weights = 0.0;
+    for (std::size_t i = 0; i < pos.size(); ++i) {
+        double w = radii[i] * radii[i];
+        weighted += w * lists.count(i);
+        weights += w;
+    }
+    double ms = std::chrono::duration<double, std::milli>(end - start).count() / runs;
+    std::cout << pos.size() << " receivers x " << lists.casterCount() << " casters\n"
+              << "occluders per receiver:        " << (double)lists.listedCount() / pos.size() << "\n"
+              << "occluders per fragment (est.): " << weighted / weights << "\n"
+              << "without culling:               " << lists.casterCount() - 1 << "\n"
+              << "build: " << ms << " ms (" << lists.pairsTested() / (ms * 1000.0) << " M pair tests/s)" << std::endl;
+    return 0;
+}
+
+// Clustered lighting benchmark (--bench-lights [max]): 1, 2, 4 .. max
+// lights scattered through the default view, binned single-threaded and on
+// every hardware thread. "per cluster" is what a fragment loops over instead
+// of every light.
+int benchLights(int maxLights)
+{
+    const float zNear = 0.1f, zFar = 100.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, zNear, zFar);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    std::vector<ClusterLight> lights(std::max(maxLights, 1));
+    for (std::size_t i = 0; i < lights.size(); ++i) {
+        float t = (float)i;
+        float depth = 1.0f + std::fmod(t * 7.31f, 60.0f);
+        lights[i].position = glm::vec3(std::sin(t * 1.7f) * depth * 0.4f, std::cos(t * 2.3f) * depth * 0.3f, -depth);
+        lights[i].radius = 0.5f + std::fmod(t * 0.37f, 2.5f);
+        lights[i].ambient = glm::vec3(0.05f);
+        lights[i].diffuse = lights[i].specular = glm::vec3(1.0f);
+        lights[i].constant = 1.0f;
+        lights[i].linear = lights[i].quadratic = 0.0f;
+    }
+
+    LightClusters clusters;
+    clusters.setProjection(projection, zNear, zFar);
+    const int runs = 50;
+    auto time = [&](unsigned threads, int n) {
+        clusters.setThreads(threads);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < runs; ++r) clusters.build(lights.data(), n, view);
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count() / runs;
+    };
+
+    std::cout << "lights  1 thread ms  " << WorkerPool::shared().size()
+              << " threads ms  per cluster  max cluster\n";
+    for (int n = 1; n <= maxLights; n *= 2) {
+        double single = time(1, n);
+        double multi = time(0, n);
+        std::uint32_t most = 0;
+        for (int c = 0; c < LightClusters::COUNT; ++c) most = std::max(most, clusters.clusterCount(c));
+        std::cout << n << "  " << single << "  " << multi << "  "
+                  << (double)clusters.listedCount() / LightClusters::COUNT << "  " << most << "\n";
+    }
+    return 0;
 }
 
+// Normal matrix benchmark (--bench-normals [objects]): the per-object CPU
+// normal matrix (uniform-scale fast path and general inverse) against what
+// the vertex shaders used to do, a 4x4 inverse for every vertex of a
+// 256x128 sphere, all on the CPU. The GPU side is solar_bench's high-tess
+// scene (gpu_ms), run against a build with either vertex shader.
+int benchNormals(int objects)
+{
+    SceneGraph graph;
+    std::vector<SceneGraph::NodeId> uniformNodes, skewedNodes;
+    for (int i = 0; i < objects; ++i) {
+        SceneGraph::NodeId a = graph.createNode(), b = graph.createNode();
+        glm::quat r = glm::angleAxis(i * 0.1f, glm::normalize(glm::vec3(1.0f, i % 7, 2.0f)));
+        graph.setRotation(a, r);
+        graph.setScale(a, glm::vec3(0.5f + (i % 10) * 0.1f));
+        graph.setRotation(b, r);
+        graph.setScale(b, glm::vec3(1.0f, 0.5f, 2.0f));
+        uniformNodes.push_back(a);
+        skewedNodes.push_back(b);
+    }
+    graph.update(glm::dvec3(0.0));
+
+    auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    glm::mat3 sink(0.0f);
+    auto t0 = std::chrono::high_resolution_clock::now();
+    for (SceneGraph::NodeId n : uniformNodes) sink += graph.normalMatrix(n);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    for (SceneGraph::NodeId n : skewedNodes) sink += graph.normalMatrix(n);
+    auto t2 = std::chrono::high_resolution_clock::now();
+
+    const int sphereVertices = 257 * 129;
+    glm::mat4 model = graph.renderMatrix(uniformNodes[0]);
+    for (int v = 0; v < sphereVertices; ++v) {
+        model[3][0] = v * 1e-6f;
+        sink += glm::mat3(glm::transpose(glm::inverse(model)));
+    }
+    auto t3 = std::chrono::high_resolution_clock::now();
+
+    double fast = ms(t0, t1) * 1e6 / objects, general = ms(t1, t2) * 1e6 / objects;
+    double perVertex = ms(t2, t3) * 1e6 / sphereVertices;
+    std::cout << "uniform scale (fast path): " << fast << " ns/object\n"
+              << "non-uniform scale:         " << general << " ns/object\n"
+              << "old per-vertex inverse:    " << perVertex << " ns/vertex, "
+              << perVertex * sphereVertices / 1000.0 << " us per 256x128 sphere\n"
+              << "(checksum " << sink[0][0] << ")" << std::endl;
+    return 0;
+}
+
+// Atmosphere benchmark (--bench-atmosphere [runs]): building the scattering
+// tables on one thread and on every hardware thread, and loading them back
+// from the disk cache. The per-frame cost is the GPU time of the shell pass,
+// printed with the frame times when running the viewer.
+int benchAtmosphere(int runs)
+{
+    runs = std::max(runs, 1);
+    AtmosphereTables tables;
+    auto time = [&](unsigned threads) {
+        tables.setThreads(threads);
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < runs; ++r) tables.build();
+        auto end = std::chrono::high_resolution_clock::now();
+        return std::chrono::duration<double, std::milli>(end - start).count() / runs;
+    };
+    double single = time(1);
+    double multi = time(0);
+
+    const std::string cacheDir = "atmosphere_cache";
+    tables.save(cacheDir);
+    AtmosphereTables cached;
+    auto start = std::chrono::high_resolution_clock::now();
+    bool loaded = cached.load(cacheDir);
+    double loadMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+    glm::vec3 zenith = tables.transmittance(1.0f, 1.0f), horizon = tables.transmittance(1.0f, 0.0f);
+    std::cout << "tables: " << tables.bytes() / 1024 << " KiB\n"
+              << "build, 1 thread:  " << single << " ms\n"
+              << "build, " << WorkerPool::shared().size() << " threads: " << multi << " ms\n"
+              << "cache load:       " << (loaded ? loadMs : -1.0) << " ms\n"
+              << "ground transmittance, zenith " << zenith.r << " " << zenith.g << " " << zenith.b
+              << ", horizon " << horizon.r << " " << horizon.g << " " << horizon.b << std::endl;
+    return loaded ? 0 : -1;
+}
+
+// Frustum culling benchmark (--bench-cull [count]): `count` spheres in a
+// cube around the default camera, culled by every compiled-in path.
+int benchCull(int count)
+{
+    const float zNear = 0.1f, zFar = 100.0f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, zNear, zFar);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+    FrustumCuller culler;
+    culler.setPlanes(projection * view);
+    culler.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        float t = (float)i;
+        glm::vec3 p(std::fmod(t * 7.31f, 200.0f) - 100.0f, std::fmod(t * 3.17f, 200.0f) - 100.0f, std::fmod(t * 5.43f, 200.0f) - 100.0f);
+        culler.add(p, 0.1f + std::fmod(t * 0.37f, 1.0f), (std::uint32_t)i);
+    }
+
+    const int runs = 20;
+    std::vector<std::uint32_t> visible, reference;
+    const std::pair<FrustumCuller::Path, const char*> paths[] = {
+        { FrustumCuller::Path::Scalar, "scalar" }, { FrustumCuller::Path::SSE, "SSE" }, { FrustumCuller::Path::AVX, "AVX" } };
+    for (const auto& path : paths) {
+        culler.setPath(path.first);
+        if (culler.path() != path.first) {
+            std::cout << path.second << ": not compiled in\n";
+            continue;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int r = 0; r < runs; ++r) culler.cull(visible);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / runs;
+        if (path.first == FrustumCuller::Path::Scalar) reference = visible;
+        std::cout << path.second << ": " << ms << " ms, " << (ms > 0.0 ? count / ms : 0.0) << " spheres/ms, "
+                  << visible.size() << " visible" << (visible == reference ? "" : " (differs from scalar)") << "\n";
+    }
+    std::cout << std::flush;
+    return 0;
+}
+
+// Model BVH benchmark (--bench-bvh [meshes]): a station-like model of
+// `meshes` submeshes (modules of small parts along a long truss), seen from
+// inside one end. Times the SAH build, the cache round trip and the culling
+// traversal against testing every mesh box.
+int benchBvh(int meshes)
+{
+    std::vector<Bounds> boxes(std::max(meshes, 1));
+    for (std::size_t i = 0; i < boxes.size(); ++i) {
+        float t = (float)i;
+        glm::vec3 module(0.0f, 0.0f, -(float)(i / 64) * 4.0f);
+        glm::vec3 part(std::fmod(t * 1.37f, 3.0f) - 1.5f, std::fmod(t * 2.11f, 3.0f) - 1.5f, std::fmod(t * 0.73f, 3.0f) - 1.5f);
+        glm::vec3 size = glm::vec3(0.05f) + glm::vec3(std::fmod(t * 0.31f, 0.3f));
+        boxes[i].grow(module + part - size);
+        boxes[i].grow(module + part + size);
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(20.0f, 0.0f, 10.0f), glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::vec4 planes[6];
+    frustumPlanes(projection * view, planes);
+
+    auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    BoundsBVH bvh;
+    auto t0 = std::chrono::high_resolution_clock::now();
+    bvh.build(boxes);
+    auto t1 = std::chrono::high_resolution_clock::now();
+    const std::string cachePath = "bench.bvh";
+    bvh.save(cachePath);
+    BoundsBVH cached;
+    auto t2 = std::chrono::high_resolution_clock::now();
+    bool loaded = cached.load(cachePath, boxes);
+    auto t3 = std::chrono::high_resolution_clock::now();
+    std::remove(cachePath.c_str());
+
+    const int runs = 100;
+    std::vector<std::uint32_t> viaTree, brute;
+    auto t4 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < runs; ++r) {
+        viaTree.clear();
+        cached.cull(planes, boxes, [&](std::uint32_t i) { viaTree.push_back(i); });
+    }
+    auto t5 = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < runs; ++r) {
+        brute.clear();
+        for (std::uint32_t i = 0; i < boxes.size(); ++i) {
+            unsigned mask = 0x3Fu;
+            if (BoundsBVH::intersects(boxes[i], planes, mask)) brute.push_back(i);
+        }
+    }
+    auto t6 = std::chrono::high_resolution_clock::now();
+    std::sort(viaTree.begin(), viaTree.end());
+
+    std::cout << boxes.size() << " meshes, " << bvh.nodes().size() << " nodes\n"
+              << "build:       " << ms(t0, t1) << " ms\n"
+              << "cache load:  " << (loaded ? ms(t2, t3) : -1.0) << " ms\n"
+              << "cull (BVH):  " << ms(t4, t5) * 1000.0 / runs << " us, " << viaTree.size() << " visible\n"
+              << "cull (flat): " << ms(t5, t6) * 1000.0 / runs << " us, " << brute.size() << " visible"
+              << (viaTree == brute ? "" : " (differs)") << std::endl;
+    return loaded && viaTree == brute ? 0 : -1;
+}
+
+// A straight pass over a body at a quarter of its radius above the surface,
+// looking at its center, for t from 0 to 1.
+void flybyCamera(double t, const glm::dvec3& center, double radius, glm::dvec3& pos, glm::vec3& front)
+{
+    pos = center + radius * glm::dvec3(-4.0 + 8.0 * t, 0.15, 1.25);
+    front = glm::normalize(glm::vec3(center - pos));
+}
+
+// Occlusion culling benchmark (--bench-occlusion [bodies]): a sun, a large
+// planet and `bodies` small ones on a ring around the sun, with the camera
+// on the flyby path over the planet. Reports how many of the bodies in the
+// frustum the Hi-Z test removes and what the occlusion pass costs; the
+// frame time saved is what --flyby measures in the viewer.
+int benchOcclusion(int bodies)
+{
+    Registry reg;
+    SceneGraph graph;
+    auto add = [&](const BodyDesc& d) {
+        Entity e = createBody(reg, graph, d);
+        reg.add(e, RenderSphere{ nullptr, d.radius, d.color });
+        return e;
+    };
+    BodyDesc sun;
+    sun.radius = 0.5f;
+    Entity center = add(sun);
+    BodyDesc planet;
+    planet.position = glm::dvec3(8.0, 0.0, 0.0);
+    planet.radius = 1.0f;
+    Entity planetEntity = add(planet);
+    for (int i = 0; i < bodies; ++i) {
+        BodyDesc d;
+        d.parent = center;
+        d.orbitRadius = 3.0 + 11.0 * std::fmod(i * 0.618034, 1.0);
+        d.orbitSpeed = 0.02 + (i % 97) * 0.0002;
+        d.orbitPhase = i * 2.39996;
+        d.radius = 0.01f + 0.04f * (float)std::fmod(i * 0.414214, 1.0);
+        add(d);
+    }
+
+    const float zNear = 0.1f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, zNear, 100.0f);
+    FrustumCuller culler;
+    OcclusionBuffer buffer(256, 128);
+    OcclusionRasterizer rasterizer;
+    std::vector<std::uint32_t> visible;
+    const int frames = 300;
+    double frustumMs = 0.0, occlusionMs = 0.0;
+    std::size_t inFrustum = 0, occluded = 0;
+    auto ms = [](auto a, auto b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    for (int f = 0; f < frames; ++f) {
+        orbitSystem(reg, graph, 0.016);
+        graph.update(glm::dvec3(0.0));
+        transformSystem(reg, graph);
+        glm::dvec3 eye;
+        glm::vec3 front;
+        flybyCamera((double)f / frames, reg.get<Transform>(planetEntity).position, planet.radius, eye, front);
+        graph.update(eye);
+        transformSystem(reg, graph);
+        glm::mat4 view = glm::lookAt(glm::vec3(0.0f), front, glm::vec3(0.0f, 1.0f, 0.0f));
+
+        auto t0 = std::chrono::high_resolution_clock::now();
+        visibilitySystem(reg, culler, projection * view, visible);
+        auto t1 = std::chrono::high_resolution_clock::now();
+        inFrustum += visible.size();
+        occluded += occlusionSystem(reg, graph, buffer, &rasterizer, view, projection, zNear, visible);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        frustumMs += ms(t0, t1);
+        occlusionMs += ms(t1, t2);
+    }
+
+    std::cout << reg.pool<RenderSphere>().size() << " bodies, " << frames << " flyby frames\n"
+              << "in the frustum:  " << (double)inFrustum / frames << " per frame\n"
+              << "occluded:        " << (double)occluded / frames << " per frame ("
+              << 100.0 * occluded / std::max<std::size_t>(inFrustum, 1) << "%)\n"
+              << "frustum pass:    " << frustumMs / frames << " ms/frame\n"
+              << "occlusion pass:  " << occlusionMs / frames << " ms/frame" << std::endl;
+    return 0;
+}
+
+// Software occlusion rasterizer benchmark (--bench-raster [occluders]):
+// `occluders` spheres in front of the default camera drawn as proxies into
+// the 256x128 buffer by every compiled-in path, on one thread and on every
+// hardware thread, then 100000 small spheres behind them tested. The
+// analytic sphere occluders give the reference culling rate.
+int benchRaster(int occluders)
+{
+    const float zNear = 0.1f;
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, zNear, 100.0f);
+    std::vector<glm::vec4> spheres(std::max(occluders, 1));
+    std::vector<glm::mat4> models(spheres.size());
+    for (std::size_t i = 0; i < spheres.size(); ++i) {
+        float t = (float)i;
+        spheres[i] = glm::vec4(std::fmod(t * 2.71f, 8.0f) - 4.0f, std::fmod(t * 1.93f, 5.0f) - 2.5f, -6.0f - std::fmod(t * 3.1f, 6.0f),
+                               0.6f + std::fmod(t * 0.37f, 1.0f));
+        models[i] = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(spheres[i])), t, glm::vec3(0.3f, 1.0f, 0.2f)),
+                               glm::vec3(spheres[i].w));
+    }
+    std::vector<glm::vec4> tests(100000);
+    for (std::size_t i = 0; i < tests.size(); ++i) {
+        float t = (float)i;
+        tests[i] = glm::vec4(std::fmod(t * 7.31f, 24.0f) - 12.0f, std::fmod(t * 3.17f, 16.0f) - 8.0f, -12.0f - std::fmod(t * 5.43f, 30.0f),
+                             0.02f + std::fmod(t * 0.13f, 0.2f));
+    }
+
+    OcclusionBuffer buffer(256, 128);
+    auto countCulled = [&]() {
+        std::size_t culled = 0;
+        for (const glm::vec4& s : tests) culled += !buffer.visible(glm::vec3(s), s.w);
+        return culled;
+    };
+    buffer.begin(projection, zNear);
+    for (const glm::vec4& s : spheres) buffer.addOccluder(glm::vec3(s), s.w);
+    buffer.buildHiZ();
+    std::cout << spheres.size() << " occluders, " << tests.size() << " test spheres\n"
+              << "analytic spheres: " << buffer.coveredTexels() << " texels covered, " << countCulled() << " culled\n";
+
+    const int runs = 100;
+    OcclusionRasterizer rasterizer;
+    const std::pair<OcclusionRasterizer::Path, const char*> paths[] = {
+        { OcclusionRasterizer::Path::Scalar, "scalar" }, { OcclusionRasterizer::Path::SSE, "SSE" }, { OcclusionRasterizer::Path::AVX, "AVX" } };
+    for (const auto& path : paths) {
+        rasterizer.setPath(path.first);
+        if (rasterizer.path() != path.first) {
+            std::cout << path.second << ": not compiled in\n";
+            continue;
+        }
+        for (unsigned threads : { 1u, 0u }) {
+            rasterizer.setThreads(threads);
+            auto start = std::chrono::high_resolution_clock::now();
+            for (int r = 0; r < runs; ++r) {
+                buffer.begin(projection, zNear);
+                rasterizer.begin(buffer.width(), buffer.height());
+                for (const glm::mat4& model : models) rasterizer.addSphere(projection * model);
+                rasterizer.render(buffer);
+                buffer.buildHiZ();
+            }
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / runs;
+            std::cout << path.second << ", " << (threads ? 1u : WorkerPool::shared().size()) << " thread(s): "
+                      << ms << " ms, " << rasterizer.triangleCount() << " triangles, " << buffer.coveredTexels()
+                      << " texels covered, " << countCulled() << " culled\n";
+        }
+    }
+    std::cout << std::flush;
+    return 0;
+}
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos){
+    // A free cursor is the HUD's; looking resumes from wherever it is left.
+    if (hudCursor) { firstMouse = true; return; }
     if(firstMouse){ lastX=(float)xpos; lastY=(float)ypos; firstMouse=false; }
     float xoffset = (float)xpos - lastX;
     float yoffset = lastY - (float)ypos;
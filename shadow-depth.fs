@@ -0,0 +1,50 @@
+#shader vertex
+#version 330 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 3) in mat4 instanceModel;
+
+void main()
+{
+    gl_Position = instanceModel * vec4(aPos, 1.0);
+}
+
+#shader geometry
+#version 330 core
+
+// One pass for all six cube faces: every caster triangle is emitted once
+// per face into its own layer.
+layout (triangles) in;
+layout (triangle_strip, max_vertices = 18) out;
+
+uniform mat4 shadowMatrices[6];
+
+out vec3 FragPos;
+
+void main()
+{
+    for(int face = 0; face < 6; ++face)
+    {
+        gl_Layer = face;
+        for(int i = 0; i < 3; ++i)
+        {
+            FragPos = gl_in[i].gl_Position.xyz;
+            gl_Position = shadowMatrices[face] * gl_in[i].gl_Position;
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+}
+
+#shader fragment
+#version 330 core
+
+in vec3 FragPos;
+
+uniform vec3 lightPos;
+uniform float farPlane;
+
+void main()
+{
+    gl_FragDepth = length(FragPos - lightPos) / farPlane;
+}
@@ -3,13 +3,13 @@
 
 layout(location = 0) in vec3 aPos;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#include "glsl/transform.glsl"
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    vec3 worldPos;
+    float viewDepth;
+    gl_Position = transformVertex(aPos, worldPos, viewDepth);
 }
 
 #shader fragment